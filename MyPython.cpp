@@ -6,6 +6,44 @@
 #include <cctype>
 #include <deque>
 #include <map>
+#include <algorithm>
+#include <unordered_map>
+#include <memory>
+#include <stdexcept>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <type_traits>
+#include <cmath>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <csignal>
+#include <poll.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "connection.h"
 using namespace std;
 
 // All tokens must derive from this token type
@@ -21,9 +59,10 @@ class base_token
 		type_of_token token_type;
 	public:
 		base_token(type_of_token token) : token_type(token) { };
+		virtual ~base_token() { };
         int get_token_type();
 		virtual string get_token_value() = 0;
-		virtual int parse_token(fstream& stream, int input_char) = 0;
+		virtual int parse_token(istream& stream, int input_char) = 0;
 		virtual void print_token() = 0;
 };
 
@@ -39,7 +78,7 @@ class symbol_token : public base_token
 	public:
 		symbol_token() : base_token(t_symbol) { };
         string get_token_value();
-		int parse_token(fstream& stream, int input_char);
+		int parse_token(istream& stream, int input_char);
 		void print_token();
 };
 
@@ -47,7 +86,8 @@ string symbol_token::get_token_value() {
     return symbol;
 };
 
-// A token that represents an integer
+// A token that represents a number: an integer, or a float when it has a
+// fraction or an exponent
 class integer_token : public base_token
 {
 	private:
@@ -55,7 +95,7 @@ class integer_token : public base_token
 	public:
 		integer_token() : base_token(t_integer) { };
         string get_token_value();
-		int parse_token(fstream& stream, int input_char);
+		int parse_token(istream& stream, int input_char);
 		void print_token();
 };
 
@@ -71,7 +111,7 @@ class literal_token : public base_token
 	public:
 		literal_token() : base_token(t_literal) { };
         string get_token_value();
-		int parse_token(fstream& stream, int input_char);
+		int parse_token(istream& stream, int input_char);
 		void print_token();
 };
 
@@ -87,7 +127,7 @@ class constant_token : public base_token
 	public:
 		constant_token() : base_token(t_constant) { };
         string get_token_value();
-		int parse_token(fstream& stream, int input_char);
+		int parse_token(istream& stream, int input_char);
 		void print_token();
 };
 
@@ -103,7 +143,7 @@ class punctuation_token : public base_token
 	public:
 		punctuation_token() : base_token(t_punctuation) { };
         string get_token_value();
-		int parse_token(fstream& stream, int input_char);
+		int parse_token(istream& stream, int input_char);
 		void print_token();
 };
 
@@ -117,7 +157,7 @@ class whitespace_token : public base_token
 	public:
 		whitespace_token() : base_token(t_whitespace) { };
         string get_token_value();
-		int parse_token(fstream& stream, int input_char);
+		int parse_token(istream& stream, int input_char);
 		void print_token();
 };
 
@@ -131,7 +171,7 @@ class eol_token : public base_token
 	public:
 		eol_token() : base_token(t_eol) { };
         string get_token_value();
-		int parse_token(fstream& stream, int input_char);
+		int parse_token(istream& stream, int input_char);
 		void print_token();
 };
 
@@ -149,12 +189,12 @@ class indent_token : public base_token
             indent_level = current_indent;
         };
         string get_token_value();
-		int parse_token(fstream& stream, int input_char);
+		int parse_token(istream& stream, int input_char);
 		void print_token();
 };
 
 string indent_token::get_token_value() {
-    return "0";
+    return to_string(indent_level);
 };
 
 // A token that represents an dedent
@@ -167,12 +207,12 @@ class dedent_token : public base_token
             dedent_level = current_indent;
         };
         string get_token_value();
-		int parse_token(fstream& stream, int input_char);
+		int parse_token(istream& stream, int input_char);
 		void print_token();
 };
 
 string dedent_token::get_token_value() {
-    return "0";
+    return to_string(dedent_level);
 };
 
 // A token that represents an eof
@@ -181,7 +221,7 @@ class eof_token : public base_token
 	public:
 		eof_token() : base_token(t_eof) { };
         string get_token_value();
-		int parse_token(fstream& stream, int input_char);
+		int parse_token(istream& stream, int input_char);
 		void print_token();
 };
 
@@ -197,7 +237,7 @@ class invalid_token : public base_token
 	public:
 		invalid_token() : base_token(t_invalid_token) { };
         string get_token_value();
-		int parse_token(fstream& stream, int input_char);
+		int parse_token(istream& stream, int input_char);
 		void print_token();
 };
 
@@ -209,10 +249,11 @@ string invalid_token::get_token_value() {
 class token_parser
 {
 	private:
-		fstream& source_stream;
+		istream& source_stream;
 		list<base_token *> token_list;
 	public:
-		token_parser(fstream& stream) : source_stream(stream) { };
+		token_parser(istream& stream) : source_stream(stream) { };
+		~token_parser();
         //vector<pair<int, string> > get_token_vector();
         deque<pair<int,string>> get_token_vector();
 		bool parse_tokens();
@@ -231,6 +272,11 @@ vector<pair<int, string> > token_parser::get_token_vector() {
     return token_vector;
 };
 */
+token_parser::~token_parser() {
+	for (base_token *token : token_list)
+		delete token;
+}
+
 deque<pair<int, string>> token_parser::get_token_vector(){
     deque<pair<int, string>> token_vector;
     list<base_token *>::iterator iterator;
@@ -245,7 +291,7 @@ deque<pair<int, string>> token_parser::get_token_vector(){
 }
 
 // parse the rest of a symbol
-int symbol_token::parse_token(fstream& stream, int input_char) {
+int symbol_token::parse_token(istream& stream, int input_char) {
 	symbol = input_char;
 	while (true) {
 		input_char = stream.get();
@@ -263,8 +309,9 @@ void symbol_token::print_token() {
 }
 
 // parse the rest of an integer
-int integer_token::parse_token(fstream& stream, int input_char) {
+int integer_token::parse_token(istream& stream, int input_char) {
 	integer_string = input_char;
+	bool fraction = input_char == '.', exponent = false;
 	if (input_char == '0')
 	{
 		input_char = stream.peek();
@@ -287,6 +334,20 @@ int integer_token::parse_token(fstream& stream, int input_char) {
 			integer_string += input_char;
 			continue;
 		}
+		if (input_char == '.' && !fraction && !exponent) {
+			fraction = true;
+			integer_string += input_char;
+			continue;
+		}
+		if ((input_char == 'e' || input_char == 'E') && !exponent) {
+			int p = stream.peek();
+			if (isdigit(p) || p == '+' || p == '-') {
+				exponent = true;
+				integer_string += input_char;
+				integer_string += (char)stream.get();
+				continue;
+			}
+		}
 		return input_char;
 	}
 }
@@ -297,7 +358,7 @@ void integer_token::print_token() {
 }
 
 // parse the rest of a literal
-int literal_token::parse_token(fstream& stream, int input_char) {
+int literal_token::parse_token(istream& stream, int input_char) {
 	literal_string.clear();
 	while (true) {
 		input_char = stream.get();
@@ -317,7 +378,9 @@ int literal_token::parse_token(fstream& stream, int input_char) {
 				cout << "error: EOF encountered before closing literal quotes" << endl;
 				exit(0);
 			}
-			literal_string += input_char;
+			// keep other escapes for the compiler to translate
+			literal_string += '\\';
+			literal_string += stream.get();
 			continue;
 		}
 		if (input_char != '\"' && input_char != -1) {
@@ -339,7 +402,7 @@ void literal_token::print_token() {
 }
 
 // parse the rest of a literal
-int constant_token::parse_token(fstream& stream, int input_char) {
+int constant_token::parse_token(istream& stream, int input_char) {
 	constant_string.clear();
 	while (true) {
 		input_char = stream.get();
@@ -351,9 +414,18 @@ int constant_token::parse_token(fstream& stream, int input_char) {
 				constant_string += input_char;
 				continue;
 			}
-			constant_string += input_char;
+			if (input_char == 0x0A || input_char == -1) {
+				cout << "error: EOL encountered before closing literal quotes" << endl;
+				exit(0);
+			}
+			constant_string += '\\';
+			constant_string += stream.get();
 			continue;
 		}
+		if (input_char == -1) {
+			cout << "error: EOF encountered before closing literal quotes" << endl;
+			exit(0);
+		}
 		if (input_char != '\'') {
 			constant_string += input_char;
 			continue;
@@ -373,7 +445,7 @@ void constant_token::print_token() {
 // punctuation string. NB: The sequence .. is accepted as a 
 // punctuation token, but must be rejected by the compiler at
 // some later stage.
-int punctuation_token::parse_token(fstream& stream, int input_char) {
+int punctuation_token::parse_token(istream& stream, int input_char) {
 	punctuation_string = input_char;
 	switch (input_char) {
 	case '!': // Looking for either ! or !=
@@ -404,11 +476,16 @@ int punctuation_token::parse_token(fstream& stream, int input_char) {
 			punctuation_string += input_char; // && token
 		}
 		break;
-	case '*': // Looking for either * or *=
+	case '*': // Looking for either *, *=, ** or **=
 		input_char = stream.peek();
+		if (input_char == '*') {
+			input_char = stream.get();
+			punctuation_string += input_char; // ** token
+			input_char = stream.peek();
+		}
 		if (input_char == '=') {
 			input_char = stream.get();
-			punctuation_string += input_char; // *= token
+			punctuation_string += input_char; // *= or **= token
 		}
 		break;
 	case '+': // Looking for either +, ++, or +=
@@ -446,11 +523,16 @@ int punctuation_token::parse_token(fstream& stream, int input_char) {
 			}
 		}
 		break;
-	case '/': // Looking for either / or /=
+	case '/': // Looking for either /, /=, // or //=
 		input_char = stream.peek();
+		if (input_char == '/') {
+			input_char = stream.get();
+			punctuation_string += input_char; // // token
+			input_char = stream.peek();
+		}
 		if (input_char == '=') {
 			input_char = stream.get();
-			punctuation_string += input_char; // /= token
+			punctuation_string += input_char; // /= or //= token
 		}
 		break;
 	case ':': // Looking for either : or ::
@@ -501,6 +583,13 @@ int punctuation_token::parse_token(fstream& stream, int input_char) {
 			}
 		}
 		break;
+	case '^': // Looking for either ^ or ^=
+		input_char = stream.peek();
+		if (input_char == '=') {
+			input_char = stream.get();
+			punctuation_string += input_char; // ^= token
+		}
+		break;
 	case '|': // Looking for either |, |=, or || 
 		input_char = stream.peek();
 		if (input_char == '|' || input_char == '=') {
@@ -519,7 +608,7 @@ void punctuation_token::print_token() {
 }
 
 // parse the whitespace characters
-int whitespace_token::parse_token(fstream& stream, int input_char) {
+int whitespace_token::parse_token(istream& stream, int input_char) {
 	while (true) {
 		input_char = stream.get();
 		if (input_char == ' ' || input_char == 0x09 || input_char == 0x0B || input_char == 0x0D) {
@@ -535,7 +624,7 @@ void whitespace_token::print_token() {
 }
 
 // parse the eol character
-int eol_token::parse_token(fstream& stream, int input_char) {
+int eol_token::parse_token(istream& stream, int input_char) {
 	while (true) {
 		input_char = stream.get();
 		return input_char;
@@ -548,7 +637,7 @@ void eol_token::print_token() {
 }
 
 // parse the indent character
-int indent_token::parse_token(fstream& stream, int input_char) {
+int indent_token::parse_token(istream& stream, int input_char) {
 	while (true) {
 		input_char = stream.get();
 		return input_char;
@@ -561,7 +650,7 @@ void indent_token::print_token() {
 }
 
 // parse the dedent character
-int dedent_token::parse_token(fstream& stream, int input_char) {
+int dedent_token::parse_token(istream& stream, int input_char) {
 	while (true) {
 		input_char = stream.get();
 		return input_char;
@@ -574,7 +663,7 @@ void dedent_token::print_token() {
 }
 
 // parse the eof character
-int eof_token::parse_token(fstream& stream, int input_char) {
+int eof_token::parse_token(istream& stream, int input_char) {
 	return 0;
 }
 
@@ -584,7 +673,7 @@ void eof_token::print_token(void) {
 }
 
 // parse the invalid character
-int invalid_token::parse_token(fstream& stream, int input_char) {
+int invalid_token::parse_token(istream& stream, int input_char) {
 	invalid_character = input_char;
 	input_char = stream.get();
 	return input_char;
@@ -616,11 +705,14 @@ bool token_parser::parse_tokens() {
 			{
 				// Remove any comments from the source
 				if (input_char == '#') {
+					// Stop in front of the newline so that it still
+					// produces the indentation of the next line
 					int peek_character = source_stream.peek();
-                    while (peek_character != 0x0A && !source_stream.eof()) {
-                        peek_character = source_stream.get();
+                    while (peek_character != 0x0A && peek_character != EOF) {
+                        source_stream.get();
+                        peek_character = source_stream.peek();
                     }
-                    token = new(nothrow) eol_token;
+                    token = new(nothrow) whitespace_token;
                     break;
 				}
 				if (isalpha(input_char) || input_char == '_') {
@@ -629,22 +721,34 @@ bool token_parser::parse_tokens() {
 					break;
 				}
 				if (input_char == 0x0A) {
-					// Handle newlines, indent, and dedent
+					// Handle newlines, indent, and dedent. Blank lines and
+					// lines holding only a comment do not change the
+					// indentation; a tab advances to the next multiple of 8.
                     int spaces = 0;
-                    int p = source_stream.peek();
-                    if (isspace(p)) {
-                        int g = source_stream.get();
-                        spaces++;
-                        while (g != 0x0A && !source_stream.eof()) {
-                            p = source_stream.peek();
-                            if (isspace(p)) {
-                                g = source_stream.get();
-                                spaces++;
-                            }
-                            else {
-                                break;
-                            }
+                    while (true) {
+                        int p = source_stream.peek();
+                        if (p == ' ') {
+                            spaces++;
+                        }
+                        else if (p == 0x09) {
+                            spaces = (spaces / 8 + 1) * 8;
+                        }
+                        else if (p == 0x0A) {
+                            spaces = 0;
                         }
+                        else if (p == 0x0D || p == 0x0B) {
+                        }
+                        else if (p == '#') {
+                            while (source_stream.peek() != 0x0A && source_stream.peek() != EOF)
+                                source_stream.get();
+                            continue;
+                        }
+                        else {
+                            if (p == EOF)
+                                spaces = 0;
+                            break;
+                        }
+                        source_stream.get();
                     }
                     if (spaces > current_indent) {
                         current_indent = spaces;
@@ -674,7 +778,7 @@ bool token_parser::parse_tokens() {
 					token = new(nothrow) constant_token;
 					break;
 				}
-				if (isdigit(input_char)) {
+				if (isdigit(input_char) || (input_char == '.' && isdigit(source_stream.peek()))) {
 					// Start of number sequence
 					token = new(nothrow) integer_token;
 					break;
@@ -710,613 +814,9146 @@ void token_parser::print_tokens() {
 	}
 }
 
-typedef enum {t_invalid_token=0, t_symbol,
-	t_integer, t_literal,
-	t_constant, t_punctuation,
-	t_whitespace, t_eol, t_indent, t_dedent, t_output, t_eof
-} t_type;
+// Interned strings: every distinct string is stored exactly once together
+// with its hash. Tables keyed by identifiers can then compare keys by
+// pointer and never hash the same name twice.
+class istr
+{
+    private:
+        const pair<const string, size_t> *entry;
+    public:
+        istr() : entry(NULL) { };
+        explicit istr(const pair<const string, size_t> *e) : entry(e) { };
+        const string& str() const { return entry->first; };
+        size_t hash() const { return entry->second; };
+        bool operator==(const istr &other) const { return entry == other.entry; };
+        bool operator!=(const istr &other) const { return entry != other.entry; };
+};
 
-map <string, pair<int,string>> var_table;
-map <string,string> arithmetic_table = {{"+","+"},{"-","-"},{"*","*"},{"/","/"}};
-map <string, pair<int,string>> def_table;
-map <string, string> key_table = {{"if","if"},{"return","return"},{"def","def"},{"print","print"}};
+ostream& operator<<(ostream &out, const istr &s) {
+    return out << s.str();
+}
 
-int evaluate(deque<pair<int,string>> &n);
-deque<pair<int,string>> remove_whitespace(deque<pair<int,string>> tokens);
-int eeval(deque<pair<int,string>> &tokens, deque<pair<int,string>> &eval);
-int aeval(deque<pair<int,string>> &tokens, deque<pair<int,string>> &eval, pair<int,string> &a);
-int peval(deque<pair<int,string>> &tokens, pair<int,string> &a);
-pair<int,string> doArith(pair<int,string>,pair<int,string>,pair<int,string>);
-int printeval(deque <pair<int,string>> &tokens, pair<int, string> &a);
-int eval_line(deque<pair<int,string>> &eval);
+// The interned strings, which all interpreters share. Only compiling and
+// setting up builtins intern new strings, so the lock is never taken
+// while a script runs.
+class intern_table
+{
+    private:
+        unordered_map<string, size_t> strings;
+        mutex lock;
+    public:
+        istr intern(const string &s);
+        size_t size() const { return strings.size(); };
+};
 
-deque<pair<int,string>> remove_whitespace(deque<pair<int,string>> tokens){
-    deque<pair<int,string>> newtokens;
-    while(!tokens.empty()){
-        if(tokens.at(0).first != t_whitespace){
-            newtokens.push_back(tokens.at(0));
-            tokens.pop_front();
-        }else{
-            tokens.pop_front();
-        }
+// return the canonical copy of s, adding it on first use
+istr intern_table::intern(const string &s) {
+    lock_guard<mutex> hold(lock);
+    unordered_map<string, size_t>::iterator it = strings.find(s);
+    if(it == strings.end()){
+        it = strings.emplace(s, hash<string>()(s)).first;
     }
-    return newtokens;
+    return istr(&*it);
 }
 
-int evaluate(deque<pair<int,string>> &tokens){
-    pair<int, string> t, temp;
-    deque<pair<int,string>> eval;
-    
-    while(!tokens.empty()){
-        t = tokens.at(0);
-        tokens.pop_front();
-        if(t.first == t_eol){
-            cout<<"eol"<<endl;
-            if(eval_line(eval) != 0)
-                return -1;
-            continue;
-        }
-        if(t.first == t_eof){
-            cout << "eof"<<endl;
-            if(eval_line(eval) != 0)
-                return -1;
-            break;
-        }
-        if(t.first == t_literal){
-            if(eval.empty()){
-                eval.push_back(t);
-            }else{
-                return -1;
-            }
-        }
+intern_table interned;
 
-        if(t.first == t_integer){
-            if(eval.empty()){
-                eval.push_back(t);
-            }else if(tokens.at(0).first == t_punctuation){
-                if(arithmetic_table.count(tokens.at(0).second) != 0){
-                    if(aeval(tokens, eval, t) == 0){
-                        eval.push_back(t);
-                        continue;
-                    }else{
-                        return -1;
-                    }
-                }else{
-                    return -1;
-                }
-            }else{
-                return -1;
-            }
-        }
+istr intern(const string &s) {
+    return interned.intern(s);
+}
 
-        if(t.first == t_symbol){
-            cout << t.second << endl;
-            if(var_table.count(t.second) > 0){
-                if(tokens.at(0).first == t_punctuation && tokens.at(0).second == "="){
-                    eval.push_back(t);
-                }else{
-                    eval.push_back(var_table.at(t.second));
-                }
-            }else if(key_table.count(t.second) > 0 && t.second == "print"){
-                if(printeval(tokens, t) == 0){
-                    eval.push_back(t);
-                }else{
-                    return -1;
-                }
-            }else{
-                if(tokens.at(0).first == t_punctuation){
-                    if(tokens.at(0).second == "="){
-                        eval.push_back(t);
-                    }else{
-                        cout << "error" << endl;
-                        return -1;
-                    }
-                }else{
-                    return -1;
-                }
-            }
-         }
-         if(t.first == t_punctuation){
-            if(t.second == "="){
-                cout << "push back = " << endl;
-                eval.push_back(t);
-                if(eeval(tokens, eval) != 0)
-                    return -1;
-            }
-         }
+// special method names looked up while scripts run, interned before any
+// thread starts so that the lookups never take the lock
+const istr init_name = intern("__init__");
+const istr await_name = intern("__await__");
 
+// Key behaviour for compact_dict. hash() and match() are overloaded for
+// every type a table may be probed with; make_key() turns such a probe into
+// a stored key on insertion.
+template <class K>
+struct dict_traits
+{
+    static size_t hash(const K &key) { return std::hash<K>()(key); };
+    static bool match(const K &stored, const K &key) { return stored == key; };
+    static K make_key(const K &key) { return key; };
+};
 
-    }
-    /*
-    pair<int, string> b;
-    b.first = 0;
-    b.second = "hello";
-    var_table.emplace("name",b );
-    cout << var_table.at("name").second << endl;
-    */
-    for(auto &i : var_table)
-        cout << i.first << " = " << i.second.second << endl;
+// Identifier keys: all istr handles come from one intern table, so equal
+// strings are the same pointer. Plain strings still work as probes and are
+// compared by content against the cached hash.
+template <>
+struct dict_traits<istr>
+{
+    static size_t hash(const istr &key) { return key.hash(); };
+    static size_t hash(const string &key) { return std::hash<string>()(key); };
+    static bool match(const istr &stored, const istr &key) { return stored == key; };
+    static bool match(const istr &stored, const string &key) { return stored.str() == key; };
+    static istr make_key(const istr &key) { return key; };
+    static istr make_key(const string &key) { return intern(key); };
+};
 
-    return 0;
-}
+// Group probed ("Swiss") tables keep one control byte per slot: empty,
+// deleted, or the low 7 bits of the slot's hash. Slots are probed sixteen
+// at a time; one SSE2 compare tests a whole group against the wanted hash
+// bits, so a lookup touches a single cache line of control bytes in the
+// common case instead of chasing entries.
+enum { ctrl_empty = -128, ctrl_deleted = -2, swiss_group_width = 16 };
 
-int eval_line(deque<pair<int,string>> &eval){
-    if(eval.size() == 0){
-        cout << "nothing to evaluate!" << endl;
-        return 0;
+// bitmask of the slots in a group whose control byte equals h
+inline unsigned group_match(const int8_t *ctrl, int8_t h) {
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h)));
+#else
+    unsigned mask = 0;
+    for(int i = 0; i < swiss_group_width; i++){
+        if(ctrl[i] == h)
+            mask |= 1u << i;
     }
-    else if(eval.size() == 1){
-        if(eval.at(0).first == t_output){
-            cout << eval.at(0).second << endl;
-            eval.pop_front();
-        }else{
-            cout << "single integer or literal" << endl;
-            eval.pop_front();
-        }
-        return 0;
-    }else{
-        return -1;
+    return mask;
+#endif
+}
+
+// bitmask of the empty or deleted slots in a group (their sign bit is set)
+inline unsigned group_match_free(const int8_t *ctrl) {
+#if defined(__SSE2__)
+    return (unsigned)_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl)));
+#else
+    unsigned mask = 0;
+    for(int i = 0; i < swiss_group_width; i++){
+        if(ctrl[i] < 0)
+            mask |= 1u << i;
     }
+    return mask;
+#endif
+}
 
+inline int lowest_bit(unsigned mask) {
+    return __builtin_ctz(mask);
 }
 
-int eeval(deque<pair<int,string>> &tokens, deque<pair<int,string>> &eval){
-    pair<int, string> t; 
-    deque<pair<int,string>> a;
-
-    while(tokens.at(0).first != t_eol && tokens.at(0).first != t_eof){
-        t = tokens.at(0);
-        tokens.pop_front();
-        if(t.first == t_literal){
-            eval.push_back(t);
-            //todo check if prev is =
-        }else if(t.first == t_integer){
-            cout << "push back num" << endl;
-            eval.push_back(t);
-        }else if(t.first == t_punctuation){
-            if(arithmetic_table.count(t.second) > 0){
-                cout << "found a arith " << endl;
-                if(eval.at(eval.size()-1).first == t_integer){
-                    a.push_back(eval.at(eval.size()-1));
-                    eval.pop_back();
-                    a.push_back(t);
-                    if(aeval(tokens, a, t) == 0){
-                        cout << "foudn arith in assignment" << endl;
-                        eval.push_back(t);
-                    }else{
-                        return -1;
-                    }
-                }else{
-                    return -1;
-                }
-            }else{
-                return -1;
-            }
-        }else{
-            return -1;
+// Spread the bits of a hash; std::hash on integers is the identity, which
+// would leave the control bytes and the group choice correlated.
+inline size_t swiss_mix(size_t hash) {
+    uint64_t h = (uint64_t)hash * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h ^ (h >> 32));
+}
+
+// The control bytes and probing of a Swiss table. Slot payloads are kept by
+// the owner in a parallel array; probe() hands candidate slots to a
+// predicate and claim()/release() maintain the control bytes.
+class swiss_ctrl
+{
+    private:
+        vector<int8_t> ctrl;
+        size_t group_mask;
+        size_t growth_left;
+        size_t tombstones;
+    public:
+        swiss_ctrl() : group_mask(0), growth_left(0), tombstones(0) { };
+        void init(size_t capacity);
+        size_t capacity() const { return ctrl.size(); };
+        size_t room() const { return growth_left; };
+        size_t deleted() const { return tombstones; };
+        bool full(size_t i) const { return ctrl[i] >= 0; };
+        template <class P> long probe(size_t hash, P match) const;
+        size_t claim(size_t hash);
+        void release(size_t i);
+};
+
+// capacity is rounded up to a power of two number of groups and filled up
+// to 7/8 before the owner has to grow
+void swiss_ctrl::init(size_t capacity) {
+    size_t groups = 1;
+    while(groups * swiss_group_width < capacity)
+        groups <<= 1;
+    ctrl.assign(groups * swiss_group_width, (int8_t)ctrl_empty);
+    group_mask = groups - 1;
+    growth_left = ctrl.size() - ctrl.size() / 8;
+    tombstones = 0;
+}
+
+// Return the first full slot with matching hash bits for which match(slot)
+// holds, or -1. Groups are visited in triangular order, which reaches every
+// group of a power of two table; a group with an empty slot ends the search.
+template <class P>
+long swiss_ctrl::probe(size_t hash, P match) const {
+    size_t h = swiss_mix(hash);
+    int8_t h2 = (int8_t)(h & 0x7f);
+    size_t g = (h >> 7) & group_mask;
+    for(size_t step = 1; ; step++){
+        const int8_t *group = ctrl.data() + g * swiss_group_width;
+        for(unsigned m = group_match(group, h2); m != 0; m &= m - 1){
+            size_t i = g * swiss_group_width + lowest_bit(m);
+            if(match(i))
+                return (long)i;
         }
-    }
-    //Todo check to see if eval has only 3 items in it
-    string name = eval.at(0).second;
-    int type = eval.at(2).first;
-    string value = eval.at(2).second;
-    cout << "name = " << name << endl;
-    if(var_table.count(eval.at(0).second) == 0){
-        var_table.emplace(name, make_pair(type,value));
-        cout << name << " = " << var_table.at(name).first << " " << var_table.at(name).second<< endl;
-     }else{
-         var_table.erase(name);
-         var_table.emplace(name, make_pair(type,value));
-     }
-
-     while(!eval.empty()){
-         eval.pop_front();
-     }
-     return 0;
-}
-
-int aeval(deque<pair<int,string>> &tokens, deque<pair<int,string>> &eval, pair<int,string> &a){
-    pair<int, string> t; 
-    cout << "in aeval" << endl;
-    while(tokens.at(0).first != t_eol && tokens.at(0).first != t_eof && tokens.at(0).second != ")"){
-        t = tokens.at(0);
-        tokens.pop_front();       
-        cout << t.first << "-" << t.second << endl;        
-        if(t.first == t_punctuation){
-            if(arithmetic_table.count(t.second) > 0){
-                cout << "arith operator" << endl;
-                eval.push_back(t);
-            }else if(t.second == "("){
-                if(peval(tokens, t) == 0){
-                    eval.push_back(t);
-                }else{
-                    return -1;
-                }
-            }else{
-                return -1;
-            }
-        }else if(t.first == t_symbol){
-            if(var_table.count(t.second) != 0){
-                if(var_table.at(t.second).first == t_integer){
-                    cout << "a variable" << endl;
-                    eval.push_back(var_table.at(t.second));
-                }else{
-                    return -1;
-                }
-            }else{
-                return -1;
-            }
-        }else if(t.first == t_integer){
-            cout << "an int" <<endl;
-            eval.push_back(t);
-        }else{
+        if(group_match(group, (int8_t)ctrl_empty) != 0)
             return -1;
-        }
+        g = (g + step) & group_mask;
     }
-    cout << "out of the loop" << endl;
-    int cint = 0, cart = 0;
-    for(auto &i : eval){
-        cout << i.second << " " << endl;
-        if(i.first == t_integer){
-            cint++;
-        }else{
-            cart++;
+}
+
+// mark the first free slot on hash's probe path as full and return it; the
+// caller has checked that the key is absent and that room() is not zero
+size_t swiss_ctrl::claim(size_t hash) {
+    size_t h = swiss_mix(hash);
+    size_t g = (h >> 7) & group_mask;
+    for(size_t step = 1; ; step++){
+        unsigned m = group_match_free(ctrl.data() + g * swiss_group_width);
+        if(m != 0){
+            size_t i = g * swiss_group_width + lowest_bit(m);
+            if(ctrl[i] == ctrl_deleted)
+                tombstones--;
+            else
+                growth_left--;
+            ctrl[i] = (int8_t)(h & 0x7f);
+            return i;
         }
+        g = (g + step) & group_mask;
     }
-    cout << "checking number of values" << endl;
-    if((cint-cart) > 1){
-        cout << "too many ints" << endl;
-        return -1;
-    }else if ((cint-cart) < 1){
-        cout << "too many arithmetic operators" << endl;
-        return -1;
-    }else{
-        cint = 0;
-        cart = 0;
-    }
-    cout << "done checking " << endl;
-    deque<pair<int,string>> as, f;
-    pair<int,string> n1, n2, o;
-
-    while(!eval.empty()){
-        t = eval.at(0);
-        eval.pop_front();
-        if(t.first == t_integer){
-            n1 = t;
-            as.push_back(n1);
-        }else{
-            o = t;
-            as.push_back(o);
-            if(o.second == "*" || o.second == "/"){
-                n2 = eval.at(0);
-                eval.pop_front();
-            
-                as.pop_back();
-                as.pop_back();
-            
-                t = doArith(n1,n2,o);
-                n1 = t;
-                as.push_back(t);
-            }
-        }
-
-    }
-    for(auto &i : as)
-        cout << i.second << " " << endl;
-    while(!as.empty()){
-        t = as.at(0);
-        as.pop_front();
-        if(t.first == t_integer){
-            n1 = t;
-            f.push_back(n1);
-        }else{
-            o = t;
-            f.push_back(o);
-            if(o.second == "-" || o.second == "+"){
-                n2 = as.at(0);
-                as.pop_front();
-            
-                f.pop_back();
-                f.pop_back();
-                cout << n1.second << " " << o.second << " " <<n2.second << endl; 
-                t = doArith(n1,n2,o);
-                cout << t.second << endl;
-                n1 = t;
-                f.push_back(t);
-            }
-        }
+}
 
+// Free slot i. If its group still has an empty slot no probe sequence can
+// run through it, so the slot can become empty again; otherwise it has to
+// stay a tombstone until the next rehash.
+void swiss_ctrl::release(size_t i) {
+    const int8_t *group = ctrl.data() + (i & ~(size_t)(swiss_group_width - 1));
+    if(group_match(group, (int8_t)ctrl_empty) != 0){
+        ctrl[i] = (int8_t)ctrl_empty;
+        growth_left++;
+    }else{
+        ctrl[i] = (int8_t)ctrl_deleted;
+        tombstones++;
     }
+}
 
-    for(auto &i : f){
-        cout << i.first << " - " << i.second << endl;
-    }
+// An unordered hash set stored directly in a Swiss table.
+template <class K, class Traits = dict_traits<K> >
+class swiss_set
+{
+    private:
+        swiss_ctrl ctrl;
+        vector<K> slots;
+        size_t used;
+        void rehash(size_t capacity);
+    public:
+        swiss_set() : used(0) { rehash(swiss_group_width); };
+        size_t size() const { return used; };
+        bool empty() const { return used == 0; };
+        void clear() { used = 0; rehash(swiss_group_width); };
+        void reserve(size_t n) { if(n > used + ctrl.room()) rehash(n + n / 7 + 1); };
+        template <class L> size_t count(const L &key) const;
+        template <class L> bool insert(const L &key);
+        template <class L> size_t erase(const L &key);
+        template <class F> void for_each(F f) const;
+        // the slots by position, for walking the set a step at a time
+        size_t capacity() const { return slots.size(); };
+        bool full(size_t i) const { return ctrl.full(i); };
+        const K& slot(size_t i) const { return slots[i]; };
+};
 
-    if(f.size()==1){
-        a = f.at(0);
-        cout << "result " << a.second << "endl";
-    }else{
-        cout << "error with arithmetic" << endl;
-        return -1;
+template <class K, class Traits>
+void swiss_set<K, Traits>::rehash(size_t capacity) {
+    vector<K> old;
+    old.swap(slots);
+    swiss_ctrl old_ctrl = ctrl;
+    ctrl.init(capacity);
+    slots.resize(ctrl.capacity());
+    for(size_t i = 0; i < old.size(); i++){
+        if(old_ctrl.full(i))
+            slots[ctrl.claim(Traits::hash(old[i]))] = old[i];
     }
-
-    return 0;
 }
 
-pair<int,string> doArith(pair<int,string> n1,pair<int,string> n2, pair<int,string> o){
-    pair<int,string> result;
-    result.first = t_integer;
-    int r = 0, t1 = 0, t2 = 0;
-    t1 = stoi(n1.second);
-    t2 = stoi(n2.second);
-    if(o.second == "+")
-       r = t1 + t2; 
-    if(o.second == "-")
-       r = t1 - t2; 
-    if(o.second == "*")
-       r = t1 * t2; 
-    if(o.second == "/")
-       r = t1 / t2; 
-
-    result.second = to_string(r);
-    return result;
+template <class K, class Traits>
+template <class L>
+size_t swiss_set<K, Traits>::count(const L &key) const {
+    const vector<K> &s = slots;
+    return ctrl.probe(Traits::hash(key), [&](size_t i) { return Traits::match(s[i], key); }) >= 0 ? 1 : 0;
 }
 
-int peval(deque<pair<int,string>> &tokens, pair<int,string> &a){
-    pair<int, string> t;
-    deque<pair<int,string>> eval;
-    while(tokens.at(0).first != t_eol && tokens.at(0).first != t_eof){
-        t = tokens.at(0);
-        tokens.pop_front();
-        if(t.first == t_integer){
-            eval.push_back(t);
-        }else if(t.first == t_symbol && var_table.count(t.second) > 0){
-            if(var_table.at(t.second).first == t_integer){
-                eval.push_back(t);
-            }else{
-                if(eval.empty()){
-                    eval.push_back(t);
-                }else{
-                    return -1;
-                }
-            }
-        }else if(t.first == t_punctuation && arithmetic_table.count(t.second) > 0){
-            if(eval.empty()){
-                return -1;
-            }
-            if(eval.at(eval.size()-1).first != t_integer){
-                return -1;
-            }else{
-                eval.push_back(t);
-                if(aeval(tokens, eval, t) == 0){
-                    eval.push_back(t);
-                }else{
-                    return -1;
-                }
-            }
-        }else if(t.first == t_punctuation && t.second == ")"){
-            break;
-        }else{
-            return -1;
-        }
+// add key, returning false when it was already present
+template <class K, class Traits>
+template <class L>
+bool swiss_set<K, Traits>::insert(const L &key) {
+    size_t hash = Traits::hash(key);
+    const vector<K> &s = slots;
+    if(ctrl.probe(hash, [&](size_t i) { return Traits::match(s[i], key); }) >= 0)
+        return false;
+    if(ctrl.room() == 0){
+        // mostly tombstones: clean up in place; otherwise double
+        rehash(ctrl.deleted() > used / 2 ? ctrl.capacity() : ctrl.capacity() * 2);
     }
+    slots[ctrl.claim(hash)] = Traits::make_key(key);
+    used++;
+    return true;
+}
 
-    if(eval.size() != 1){
-        return -1;
-    }else{
-        a = eval.at(0);
-        eval.pop_front();
+template <class K, class Traits>
+template <class L>
+size_t swiss_set<K, Traits>::erase(const L &key) {
+    const vector<K> &s = slots;
+    long i = ctrl.probe(Traits::hash(key), [&](size_t j) { return Traits::match(s[j], key); });
+    if(i < 0)
         return 0;
-    }
+    ctrl.release((size_t)i);
+    slots[i] = K();
+    used--;
+    return 1;
 }
-/*
-int defeval(){
-    
-    string name,value;
-    int type;
-    pair<int,string> t;
-    //probably better to put this crap in a array or something
-    if(tokens.at(0).first != t_symbol){
-        return -1;
-    }
 
-    t = tokens.at(0);
-    tokens.pop_front();
-    if(def_table.count(t.second) > 0){
-        return -1;
+template <class K, class Traits>
+template <class F>
+void swiss_set<K, Traits>::for_each(F f) const {
+    for(size_t i = 0; i < slots.size(); i++){
+        if(ctrl.full(i))
+            f(slots[i]);
     }
-    tokens.pop_front();
-    if(tokens.at(0).second != "("){
-        return -1;
+}
+
+// The index slots past which a compact_dict switches to large mode. In
+// bench/index_modes.sh the linear index was faster at every size up to 10M
+// keys, so by default no table gets that far; build with 0 to put every
+// table in large mode.
+#ifndef MYPYTHON_DICT_LARGE_SIZE
+#define MYPYTHON_DICT_LARGE_SIZE (1 << 30)
+#endif
+
+// An insertion ordered hash table. Entries live in a dense array in the
+// order they were added; a separate open addressing index holds 1, 2 or 4
+// byte positions into that array, so the part that is probed stays small
+// and iteration walks contiguous memory. Deleted entries are left in place
+// and skipped until the next resize compacts the array.
+//
+// Past d_large_size index slots the table switches to large mode, where
+// the index is a Swiss table of entry positions. A group probe usually
+// resolves within one line of control bytes, but that line is one more
+// cache miss before the entry position is read.
+template <class K, class V, class Traits = dict_traits<K> >
+class compact_dict
+{
+    public:
+        struct entry {
+            size_t hash;
+            K first;
+            V second;
+            bool live;
+        };
+        class iterator
+        {
+            private:
+                entry *current, *last;
+                void skip() { while(current != last && !current->live) ++current; };
+            public:
+                iterator(entry *c, entry *l) : current(c), last(l) { skip(); };
+                entry& operator*() const { return *current; };
+                entry* operator->() const { return current; };
+                iterator& operator++() { ++current; skip(); return *this; };
+                bool operator==(const iterator &o) const { return current == o.current; };
+                bool operator!=(const iterator &o) const { return current != o.current; };
+        };
+        enum { d_large_size = MYPYTHON_DICT_LARGE_SIZE };
+    private:
+        enum { d_empty = -1, d_dummy = -2, d_min_size = 8 };
+        vector<entry> entries;
+        vector<char> index;
+        int index_width;
+        size_t mask;
+        swiss_ctrl large_ctrl;
+        vector<int32_t> large_index;
+        bool large;
+        size_t used;
+        size_t usable;
+        long get_index(size_t i) const;
+        void set_index(size_t i, long ix);
+        void build_index(size_t size);
+        void insert_index(size_t hash, size_t slot, long ix);
+        void resize(size_t min_used);
+        template <class L> long lookup(const L &key, size_t hash, size_t *slot) const;
+    public:
+        compact_dict() : large(false), used(0) { build_index(d_min_size); };
+        compact_dict(initializer_list<pair<string, V> > init);
+        size_t size() const { return used; };
+        bool empty() const { return used == 0; };
+        void clear();
+        void reserve(size_t n);
+        template <class L> size_t count(const L &key) const;
+        template <class L> V* find(const L &key);
+        template <class L> V& at(const L &key);
+        template <class L> pair<V*, bool> emplace(const L &key, const V &value);
+        template <class L> V& operator[](const L &key);
+        template <class L> size_t erase(const L &key);
+        // the entries by position, dead ones included, for walking the
+        // table a step at a time
+        size_t entry_count() const { return entries.size(); };
+        entry& entry_at(size_t i) { return entries[i]; };
+        iterator begin() { return iterator(entries.data(), entries.data() + entries.size()); };
+        iterator end() { return iterator(entries.data() + entries.size(), entries.data() + entries.size()); };
+};
+
+template <class K, class V, class Traits>
+compact_dict<K, V, Traits>::compact_dict(initializer_list<pair<string, V> > init) : large(false), used(0) {
+    build_index(d_min_size);
+    for(auto &i : init)
+        emplace(i.first, i.second);
+}
+
+// read slot i of the index, whatever its current width
+template <class K, class V, class Traits>
+long compact_dict<K, V, Traits>::get_index(size_t i) const {
+    switch(index_width){
+    case 1:
+        return reinterpret_cast<const int8_t *>(index.data())[i];
+    case 2:
+        return reinterpret_cast<const int16_t *>(index.data())[i];
+    default:
+        return reinterpret_cast<const int32_t *>(index.data())[i];
     }
-    tokens.pop_front()
-    if(tokens.at(0).second != ")"){
-        return -1;
+}
+
+template <class K, class V, class Traits>
+void compact_dict<K, V, Traits>::set_index(size_t i, long ix) {
+    switch(index_width){
+    case 1:
+        reinterpret_cast<int8_t *>(index.data())[i] = (int8_t)ix;
+        break;
+    case 2:
+        reinterpret_cast<int16_t *>(index.data())[i] = (int16_t)ix;
+        break;
+    default:
+        reinterpret_cast<int32_t *>(index.data())[i] = (int32_t)ix;
+        break;
     }
-    tokens.pop_front();
-    if(tokens.at(0).second != ":"){
-         return -1;
+}
+
+// allocate an empty index of the given (power of two) size, using the
+// narrowest integer that can address every usable entry, or a Swiss index
+// once the table is large
+template <class K, class V, class Traits>
+void compact_dict<K, V, Traits>::build_index(size_t size) {
+    large = size > d_large_size;
+    if(large){
+        index.clear();
+        large_ctrl.init(size);
+        large_index.assign(large_ctrl.capacity(), 0);
+        usable = large_ctrl.room() - entries.size();
+        return;
     }
-    tokens.pop_front();
-    if(tokens.at(0).first != t_eol){
-        return -1;
+    large_ctrl = swiss_ctrl();
+    large_index.clear();
+    index_width = size <= 128 ? 1 : size <= 32768 ? 2 : 4;
+    index.assign(size * index_width, (char)0xff);
+    mask = size - 1;
+    usable = (size * 2) / 3 - entries.size();
+}
+
+// Probe for key. Returns its entry position, or -1 with *slot set to the
+// empty index slot where it would be inserted. The linear index uses the
+// perturbed probe sequence from CPython so that all hash bits take part.
+template <class K, class V, class Traits>
+template <class L>
+long compact_dict<K, V, Traits>::lookup(const L &key, size_t hash, size_t *slot) const {
+    if(large){
+        const vector<entry> &e = entries;
+        const vector<int32_t> &ix = large_index;
+        long i = large_ctrl.probe(hash, [&](size_t j) {
+            return e[ix[j]].hash == hash && Traits::match(e[ix[j]].first, key);
+        });
+        return i < 0 ? -1 : ix[i];
     }
-    tokens.pop_front();
-    while(tokens.at(0).first != t_eof){
-        t = tokens.at(0);
-        tokens.pop_front();
-        if(t.first == t_eol){
-            if(eval_line(eval)==0){
-                if(tokens.at(0).first != t_indent && tokens.at(0).first != t_dedent){
-                    return -1;
-                }
-            }else{
-                return -1;
-            }
+    size_t perturb = hash;
+    size_t i = hash & mask;
+    while(true){
+        long ix = get_index(i);
+        if(ix == d_empty){
+            if(slot != NULL)
+                *slot = i;
+            return -1;
         }
-
-        if(t.first == t_dedent){
-            break;
+        if(ix >= 0){
+            const entry &e = entries[ix];
+            if(e.hash == hash && Traits::match(e.first, key))
+                return ix;
         }
+        perturb >>= 5;
+        i = (i * 5 + perturb + 1) & mask;
+    }
+}
+
+// point the index at entry ix; slot is the empty slot found by lookup()
+template <class K, class V, class Traits>
+void compact_dict<K, V, Traits>::insert_index(size_t hash, size_t slot, long ix) {
+    if(large)
+        large_index[large_ctrl.claim(hash)] = (int32_t)ix;
+    else
+        set_index(slot, ix);
+}
 
-        if(t.first == t_indent){
+// Drop deleted entries and rebuild an index large enough for min_used,
+// filled to at most 2/3, or to 7/8 once it is a Swiss table. Room is made
+// in the entry array for min_used entries and no more: the index, at a
+// few bytes a slot, may address more than that, but the entries are far
+// larger, so they only grow as far as they are asked to.
+template <class K, class V, class Traits>
+void compact_dict<K, V, Traits>::resize(size_t min_used) {
+    size_t size = d_min_size;
+    while((size > d_large_size ? size / 8 * 7 : size * 2 / 3) < min_used)
+        size <<= 1;
+    if(used != entries.size()){
+        size_t j = 0;
+        for(size_t i = 0; i < entries.size(); i++){
+            if(entries[i].live){
+                if(i != j)
+                    entries[j] = entries[i];
+                j++;
+            }
+        }
+        entries.resize(j);
+    }
+    build_index(size);
+    usable = min(usable, min_used - entries.size());
+    entries.reserve(entries.size() + usable);
+    for(size_t i = 0; i < entries.size(); i++){
+        if(large){
+            large_index[large_ctrl.claim(entries[i].hash)] = (int32_t)i;
             continue;
         }
-        //symbol
-        if(t.first == t_symbol){
-            if(key_table.count(t.second) > 0){
-                if(t.second == "if"){
-                    if(ifeval(tokens, t) == 0){
-                        if(t.first == t_output){
-                            type = t.first;
-                            value = value + t.second + "\n"; 
-                        }
-                    }else{
-                        return -1;
-                    }
-                }else if(t.second == "return"){
-                    if(tokens.at(0).first == t_literal){
-                        t = tokens.at(0);
-                        tokens.pop_front();
-                        type = t.first;
-                        value = t.second;
-                        continue;
-                    }else if(tokens.at(0).first == t_integer){
-                        t = tokens.at(0);
-                        tokens.pop_front();
-                        type = t.first;
-                        value = t.second;
-                        continue;
-                    }else if(tokens.at(0).first == t_symbol){
-                        if(local_var_table.count(tokens.at(0).second) > 0){
-                            t = tokens.at(0);
-                            tokens.pop_front();
-                            type = t.first;
-                            value = t.second;
-                            continue;
-                        }else{
-                            return -1;
-                        }
-                    }else{
-                        return -1;
-                    }
-                }else if(t.second == "print"){
-                    if(dprinteval(tokens, t) == 0){
-                        type = t_output;
-                        value = value + t.second + "\n";
-                        continue;
-                    }else{
-                        return -1;
-                    }
-                }else{
-                    return -1;
-                }
-            }else if(local_var_table.count(t.second) > 0){
-                eval.push_back(t);
-            }else{
-                if(tokens.at(0).first != t_punctuation && tokens.at(0).second != "="){
-                    return -1;
-                }else{
-                    deeval();
-                }
-            }
+        size_t perturb = entries[i].hash;
+        size_t s = perturb & mask;
+        while(get_index(s) != d_empty){
+            perturb >>= 5;
+            s = (s * 5 + perturb + 1) & mask;
         }
-        //end of symbol
-
-
+        set_index(s, (long)i);
     }
-    
-    
-    
 }
-int ifeval(){return 0;}
-*/
-int printeval(deque <pair<int,string>> &tokens, pair<int, string> &a){
-    pair<int, string> t;
-    deque<pair<int,string>> eval;
-    t = tokens.at(0);
-    if(t.second != "(")
-        return -1;
-    tokens.pop_front(); 
-    
-    while(tokens.at(0).first != t_eol && tokens.at(0).first != t_eof){
-        t = tokens.at(0);
-        tokens.pop_front();
-
-        if(t.first == t_punctuation && t.second == ","){
-            if(eval.empty()){
-                return -1;
-            }
 
-            if(eval.at(eval.size()-1).first != t_literal && eval.at(eval.size()-1).first != t_integer) {
-                return -1;
-            }else{
-                eval.push_back(make_pair(t_whitespace, " "));
-            }
-        }else if(t.first == t_punctuation && t.second == ")"){
-            break;
-        }else if(t.first == t_literal){
-            if(eval.empty()){
-                eval.push_back(t);
-            }else if(eval.at(eval.size()-1).second == ","){
-                eval.push_back(t);
-            }else{
-                return -1;
-            }
-        }else if(t.first == t_integer){
-            if(eval.empty()){
-                eval.push_back(t);
-            }else if(eval.at(eval.size()-1).second == ","){
-                eval.push_back(t);
-            }else{
-                return -1;
-            }
-        }else if(t.first == t_symbol){
-            if(var_table.count(t.second) > 0){
-                eval.push_back(var_table.at(t.second));
-            }else{
-                return -1;
-            }
-        }else{
-            return -1;
-        }
+template <class K, class V, class Traits>
+void compact_dict<K, V, Traits>::clear() {
+    entries.clear();
+    used = 0;
+    build_index(d_min_size);
+}
 
+template <class K, class V, class Traits>
+void compact_dict<K, V, Traits>::reserve(size_t n) {
+    if(n > used + usable)
+        resize(n);
+}
 
-    }
+template <class K, class V, class Traits>
+template <class L>
+size_t compact_dict<K, V, Traits>::count(const L &key) const {
+    return lookup(key, Traits::hash(key), NULL) >= 0 ? 1 : 0;
+}
 
+template <class K, class V, class Traits>
+template <class L>
+V* compact_dict<K, V, Traits>::find(const L &key) {
+    long ix = lookup(key, Traits::hash(key), NULL);
+    return ix >= 0 ? &entries[ix].second : NULL;
+}
 
-    a.first = t_output;
-    if(eval.empty()){
-        return -1;
-    }
+template <class K, class V, class Traits>
+template <class L>
+V& compact_dict<K, V, Traits>::at(const L &key) {
+    V *v = find(key);
+    if(v == NULL)
+        throw out_of_range("compact_dict::at");
+    return *v;
+}
 
-    for(auto &i : eval){
-        a.second += i.second;
+// insert key if it is not present yet; like std::map, an existing value is
+// left untouched and the returned flag is false
+template <class K, class V, class Traits>
+template <class L>
+pair<V*, bool> compact_dict<K, V, Traits>::emplace(const L &key, const V &value) {
+    size_t hash = Traits::hash(key);
+    size_t slot = 0;
+    long ix = lookup(key, hash, &slot);
+    if(ix >= 0)
+        return make_pair(&entries[ix].second, false);
+    if(usable == 0){
+        // the entries double, and as in CPython a linear index gets at
+        // least three slots for each key held
+        resize(used * 2 + 1);
+        lookup(key, hash, &slot);
     }
+    entry e = {hash, Traits::make_key(key), value, true};
+    insert_index(hash, slot, (long)entries.size());
+    entries.push_back(e);
+    used++;
+    usable--;
+    return make_pair(&entries.back().second, true);
+}
 
-    return 0;
+template <class K, class V, class Traits>
+template <class L>
+V& compact_dict<K, V, Traits>::operator[](const L &key) {
+    return *emplace(key, V()).first;
 }
 
-void remove_empty_lines(const string& file_path)
+template <class K, class V, class Traits>
+template <class L>
+size_t compact_dict<K, V, Traits>::erase(const L &key) {
+    size_t hash = Traits::hash(key);
+    long ix = -1;
+    if(large){
+        const vector<entry> &e = entries;
+        const vector<int32_t> &x = large_index;
+        long i = large_ctrl.probe(hash, [&](size_t j) {
+            return e[x[j]].hash == hash && Traits::match(e[x[j]].first, key);
+        });
+        if(i < 0)
+            return 0;
+        ix = large_index[i];
+        large_ctrl.release((size_t)i);
+    }else{
+        size_t perturb = hash;
+        size_t i = hash & mask;
+        while(true){
+            ix = get_index(i);
+            if(ix == d_empty)
+                return 0;
+            if(ix >= 0 && entries[ix].hash == hash && Traits::match(entries[ix].first, key)){
+                set_index(i, d_dummy);
+                break;
+            }
+            perturb >>= 5;
+            i = (i * 5 + perturb + 1) & mask;
+        }
+    }
+    entries[ix].live = false;
+    entries[ix].first = K();
+    entries[ix].second = V();
+    used--;
+    return 1;
+}
+
+// A hidden class: the layout of the attributes of an instance, as a map
+// from name to slot. Shapes form a tree rooted at the empty shape of each
+// class; adding an attribute follows (or creates) the transition for that
+// name, so instances given the same attributes in the same order share
+// one shape and differ only in their slot values. Every shape gets an id
+// never reused, which inline caches compare instead of the pointer.
+class shape
+{
+    private:
+        compact_dict<istr, int> slots;
+        compact_dict<istr, shape *> transitions;
+        vector<istr> keys;
+    public:
+        enum { max_shape_slots = 64 };
+        unsigned id;
+        shape();
+        int find(istr key) { int *s = slots.find(key); return s == NULL ? -1 : *s; };
+        int size() const { return (int)keys.size(); };
+        istr key_at(int slot) const { return keys[slot]; };
+        shape* next(istr key) { shape **s = transitions.find(key); return s == NULL ? NULL : *s; };
+        shape* add(istr key);
+};
+
+// A new shape with key added after the attributes of this one, recorded
+// as the transition for key. The caller owns it.
+shape* shape::add(istr key) {
+    shape *s = new shape();
+    s->slots = slots;
+    s->keys = keys;
+    s->slots.emplace(key, size());
+    s->keys.push_back(key);
+    transitions.emplace(key, s);
+    return s;
+}
+
+// Runtime objects. Every value that is not a scalar lives on the heap as a
+// py_object and is reference counted; type says which subclass it is so
+// hot paths can switch on it without a virtual call.
+//
+// An immortal object has a negative count that references leave alone.
+// Objects set up before --prefork forks its children are made immortal,
+// so a child taking references to them writes nothing to the pages it
+// shares with the parent.
+typedef enum {o_str, o_list, o_tuple, o_range, o_builtin, o_bound_method,
+    o_function, o_cell, o_code, o_class, o_instance, o_method, o_generator, o_iterator,
+    o_dict, o_set} object_type;
+
+class py_object
+{
+    public:
+        int type;
+        int refcount;
+        py_object(int t) : type(t), refcount(0) { };
+        virtual ~py_object() { };
+        bool immortal() const { return refcount < 0; };
+        void incref() { if(refcount >= 0) refcount++; };
+        void decref();
+};
+
+// free an object whose last reference is gone; immortal objects stay
+void destroy_object(py_object *o);
+
+// The last reference and an immortal object share the branch out to
+// destroy_object, so dropping any other reference costs no more than an
+// unconditional decrement would.
+inline void py_object::decref() {
+    if(refcount > 1)
+        refcount--;
+    else
+        destroy_object(this);
+}
+
+// A tagged runtime value. None, bools, ints and floats are stored inline;
+// anything else is a counted reference to a py_object. A null value is
+// never seen by scripts and marks a failed operation.
+class value
+{
+    public:
+        typedef enum {v_null=0, v_none, v_bool, v_int, v_float, v_object} value_tag;
+    private:
+        value_tag t;
+        union {
+            long long i;
+            double d;
+            py_object *o;
+        };
+        void retain() const { if(t == v_object) o->incref(); };
+        // release() and the move assignment run for nearly every
+        // instruction, but the interpreter loop is too large for the
+        // compiler to inline them on its own
+        __attribute__((always_inline)) void release() { if(t == v_object) o->decref(); };
+    public:
+        value() : t(v_null), i(0) { };
+        value(py_object *obj) : t(v_object), o(obj) { obj->incref(); };
+        value(const value &v) : t(v.t), i(v.i) { retain(); };
+        value(value &&v) : t(v.t), i(v.i) { v.t = v_null; };
+        ~value() { release(); };
+        value& operator=(const value &v) { v.retain(); release(); t = v.t; i = v.i; return *this; };
+        __attribute__((always_inline)) value& operator=(value &&v) {
+            if(this != &v){
+                release();
+                t = v.t;
+                i = v.i;
+                v.t = v_null;
+            }
+            return *this;
+        };
+        static value none() { value v; v.t = v_none; return v; };
+        static value from_bool(bool b) { value v; v.t = v_bool; v.i = b ? 1 : 0; return v; };
+        static value from_int(long long n) { value v; v.t = v_int; v.i = n; return v; };
+        static value from_float(double x) { value v; v.t = v_float; v.d = x; return v; };
+        value_tag tag() const { return t; };
+        bool is_null() const { return t == v_null; };
+        bool is_none() const { return t == v_none; };
+        bool is_bool() const { return t == v_bool; };
+        bool is_int() const { return t == v_int; };
+        bool is_float() const { return t == v_float; };
+        bool is_object() const { return t == v_object; };
+        bool is(int type) const { return t == v_object && o->type == type; };
+        long long as_int() const { return i; };
+        double as_float() const { return d; };
+        py_object* as_object() const { return o; };
+};
+
+// the module code of a script run before, with the source it was
+// compiled from
+struct cached_module {
+    string source;
+    value code;
+};
+
+// Everything running scripts change: the globals, builtins and native
+// methods, the error being raised, the call depth, the counters behind
+// shape ids and class versions, the code of scripts already compiled,
+// and where print writes. Each thread runs scripts in an interpreter of
+// its own, found through current, so interpreters on different threads
+// share nothing a script can change and need no locks.
+class interpreter
+{
+    public:
+        compact_dict <istr, value> var_table;
+        compact_dict <istr, value> builtin_table;
+        compact_dict <istr, value> list_methods;
+        compact_dict <istr, value> str_methods;
+        compact_dict <istr, value> generator_methods;
+        compact_dict <istr, value> dict_methods;
+        compact_dict <istr, value> set_methods;
+        string error_message;
+        int call_depth;
+        unsigned shape_count;
+        unsigned class_version_count;
+        // the module code of each script a batch has run, by path
+        compact_dict<istr, cached_module> module_cache;
+        ostream *out;
+        // a script stops with an error once the clock passes deadline,
+        // which is read when ticks, counted down by jumps and calls, runs
+        // out
+        chrono::steady_clock::time_point deadline;
+        int ticks;
+        interpreter();
+        ~interpreter();
+        void init_builtins();
+        void reset();
+        void freeze();
+        bool on_time();
+};
+
+thread_local interpreter *current;
+
+// Calls, and comparisons of nested containers, nest on the C++ stack, so
+// their depth is limited.
+enum { max_call_depth = 1000 };
+
+// jumps and calls between looks at the clock for the deadline
+enum { tick_interval = 4096 };
+
+// false, after raising, once the script has run past the deadline
+inline bool on_time() {
+    return --current->ticks > 0 || current->on_time();
+}
+
+shape::shape() : id(++current->shape_count) {
+}
+
+// a borrowed range of bytes
+struct text_ref {
+    const char *data;
+    size_t size;
+};
+
+inline int compare_text(text_ref a, text_ref b) {
+    int c = memcmp(a.data, b.data, min(a.size, b.size));
+    if(c != 0)
+        return c < 0 ? -1 : 1;
+    return a.size < b.size ? -1 : a.size > b.size ? 1 : 0;
+}
+
+inline bool equal_text(text_ref a, text_ref b) {
+    return a.size == b.size && memcmp(a.data, b.data, a.size) == 0;
+}
+
+// A Python str. It either owns its text or is a view of part of the text
+// of another, owning, str: slices of at least view_min bytes are made
+// views, so cutting up a large string does not copy it. A view keeps its
+// base alive. Once nothing but views refer to the base, a view covering
+// less than half of it copies its bytes out the next time it is read and
+// lets go of the base, so a small slice does not pin a large buffer.
+class py_str : public py_object
+{
+    private:
+        string s;
+        py_str *base;
+        size_t offset;
+        size_t length;
+        int views;
+        void compact();
+    public:
+        enum { view_min = 64 };
+        py_str(const string &str) : py_object(o_str), s(str), base(NULL), offset(0), length(0), views(0) { };
+        py_str(string &&str) : py_object(o_str), s(std::move(str)), base(NULL), offset(0), length(0), views(0) { };
+        py_str(py_str *b, size_t start, size_t n);
+        ~py_str();
+        bool is_view() const { return base != NULL; };
+        size_t size() const { return base != NULL ? length : s.size(); };
+        text_ref text();
+        const string& str();
+        bool append(text_ref t);
+};
+
+// a view of n bytes of b's text from start; a view of a view shares the
+// text of the owning str
+py_str::py_str(py_str *b, size_t start, size_t n) : py_object(o_str), base(b->base != NULL ? b->base : b), offset(b->base != NULL ? b->offset + start : start), length(n), views(0) {
+    // an immortal base is never compacted away from, and counting its
+    // views would write to a page --prefork children share
+    base->incref();
+    if(!base->immortal())
+        base->views++;
+}
+
+py_str::~py_str() {
+    if(base != NULL){
+        if(!base->immortal())
+            base->views--;
+        base->decref();
+    }
+}
+
+void py_str::compact() {
+    py_str *b = base;
+    s.assign(b->s.data() + offset, length);
+    base = NULL;
+    if(!b->immortal())
+        b->views--;
+    b->decref();
+}
+
+text_ref py_str::text() {
+    if(base == NULL){
+        text_ref t = {s.data(), s.size()};
+        return t;
+    }
+    if(base->refcount == base->views && length < base->s.size() / 2)
+        compact();
+    if(base == NULL)
+        return text();
+    text_ref t = {base->s.data() + offset, length};
+    return t;
+}
+
+// Add t to the end of the text when nothing else can see the change: no
+// other reference to this str and no view of it.
+bool py_str::append(text_ref t) {
+    if(refcount != 1 || base != NULL || views != 0)
+        return false;
+    s.append(t.data, t.size);
+    return true;
+}
+
+// the text as a std::string; a view copies its bytes out first
+const string& py_str::str() {
+    if(base != NULL)
+        compact();
+    return s;
+}
+
+value make_str(const string &s) {
+    return value(new py_str(s));
+}
+
+value make_str(string &&s) {
+    return value(new py_str(std::move(s)));
+}
+
+value make_str(text_ref t) {
+    return make_str(string(t.data, t.size));
+}
+
+inline text_ref str_text(const value &v) {
+    return static_cast<py_str *>(v.as_object())->text();
+}
+
+// n bytes of the str v from start: a view when that is at least view_min
+// bytes, a copy otherwise
+value str_slice(const value &v, size_t start, size_t n) {
+    py_str *p = static_cast<py_str *>(v.as_object());
+    if(n == p->size() && start == 0)
+        return v;
+    text_ref t = p->text();
+    if(n < py_str::view_min)
+        return make_str(string(t.data + start, n));
+    return value(new py_str(p, start, n));
+}
+
+// String kernels. Text is scanned a block at a time: one vector compare
+// gives a bitmask of the positions in the block that hold a given byte,
+// 32 positions with AVX2 and 16 with SSE2. Without either the mask is
+// built by a plain loop over eight bytes.
+#if defined(__AVX2__)
+enum { text_block = 32 };
+
+inline uint32_t text_match(const char *p, char c) {
+    __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(c)));
+}
+#elif defined(__SSE2__)
+enum { text_block = 16 };
+
+inline uint32_t text_match(const char *p, char c) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(c)));
+}
+#else
+enum { text_block = 8 };
+
+inline uint32_t text_match(const char *p, char c) {
+    uint32_t mask = 0;
+    for(int i = 0; i < text_block; i++){
+        if(p[i] == c)
+            mask |= 1u << i;
+    }
+    return mask;
+}
+#endif
+
+// Call f with the position of each occurrence of c in p[0, n), in order,
+// until f returns false.
+template <class F>
+void for_each_byte(const char *p, size_t n, char c, F f) {
+    size_t i = 0;
+    for(; i + text_block <= n; i += text_block){
+        for(uint32_t m = text_match(p + i, c); m != 0; m &= m - 1){
+            if(!f(i + __builtin_ctz(m)))
+                return;
+        }
+    }
+    for(; i < n; i++){
+        if(p[i] == c && !f(i))
+            return;
+    }
+}
+
+size_t text_count_byte(const char *p, size_t n, char c) {
+    size_t count = 0, i = 0;
+    for(; i + text_block <= n; i += text_block)
+        count += __builtin_popcount(text_match(p + i, c));
+    for(; i < n; i++)
+        count += p[i] == c;
+    return count;
+}
+
+// First position at or after from where s[0, m) occurs in h[0, n), or
+// string::npos. Candidates are the positions where both the first and the
+// last byte of s match, found a block at a time; only those are compared
+// in full, so most of the text is rejected by two vector compares per
+// block.
+size_t text_find(const char *h, size_t n, const char *s, size_t m, size_t from) {
+    if(m == 0)
+        return from <= n ? from : string::npos;
+    if(m > n || from > n - m)
+        return string::npos;
+    size_t last = n - m, i = from;
+    char first = s[0], final = s[m - 1];
+    for(; i + text_block <= last + 1; i += text_block){
+        uint32_t mask = text_match(h + i, first);
+        if(m > 1)
+            mask &= text_match(h + i + m - 1, final);
+        for(; mask != 0; mask &= mask - 1){
+            size_t k = i + __builtin_ctz(mask);
+            if(m <= 2 || memcmp(h + k + 1, s + 1, m - 2) == 0)
+                return k;
+        }
+    }
+    for(; i <= last; i++){
+        if(h[i] == first && h[i + m - 1] == final && (m <= 2 || memcmp(h + i + 1, s + 1, m - 2) == 0))
+            return i;
+    }
+    return string::npos;
+}
+
+// non-overlapping occurrences of s[0, m) in h[from, n)
+size_t text_count(const char *h, size_t n, const char *s, size_t m, size_t from) {
+    if(from > n)
+        return 0;
+    if(m == 0)
+        return n - from + 1;
+    if(m == 1)
+        return text_count_byte(h + from, n - from, s[0]);
+    size_t count = 0;
+    for(size_t k = text_find(h, n, s, m, from); k != string::npos; k = text_find(h, n, s, m, k + m))
+        count++;
+    return count;
+}
+
+// Copy p[0, n) to out with ASCII letters converted to upper (or lower)
+// case. Other bytes, including those of UTF-8 sequences, are unchanged.
+// Letters are found with one signed range compare: subtracting the first
+// letter and biasing by 128 maps exactly the 26 letters below -102.
+void text_convert_case(const char *p, size_t n, char *out, bool upper) {
+    char from = upper ? 'a' : 'A';
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i bias = _mm256_set1_epi8((char)(128 - from)), limit = _mm256_set1_epi8(-128 + 26), flip = _mm256_set1_epi8(0x20);
+    for(; i + 32 <= n; i += 32){
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        __m256i letters = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(block, bias));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_xor_si256(block, _mm256_and_si256(letters, flip)));
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i bias16 = _mm_set1_epi8((char)(128 - from)), limit16 = _mm_set1_epi8(-128 + 26), flip16 = _mm_set1_epi8(0x20);
+    for(; i + 16 <= n; i += 16){
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i letters = _mm_cmplt_epi8(_mm_add_epi8(block, bias16), limit16);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_xor_si128(block, _mm_and_si128(letters, flip16)));
+    }
+#endif
+    for(; i < n; i++){
+        char c = p[i];
+        out[i] = (unsigned char)(c - from) < 26 ? (char)(c ^ 0x20) : c;
+    }
+}
+
+// A Python list. Elements are stored contiguously and the buffer grows
+// geometrically. While every element is an int (or every element a float)
+// they are kept unboxed in a typed buffer, which halves the memory and lets
+// numeric code scan plain arrays; the first element of another type boxes
+// the whole list into tagged values, and it stays boxed from then on.
+class py_list : public py_object
+{
+    public:
+        typedef enum {l_int, l_float, l_boxed} storage_kind;
+    private:
+        storage_kind kind;
+        union {
+            long long *ints;
+            double *floats;
+            value *items;
+            void *raw;
+        };
+        size_t length;
+        size_t capacity;
+        size_t item_size() const { return kind == l_boxed ? sizeof(value) : sizeof(long long); };
+        bool fits(const value &v) const;
+        void grow(size_t min_capacity);
+        void box();
+    public:
+        py_list() : py_object(o_list), kind(l_int), raw(NULL), length(0), capacity(0) { };
+        ~py_list();
+        size_t size() const { return length; };
+        storage_kind storage() const { return kind; };
+        const long long* int_items() const { return ints; };
+        const double* float_items() const { return floats; };
+        long long* int_items() { return ints; };
+        double* float_items() { return floats; };
+        value* boxed_items() { return items; };
+        value get(size_t i) const;
+        void set(size_t i, const value &v);
+        void append(const value &v);
+        void insert(size_t i, const value &v);
+        value pop(size_t i);
+        void reserve(size_t n);
+        void reverse();
+        void clear();
+};
+
+py_list::~py_list() {
+    clear();
+    ::operator delete(raw);
+}
+
+// can v be stored without changing the storage kind?
+bool py_list::fits(const value &v) const {
+    switch(kind){
+    case l_int:
+        return v.is_int();
+    case l_float:
+        return v.is_float();
+    default:
+        return true;
+    }
+}
+
+// reallocate to hold at least min_capacity elements, over-allocating by
+// half so that a run of appends is amortized O(1)
+void py_list::grow(size_t min_capacity) {
+    if(min_capacity <= capacity)
+        return;
+    size_t n = capacity + (capacity >> 1) + 4;
+    if(n < min_capacity)
+        n = min_capacity;
+    void *buffer = ::operator new(n * item_size());
+    if(kind == l_boxed){
+        value *to = static_cast<value *>(buffer);
+        for(size_t i = 0; i < length; i++){
+            new(&to[i]) value(std::move(items[i]));
+            items[i].~value();
+        }
+    }else if(length > 0){
+        memcpy(buffer, raw, length * item_size());
+    }
+    ::operator delete(raw);
+    raw = buffer;
+    capacity = n;
+}
+
+// convert an unboxed buffer into tagged values
+void py_list::box() {
+    value *buffer = static_cast<value *>(::operator new((capacity > 0 ? capacity : 4) * sizeof(value)));
+    for(size_t i = 0; i < length; i++){
+        if(kind == l_int)
+            new(&buffer[i]) value(value::from_int(ints[i]));
+        else
+            new(&buffer[i]) value(value::from_float(floats[i]));
+    }
+    ::operator delete(raw);
+    items = buffer;
+    if(capacity == 0)
+        capacity = 4;
+    kind = l_boxed;
+}
+
+value py_list::get(size_t i) const {
+    switch(kind){
+    case l_int:
+        return value::from_int(ints[i]);
+    case l_float:
+        return value::from_float(floats[i]);
+    default:
+        return items[i];
+    }
+}
+
+void py_list::set(size_t i, const value &v) {
+    if(!fits(v))
+        box();
+    switch(kind){
+    case l_int:
+        ints[i] = v.as_int();
+        break;
+    case l_float:
+        floats[i] = v.as_float();
+        break;
+    default:
+        items[i] = v;
+        break;
+    }
+}
+
+void py_list::append(const value &v) {
+    insert(length, v);
+}
+
+void py_list::insert(size_t i, const value &v) {
+    if(length == 0 && kind != l_boxed)
+        kind = v.is_float() ? l_float : l_int;
+    if(!fits(v))
+        box();
+    grow(length + 1);
+    if(kind == l_boxed){
+        new(&items[length]) value();
+        for(size_t j = length; j > i; j--)
+            items[j] = std::move(items[j - 1]);
+        items[i] = v;
+    }else{
+        char *base = static_cast<char *>(raw);
+        memmove(base + (i + 1) * item_size(), base + i * item_size(), (length - i) * item_size());
+        if(kind == l_int)
+            ints[i] = v.as_int();
+        else
+            floats[i] = v.as_float();
+    }
+    length++;
+}
+
+value py_list::pop(size_t i) {
+    value v = get(i);
+    if(kind == l_boxed){
+        for(size_t j = i; j + 1 < length; j++)
+            items[j] = std::move(items[j + 1]);
+        items[length - 1].~value();
+    }else{
+        char *base = static_cast<char *>(raw);
+        memmove(base + i * item_size(), base + (i + 1) * item_size(), (length - i - 1) * item_size());
+    }
+    length--;
+    return v;
+}
+
+void py_list::reserve(size_t n) {
+    grow(n);
+}
+
+void py_list::reverse() {
+    switch(kind){
+    case l_int:
+        std::reverse(ints, ints + length);
+        break;
+    case l_float:
+        std::reverse(floats, floats + length);
+        break;
+    default:
+        std::reverse(items, items + length);
+        break;
+    }
+}
+
+void py_list::clear() {
+    if(kind == l_boxed){
+        for(size_t i = 0; i < length; i++)
+            items[i].~value();
+    }
+    length = 0;
+}
+
+// Timsort: a stable, adaptive merge sort. The input is split into natural
+// runs (strictly descending runs are reversed in place), short runs are
+// extended to a minimum length with binary insertion sort, and runs are
+// merged under invariants that keep the merge tree balanced. Merges switch
+// to galloping (exponential search) while one run keeps winning, so sorted
+// or partially sorted data costs close to n comparisons. This follows
+// CPython's listsort; less must be a strict weak ordering.
+template <class T, class Less>
+class timsort
+{
+    private:
+        enum { min_gallop_start = 7 };
+        struct run {
+            T *base;
+            ptrdiff_t length;
+        };
+        T *items;
+        ptrdiff_t count;
+        Less less;
+        ptrdiff_t min_gallop;
+        vector<run> runs;
+        vector<T> scratch;
+        static ptrdiff_t min_run_length(ptrdiff_t n);
+        ptrdiff_t count_run(T *lo, T *hi);
+        void binary_insertion(T *lo, T *hi, T *start);
+        ptrdiff_t gallop_left(const T &key, T *a, ptrdiff_t n, ptrdiff_t hint);
+        ptrdiff_t gallop_right(const T &key, T *a, ptrdiff_t n, ptrdiff_t hint);
+        void merge_lo(T *pa, ptrdiff_t na, T *pb, ptrdiff_t nb);
+        void merge_hi(T *pa, ptrdiff_t na, T *pb, ptrdiff_t nb);
+        void merge_at(size_t i);
+        void merge_collapse();
+        void merge_force_collapse();
+    public:
+        timsort(T *a, size_t n, Less l) : items(a), count((ptrdiff_t)n), less(l), min_gallop(min_gallop_start) { };
+        void sort();
+};
+
+// a run length between 32 and 64 such that n / length is a power of two,
+// or slightly less
+template <class T, class Less>
+ptrdiff_t timsort<T, Less>::min_run_length(ptrdiff_t n) {
+    ptrdiff_t r = 0;
+    while(n >= 64){
+        r |= n & 1;
+        n >>= 1;
+    }
+    return n + r;
+}
+
+// length of the run starting at lo; a descending run is reversed
+template <class T, class Less>
+ptrdiff_t timsort<T, Less>::count_run(T *lo, T *hi) {
+    T *p = lo + 1;
+    if(p == hi)
+        return 1;
+    if(less(*p, *lo)){
+        for(p++; p < hi && less(*p, *(p - 1)); p++)
+            ;
+        reverse(lo, p);
+    }else{
+        for(p++; p < hi && !less(*p, *(p - 1)); p++)
+            ;
+    }
+    return p - lo;
+}
+
+// [lo, start) is sorted; insert the elements of [start, hi) into it
+template <class T, class Less>
+void timsort<T, Less>::binary_insertion(T *lo, T *hi, T *start) {
+    for(; start < hi; start++){
+        T pivot = std::move(*start);
+        T *l = lo, *r = start;
+        while(l < r){
+            T *m = l + (r - l) / 2;
+            if(less(pivot, *m))
+                r = m;
+            else
+                l = m + 1;
+        }
+        move_backward(l, start, start + 1);
+        *l = std::move(pivot);
+    }
+}
+
+// position in sorted a[0, n) to insert key before any equal elements,
+// searching outwards from a[hint]
+template <class T, class Less>
+ptrdiff_t timsort<T, Less>::gallop_left(const T &key, T *a, ptrdiff_t n, ptrdiff_t hint) {
+    ptrdiff_t last = 0, ofs = 1;
+    if(less(a[hint], key)){
+        ptrdiff_t max = n - hint;
+        while(ofs < max && less(a[hint + ofs], key)){
+            last = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if(ofs > max)
+            ofs = max;
+        last += hint;
+        ofs += hint;
+    }else{
+        ptrdiff_t max = hint + 1;
+        while(ofs < max && !less(a[hint - ofs], key)){
+            last = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if(ofs > max)
+            ofs = max;
+        ptrdiff_t k = last;
+        last = hint - ofs;
+        ofs = hint - k;
+    }
+    // a[last] < key <= a[ofs]; finish with a binary search
+    last++;
+    while(last < ofs){
+        ptrdiff_t m = last + (ofs - last) / 2;
+        if(less(a[m], key))
+            last = m + 1;
+        else
+            ofs = m;
+    }
+    return ofs;
+}
+
+// like gallop_left, but after any elements equal to key
+template <class T, class Less>
+ptrdiff_t timsort<T, Less>::gallop_right(const T &key, T *a, ptrdiff_t n, ptrdiff_t hint) {
+    ptrdiff_t last = 0, ofs = 1;
+    if(less(key, a[hint])){
+        ptrdiff_t max = hint + 1;
+        while(ofs < max && less(key, a[hint - ofs])){
+            last = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if(ofs > max)
+            ofs = max;
+        ptrdiff_t k = last;
+        last = hint - ofs;
+        ofs = hint - k;
+    }else{
+        ptrdiff_t max = n - hint;
+        while(ofs < max && !less(key, a[hint + ofs])){
+            last = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if(ofs > max)
+            ofs = max;
+        last += hint;
+        ofs += hint;
+    }
+    // a[last] <= key < a[ofs]
+    last++;
+    while(last < ofs){
+        ptrdiff_t m = last + (ofs - last) / 2;
+        if(less(key, a[m]))
+            ofs = m;
+        else
+            last = m + 1;
+    }
+    return ofs;
+}
+
+// Merge adjacent runs a and b, na <= nb, left to right with a copied out.
+// a[0] belongs after b[0] and b's last element after a's last, which the
+// caller has arranged with gallops.
+template <class T, class Less>
+void timsort<T, Less>::merge_lo(T *pa, ptrdiff_t na, T *pb, ptrdiff_t nb) {
+    scratch.clear();
+    scratch.insert(scratch.end(), make_move_iterator(pa), make_move_iterator(pa + na));
+    T *tmp = scratch.data();
+    T *dest = pa;
+    *dest++ = std::move(*pb++);
+    if(--nb == 0)
+        goto succeed;
+    if(na == 1)
+        goto copy_b;
+    while(true){
+        ptrdiff_t acount = 0, bcount = 0;
+        // one pair at a time until a run wins min_gallop times in a row
+        while(true){
+            if(less(*pb, *tmp)){
+                *dest++ = std::move(*pb++);
+                bcount++;
+                acount = 0;
+                if(--nb == 0)
+                    goto succeed;
+                if(bcount >= min_gallop)
+                    break;
+            }else{
+                *dest++ = std::move(*tmp++);
+                acount++;
+                bcount = 0;
+                if(--na == 1)
+                    goto copy_b;
+                if(acount >= min_gallop)
+                    break;
+            }
+        }
+        // gallop until neither run wins big any more
+        min_gallop++;
+        do {
+            min_gallop -= min_gallop > 1;
+            ptrdiff_t k = gallop_right(*pb, tmp, na, 0);
+            acount = k;
+            if(k > 0){
+                dest = std::move(tmp, tmp + k, dest);
+                tmp += k;
+                na -= k;
+                if(na == 1)
+                    goto copy_b;
+                if(na == 0)
+                    goto succeed;
+            }
+            *dest++ = std::move(*pb++);
+            if(--nb == 0)
+                goto succeed;
+            k = gallop_left(*tmp, pb, nb, 0);
+            bcount = k;
+            if(k > 0){
+                dest = std::move(pb, pb + k, dest);
+                pb += k;
+                nb -= k;
+                if(nb == 0)
+                    goto succeed;
+            }
+            *dest++ = std::move(*tmp++);
+            if(--na == 1)
+                goto copy_b;
+        } while(acount >= min_gallop_start || bcount >= min_gallop_start);
+        min_gallop++;
+    }
+succeed:
+    std::move(tmp, tmp + na, dest);
+    return;
+copy_b:
+    // the last element of a goes after the rest of b
+    dest = std::move(pb, pb + nb, dest);
+    *dest = std::move(*tmp);
+}
+
+// Merge adjacent runs a and b, nb <= na, right to left with b copied out.
+template <class T, class Less>
+void timsort<T, Less>::merge_hi(T *pa, ptrdiff_t na, T *pb, ptrdiff_t nb) {
+    scratch.clear();
+    scratch.insert(scratch.end(), make_move_iterator(pb), make_move_iterator(pb + nb));
+    T *base = scratch.data();
+    T *tmp = base + nb - 1;
+    T *dest = pb + nb - 1;
+    pa += na - 1;
+    *dest-- = std::move(*pa--);
+    if(--na == 0)
+        goto succeed;
+    if(nb == 1)
+        goto copy_a;
+    while(true){
+        ptrdiff_t acount = 0, bcount = 0;
+        while(true){
+            if(less(*tmp, *pa)){
+                *dest-- = std::move(*pa--);
+                acount++;
+                bcount = 0;
+                if(--na == 0)
+                    goto succeed;
+                if(acount >= min_gallop)
+                    break;
+            }else{
+                *dest-- = std::move(*tmp--);
+                bcount++;
+                acount = 0;
+                if(--nb == 1)
+                    goto copy_a;
+                if(bcount >= min_gallop)
+                    break;
+            }
+        }
+        min_gallop++;
+        do {
+            min_gallop -= min_gallop > 1;
+            ptrdiff_t k = na - gallop_right(*tmp, pa - na + 1, na, na - 1);
+            acount = k;
+            if(k > 0){
+                dest -= k;
+                pa -= k;
+                move_backward(pa + 1, pa + 1 + k, dest + 1 + k);
+                na -= k;
+                if(na == 0)
+                    goto succeed;
+            }
+            *dest-- = std::move(*tmp--);
+            if(--nb == 1)
+                goto copy_a;
+            k = nb - gallop_left(*pa, base, nb, nb - 1);
+            bcount = k;
+            if(k > 0){
+                dest -= k;
+                tmp -= k;
+                std::move(tmp + 1, tmp + 1 + k, dest + 1);
+                nb -= k;
+                if(nb == 1)
+                    goto copy_a;
+                if(nb == 0)
+                    goto succeed;
+            }
+            *dest-- = std::move(*pa--);
+            if(--na == 0)
+                goto succeed;
+        } while(acount >= min_gallop_start || bcount >= min_gallop_start);
+        min_gallop++;
+    }
+succeed:
+    std::move(base, base + nb, dest - nb + 1);
+    return;
+copy_a:
+    // the first element of b goes before the rest of a
+    dest -= na;
+    pa -= na;
+    move_backward(pa + 1, pa + 1 + na, dest + 1 + na);
+    *dest = std::move(*tmp);
+}
+
+// merge runs i and i + 1
+template <class T, class Less>
+void timsort<T, Less>::merge_at(size_t i) {
+    T *pa = runs[i].base, *pb = runs[i + 1].base;
+    ptrdiff_t na = runs[i].length, nb = runs[i + 1].length;
+    runs[i].length = na + nb;
+    runs.erase(runs.begin() + i + 1);
+    // elements of a before b[0], and of b after a's last, are in place
+    ptrdiff_t k = gallop_right(*pb, pa, na, 0);
+    pa += k;
+    na -= k;
+    if(na == 0)
+        return;
+    nb = gallop_left(pa[na - 1], pb, nb, nb - 1);
+    if(nb == 0)
+        return;
+    if(na <= nb)
+        merge_lo(pa, na, pb, nb);
+    else
+        merge_hi(pa, na, pb, nb);
+}
+
+// Restore the invariants on the top runs: each run is longer than the
+// next two together, and than the next one.
+template <class T, class Less>
+void timsort<T, Less>::merge_collapse() {
+    while(runs.size() > 1){
+        size_t n = runs.size() - 2;
+        if((n > 0 && runs[n - 1].length <= runs[n].length + runs[n + 1].length) ||
+                (n > 1 && runs[n - 2].length <= runs[n - 1].length + runs[n].length)){
+            if(runs[n - 1].length < runs[n + 1].length)
+                n--;
+            merge_at(n);
+        }else if(runs[n].length <= runs[n + 1].length){
+            merge_at(n);
+        }else{
+            break;
+        }
+    }
+}
+
+template <class T, class Less>
+void timsort<T, Less>::merge_force_collapse() {
+    while(runs.size() > 1){
+        size_t n = runs.size() - 2;
+        if(n > 0 && runs[n - 1].length < runs[n + 1].length)
+            n--;
+        merge_at(n);
+    }
+}
+
+template <class T, class Less>
+void timsort<T, Less>::sort() {
+    if(count < 2)
+        return;
+    ptrdiff_t min_run = min_run_length(count);
+    T *lo = items, *hi = items + count;
+    while(lo < hi){
+        ptrdiff_t n = count_run(lo, hi);
+        if(n < min_run){
+            ptrdiff_t force = hi - lo < min_run ? hi - lo : min_run;
+            binary_insertion(lo, lo + force, lo + n);
+            n = force;
+        }
+        run r = {lo, n};
+        runs.push_back(r);
+        merge_collapse();
+        lo += n;
+    }
+    merge_force_collapse();
+}
+
+template <class T, class Less>
+void tim_sort(T *items, size_t n, Less less) {
+    timsort<T, Less> s(items, n, less);
+    s.sort();
+}
+
+// A range is lazy: only start, stop and step are stored and elements are
+// computed when asked for, so looping over range(n) allocates nothing.
+class py_range : public py_object
+{
+    public:
+        long long start, stop, step, length;
+        py_range(long long b, long long e, long long s);
+        py_range(long long b, long long e, long long s, long long n) : py_object(o_range), start(b), stop(e), step(s), length(n) { };
+        // element i; i * step may not fit even when the element does
+        long long at(long long i) const { return (long long)((unsigned long long)start + (unsigned long long)i * step); };
+};
+
+// The number of elements of range(start, stop, step), computed unsigned
+// like CPython's get_len_of_range: stop - start need not fit a long long.
+unsigned long long range_length(long long start, long long stop, long long step) {
+    if(step > 0)
+        return start < stop ? ((unsigned long long)stop - start - 1) / step + 1 : 0;
+    return start > stop ? ((unsigned long long)start - stop - 1) / (0 - (unsigned long long)step) + 1 : 0;
+}
+
+py_range::py_range(long long b, long long e, long long s) : py_object(o_range), start(b), stop(e), step(s) {
+    length = (long long)range_length(start, stop, step);
+}
+
+// A tuple stores its elements inline, directly after the object header, so
+// a tuple is a single allocation. Freed tuples of up to max_free_tuple
+// elements are kept on a free list per size and reused, which makes the
+// short-lived tuples of multiple assignment and multiple return values
+// cheap to create.
+class py_tuple : public py_object
+{
+    private:
+        py_tuple(size_t n) : py_object(o_tuple), length(n) { };
+    public:
+        enum { max_free_tuple = 16, max_free_count = 2000 };
+        size_t length;
+        value* items() { return reinterpret_cast<value *>(this + 1); };
+        static py_tuple* make(size_t n);
+        static void free(py_tuple *t);
+};
+
+// free lists are chained through the first word of each block; each
+// thread keeps its own
+thread_local void *tuple_free_list[py_tuple::max_free_tuple + 1];
+thread_local int tuple_free_count[py_tuple::max_free_tuple + 1];
+
+// a tuple of n null values, to be filled in by the caller
+py_tuple* py_tuple::make(size_t n) {
+    void *block;
+    if(n <= max_free_tuple && tuple_free_list[n] != NULL){
+        block = tuple_free_list[n];
+        tuple_free_list[n] = *static_cast<void **>(block);
+        tuple_free_count[n]--;
+    }else{
+        block = ::operator new(sizeof(py_tuple) + n * sizeof(value));
+    }
+    py_tuple *t = new(block) py_tuple(n);
+    for(size_t i = 0; i < n; i++)
+        new(&t->items()[i]) value();
+    return t;
+}
+
+void py_tuple::free(py_tuple *t) {
+    size_t n = t->length;
+    for(size_t i = 0; i < n; i++)
+        t->items()[i].~value();
+    t->~py_tuple();
+    if(n <= max_free_tuple && tuple_free_count[n] < max_free_count){
+        *reinterpret_cast<void **>(t) = tuple_free_list[n];
+        tuple_free_list[n] = t;
+        tuple_free_count[n]++;
+        return;
+    }
+    ::operator delete(t);
+}
+
+// Native functions get a pointer to their nargs positional arguments,
+// followed by the values of any keyword arguments, whose names are in
+// kwnames (NULL when there are none). The arguments stay where the caller
+// keeps them, usually on the VM stack, and are only borrowed, so a call
+// allocates nothing to pass them.
+typedef value (*builtin_function)(value *args, int nargs, py_tuple *kwnames);
+
+class py_builtin : public py_object
+{
+    public:
+        string name;
+        builtin_function function;
+        py_builtin(const string &n, builtin_function f) : py_object(o_builtin), name(n), function(f) { };
+};
+
+// a native method (a py_builtin) together with the object it was looked
+// up on, which is passed as the first argument
+class py_bound_method : public py_object
+{
+    public:
+        value function;
+        value self;
+        py_bound_method(const value &f, const value &s) : py_object(o_bound_method), function(f), self(s) { };
+};
+
+class code_object;
+
+// A function defined by a script. The cells of the variables it captures
+// from enclosing functions are kept in one flat array, in the order of its
+// code's free variables, and copied into each frame it runs in. defaults
+// is a tuple of the values of its last parameters, or null.
+class py_function : public py_object
+{
+    public:
+        value code;
+        string name;
+        vector<value> closure;
+        value defaults;
+        py_function(const value &c, const string &n) : py_object(o_function), code(c), name(n) { };
+};
+
+// A generator or coroutine: the frame of its function, kept on the heap
+// between runs, and where the code stopped. ip and sp are offsets into
+// the code and the frame; resuming pushes the value sent at sp and
+// carries on from ip, so suspending copies nothing.
+class py_generator : public py_object
+{
+    public:
+        value function;
+        string name;
+        vector<value> frame;
+        int ip;
+        int sp;
+        bool coroutine;
+        bool started;
+        bool running;
+        bool finished;
+        py_generator(const value &f, const string &n, bool c) : py_object(o_generator), function(f), name(n), ip(0), sp(0), coroutine(c), started(false), running(false), finished(false) { };
+};
+
+// the position reached in a list, tuple, str or range by yield from
+class py_iterator : public py_object
+{
+    public:
+        value sequence;
+        size_t position;
+        py_iterator(const value &s) : py_object(o_iterator), sequence(s), position(0) { };
+};
+
+size_t hash_value(const value &v);
+bool values_equal(const value &a, const value &b);
+
+// Keys of script dicts and sets: hashable values, compared by value.
+template <>
+struct dict_traits<value>
+{
+    static size_t hash(const value &key) { return hash_value(key); };
+    static bool match(const value &stored, const value &key) { return values_equal(stored, key); };
+    static value make_key(const value &key) { return key; };
+};
+
+// a dict of a script, which keeps its keys in insertion order
+class py_dict : public py_object
+{
+    public:
+        compact_dict<value, value> items;
+        py_dict() : py_object(o_dict) { };
+};
+
+class py_set : public py_object
+{
+    public:
+        swiss_set<value> items;
+        py_set() : py_object(o_set) { };
+};
+
+// a variable shared between a function and the functions nested in it
+class py_cell : public py_object
+{
+    public:
+        value contents;
+        py_cell() : py_object(o_cell) { };
+};
+
+// A class defined by a script. Its methods and class attributes live in
+// attributes, and it owns the tree of shapes its instances move through.
+// inline_slots is how many attributes new instances have room for inside
+// the object; it grows to the largest shape seen so far, so instances of
+// a settled class keep every attribute inline.
+//
+// version identifies what lookup returns: it is renewed whenever the
+// attributes of the class, or of any of its bases, change, so a cache
+// holding the same version still holds the right answer. Versions are
+// never reused.
+class py_class : public py_object
+{
+    public:
+        enum { max_inline_slots = 16 };
+        string name;
+        value base;
+        compact_dict<istr, value> attributes;
+        vector<unique_ptr<shape>> shapes;
+        shape *root;
+        int inline_slots;
+        unsigned version;
+        vector<py_class *> subclasses;
+        py_class(const string &n, const value &b);
+        ~py_class();
+        value* lookup(istr key);
+        void set_attribute(istr key, const value &v);
+        void modified();
+        shape* transition(shape *from, istr key);
+};
+
+py_class::py_class(const string &n, const value &b) : py_object(o_class), name(n), base(b), inline_slots(4), version(++current->class_version_count) {
+    root = new shape();
+    shapes.push_back(unique_ptr<shape>(root));
+    if(base.is(o_class))
+        static_cast<py_class *>(base.as_object())->subclasses.push_back(this);
+}
+
+py_class::~py_class() {
+    if(base.is(o_class)){
+        vector<py_class *> &s = static_cast<py_class *>(base.as_object())->subclasses;
+        s.erase(find(s.begin(), s.end(), this));
+    }
+}
+
+void py_class::set_attribute(istr key, const value &v) {
+    attributes[key] = v;
+    modified();
+}
+
+// give this class and everything derived from it new versions
+void py_class::modified() {
+    version = ++current->class_version_count;
+    for(py_class *c : subclasses)
+        c->modified();
+}
+
+// a class attribute, searching the base classes too
+value* py_class::lookup(istr key) {
+    for(py_class *c = this; ; c = static_cast<py_class *>(c->base.as_object())){
+        value *v = c->attributes.find(key);
+        if(v != NULL || !c->base.is(o_class))
+            return v;
+    }
+}
+
+// the shape after adding key to from, or NULL when it would be too large
+shape* py_class::transition(shape *from, istr key) {
+    shape *to = from->next(key);
+    if(to != NULL)
+        return to;
+    if(from->size() >= shape::max_shape_slots)
+        return NULL;
+    to = from->add(key);
+    shapes.push_back(unique_ptr<shape>(to));
+    if(to->size() > inline_slots && to->size() <= max_inline_slots)
+        inline_slots = to->size();
+    return to;
+}
+
+// An instance of a script class. Its attribute values are kept in the
+// slots of its shape: the first capacity slots inside the object itself,
+// straight after the header, and any more in overflow. An instance whose
+// shape would grow too large moves its attributes into a dict of its own
+// and has no shape from then on.
+class py_instance : public py_object
+{
+    private:
+        py_instance(const value &c, int n) : py_object(o_instance), cls(c), layout(static_cast<py_class *>(c.as_object())->root), capacity(n) { };
+        value* inline_items() { return reinterpret_cast<value *>(this + 1); };
+    public:
+        value cls;
+        shape *layout;
+        int capacity;
+        vector<value> overflow;
+        unique_ptr<compact_dict<istr, value>> dict;
+        static py_instance* make(const value &cls);
+        static void free(py_instance *o);
+        value& slot(int i) { return i < capacity ? inline_items()[i] : overflow[i - capacity]; };
+        value* find(istr key);
+        void set(istr key, const value &v);
+};
+
+py_instance* py_instance::make(const value &cls) {
+    int n = static_cast<py_class *>(cls.as_object())->inline_slots;
+    void *block = ::operator new(sizeof(py_instance) + n * sizeof(value));
+    py_instance *o = new(block) py_instance(cls, n);
+    for(int i = 0; i < n; i++)
+        new(&o->inline_items()[i]) value();
+    return o;
+}
+
+void py_instance::free(py_instance *o) {
+    for(int i = 0; i < o->capacity; i++)
+        o->inline_items()[i].~value();
+    o->~py_instance();
+    ::operator delete(o);
+}
+
+value* py_instance::find(istr key) {
+    if(layout == NULL)
+        return dict->find(key);
+    int s = layout->find(key);
+    return s < 0 ? NULL : &slot(s);
+}
+
+void py_instance::set(istr key, const value &v) {
+    value *old = find(key);
+    if(old != NULL){
+        *old = v;
+        return;
+    }
+    if(layout != NULL){
+        shape *to = static_cast<py_class *>(cls.as_object())->transition(layout, key);
+        if(to != NULL){
+            int s = layout->size();
+            if(s >= capacity)
+                overflow.emplace_back();
+            layout = to;
+            slot(s) = v;
+            return;
+        }
+        dict.reset(new compact_dict<istr, value>());
+        for(int i = 0; i < layout->size(); i++)
+            dict->emplace(layout->key_at(i), std::move(slot(i)));
+        overflow.clear();
+        layout = NULL;
+    }
+    (*dict)[key] = v;
+}
+
+// a function looked up on an instance, bound to it
+class py_method : public py_object
+{
+    public:
+        value function;
+        value self;
+        py_method(const value &f, const value &s) : py_object(o_method), function(f), self(s) { };
+};
+
+void free_object(py_object *o) {
+    if(o->type == o_tuple)
+        py_tuple::free(static_cast<py_tuple *>(o));
+    else if(o->type == o_instance)
+        py_instance::free(static_cast<py_instance *>(o));
+    else
+        delete o;
+}
+
+// Freeing an object drops its references, which can free more objects
+// in turn, one C++ frame deeper each time. Past max_destroy_depth they
+// are queued instead and freed by the outermost destroy_object, so a
+// deeply nested list is torn down without running off the stack (the
+// trashcan of CPython).
+enum { max_destroy_depth = 1000 };
+thread_local int destroy_depth;
+thread_local vector<py_object *> destroy_later;
+
+void destroy_object(py_object *o) {
+    if(o->immortal())
+        return;
+    if(destroy_depth >= max_destroy_depth){
+        destroy_later.push_back(o);
+        return;
+    }
+    destroy_depth++;
+    free_object(o);
+    if(destroy_depth == 1){
+        while(!destroy_later.empty()){
+            py_object *next = destroy_later.back();
+            destroy_later.pop_back();
+            free_object(next);
+        }
+    }
+    destroy_depth--;
+}
+
+// The message of the last runtime error. Operations that fail return a
+// null value (or false) after calling raise_error, and the VM unwinds.
+value raise_error(const string &message) {
+    current->error_message = message;
+    return value();
+}
+
+string type_name(const value &v) {
+    switch(v.tag()){
+    case value::v_none:
+        return "NoneType";
+    case value::v_bool:
+        return "bool";
+    case value::v_int:
+        return "int";
+    case value::v_float:
+        return "float";
+    case value::v_object:
+        break;
+    default:
+        return "NULL";
+    }
+    switch(v.as_object()->type){
+    case o_str:
+        return "str";
+    case o_list:
+        return "list";
+    case o_tuple:
+        return "tuple";
+    case o_range:
+        return "range";
+    case o_function:
+        return "function";
+    case o_cell:
+        return "cell";
+    case o_code:
+        return "code";
+    case o_class:
+        return "type";
+    case o_instance:
+        return static_cast<py_class *>(static_cast<py_instance *>(v.as_object())->cls.as_object())->name;
+    case o_method:
+        return "method";
+    case o_generator:
+        return static_cast<py_generator *>(v.as_object())->coroutine ? "coroutine" : "generator";
+    case o_iterator:
+        return type_name(static_cast<py_iterator *>(v.as_object())->sequence) + "_iterator";
+    case o_dict:
+        return "dict";
+    case o_set:
+        return "set";
+    default:
+        return "builtin_function_or_method";
+    }
+}
+
+// Float conversion works on 128-bit approximations of powers of five.
+// They are worked out on first use with a little bignum arithmetic: a
+// power of five by repeated multiplication, and 2^1024 / 5^q by repeated
+// division, which rounds down exactly as a single division would.
+class power_tables
+{
+    private:
+        typedef vector<uint32_t> bignum;
+        static int bit_length(const bignum &x);
+        static unsigned __int128 shifted(const bignum &x, int shift);
+    public:
+        enum { pow5_count = 326, inverse_count = 342, pow10_min = -342, pow10_max = 308 };
+        // 5^i in 125 bits, rounded down
+        unsigned __int128 pow5[pow5_count];
+        // 2^(bits(5^i) + 124) / 5^i, rounded down, plus one
+        unsigned __int128 inverse[inverse_count];
+        // 5^e, scaled to have its top bit at bit 127 and rounded down;
+        // 10^e has the same bits
+        unsigned __int128 pow10[pow10_max - pow10_min + 1];
+        power_tables();
+        static const power_tables& get() { static power_tables t; return t; };
+};
+
+int power_tables::bit_length(const bignum &x) {
+    for(size_t i = x.size(); i-- > 0;){
+        if(x[i] != 0)
+            return (int)i * 32 + 32 - __builtin_clz(x[i]);
+    }
+    return 0;
+}
+
+// x / 2^shift, or x * 2^-shift when shift is negative, in 128 bits
+unsigned __int128 power_tables::shifted(const bignum &x, int shift) {
+    if(shift < 0)
+        return shifted(x, 0) << -shift;
+    unsigned __int128 r = 0;
+    for(int i = 127; i >= 0; i--){
+        size_t bit = (size_t)shift + i;
+        if(bit / 32 < x.size() && (x[bit / 32] >> (bit % 32) & 1))
+            r |= (unsigned __int128)1 << i;
+    }
+    return r;
+}
+
+power_tables::power_tables() {
+    bignum power(1, 1);
+    bignum quotient(33, 0);
+    quotient[32] = 1;
+    for(int q = 0; q <= pow10_max || q <= -pow10_min; q++){
+        int bits = bit_length(power);
+        if(q < pow5_count)
+            pow5[q] = shifted(power, bits - 125);
+        if(q < inverse_count)
+            inverse[q] = shifted(quotient, 1024 - bits - 124) + 1;
+        if(q <= pow10_max)
+            pow10[q - pow10_min] = shifted(power, bits - 128);
+        if(q <= -pow10_min)
+            pow10[-q - pow10_min] = shifted(quotient, bit_length(quotient) - 128);
+        uint64_t carry = 0;
+        for(uint32_t &w : power){
+            carry += (uint64_t)w * 5;
+            w = (uint32_t)carry;
+            carry >>= 32;
+        }
+        if(carry != 0)
+            power.push_back((uint32_t)carry);
+        uint64_t remainder = 0;
+        for(size_t i = quotient.size(); i-- > 0;){
+            remainder = remainder << 32 | quotient[i];
+            quotient[i] = (uint32_t)(remainder / 5);
+            remainder %= 5;
+        }
+    }
+}
+
+// Ryu: the shortest decimal digits that read back as x, which must be
+// finite and not zero. x is digits * 10^exponent.
+void shortest_digits(double x, uint64_t *digits, int *exponent) {
+    const power_tables &t = power_tables::get();
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    uint64_t mantissa = bits & ((1ULL << 52) - 1);
+    int biased = (int)(bits >> 52 & 0x7ff);
+    // x is m2 * 2^e2, with two extra bits to find the halfway points
+    uint64_t m2 = biased == 0 ? mantissa : mantissa | 1ULL << 52;
+    int e2 = (biased == 0 ? 1 : biased) - 1023 - 52 - 2;
+    bool even = (m2 & 1) == 0;
+    uint64_t mv = 4 * m2;
+    // the gap below is half as wide at a power of two
+    int mm_shift = mantissa != 0 || biased <= 1;
+    // vr, vp and vm are x and the halfway points either side of it,
+    // scaled by 10^-e10 and rounded down
+    uint64_t vr, vp, vm;
+    int e10;
+    bool vm_trailing_zeros = false, vr_trailing_zeros = false;
+    auto mul_shift = [](uint64_t m, unsigned __int128 mul, int j) {
+        unsigned __int128 low = (unsigned __int128)m * (uint64_t)mul;
+        unsigned __int128 high = (unsigned __int128)m * (uint64_t)(mul >> 64);
+        return (uint64_t)(((low >> 64) + high) >> (j - 64));
+    };
+    auto pow5_factor = [](uint64_t v) {
+        int n = 0;
+        while(v % 5 == 0){
+            v /= 5;
+            n++;
+        }
+        return n;
+    };
+    if(e2 >= 0){
+        int q = (int)(((uint64_t)e2 * 78913) >> 18) - (e2 > 3);
+        e10 = q;
+        int k = 125 + (int)((((uint64_t)q * 1217359) >> 19) + 1) - 1;
+        int i = -e2 + q + k;
+        vr = mul_shift(mv, t.inverse[q], i);
+        vp = mul_shift(mv + 2, t.inverse[q], i);
+        vm = mul_shift(mv - 1 - mm_shift, t.inverse[q], i);
+        if(q <= 21){
+            if(mv % 5 == 0)
+                vr_trailing_zeros = pow5_factor(mv) >= q;
+            else if(even)
+                vm_trailing_zeros = pow5_factor(mv - 1 - mm_shift) >= q;
+            else
+                vp -= pow5_factor(mv + 2) >= q;
+        }
+    }else{
+        int q = (int)(((uint64_t)-e2 * 732923) >> 20) - (-e2 > 1);
+        e10 = q + e2;
+        int i = -e2 - q;
+        int k = (int)((((uint64_t)i * 1217359) >> 19) + 1) - 125;
+        int j = q - k;
+        vr = mul_shift(mv, t.pow5[i], j);
+        vp = mul_shift(mv + 2, t.pow5[i], j);
+        vm = mul_shift(mv - 1 - mm_shift, t.pow5[i], j);
+        if(q <= 1){
+            vr_trailing_zeros = true;
+            if(even)
+                vm_trailing_zeros = mm_shift == 1;
+            else
+                --vp;
+        }else if(q < 63){
+            vr_trailing_zeros = (mv & ((1ULL << q) - 1)) == 0;
+        }
+    }
+    // drop digits while the halfway points still differ above them
+    int removed = 0;
+    int last_removed = 0;
+    uint64_t output;
+    if(vm_trailing_zeros || vr_trailing_zeros){
+        while(vp / 10 > vm / 10){
+            vm_trailing_zeros &= vm % 10 == 0;
+            vr_trailing_zeros &= last_removed == 0;
+            last_removed = (int)(vr % 10);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if(vm_trailing_zeros){
+            while(vm % 10 == 0){
+                vr_trailing_zeros &= last_removed == 0;
+                last_removed = (int)(vr % 10);
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        // an exact tie rounds to even
+        if(vr_trailing_zeros && last_removed == 5 && vr % 2 == 0)
+            last_removed = 4;
+        output = vr + ((vr == vm && (!even || !vm_trailing_zeros)) || last_removed >= 5);
+    }else{
+        bool round_up = false;
+        while(vp / 10 > vm / 10){
+            round_up = vr % 10 >= 5;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || round_up);
+    }
+    *digits = output;
+    *exponent = e10 + removed;
+}
+
+// Python's repr of a float: the fewest digits that read back as the
+// same double, in fixed notation for exponents from -4 to 15 and in
+// scientific notation otherwise
+string format_float(double x) {
+    if(std::isnan(x))
+        return "nan";
+    if(std::isinf(x))
+        return x > 0 ? "inf" : "-inf";
+    string s = std::signbit(x) ? "-" : "";
+    if(x == 0)
+        return s + "0.0";
+    uint64_t output;
+    int exponent;
+    shortest_digits(x, &output, &exponent);
+    char buffer[24];
+    int n = snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)output);
+    string digits(buffer, n);
+    // the exponent of the first digit
+    exponent += n - 1;
+    if(exponent < -4 || exponent >= 16){
+        s += digits[0];
+        if(digits.size() > 1)
+            s += "." + digits.substr(1);
+        char e[16];
+        snprintf(e, sizeof(e), "e%c%02d", exponent < 0 ? '-' : '+', abs(exponent));
+        return s + e;
+    }
+    if(exponent < 0)
+        return s + "0." + string(-exponent - 1, '0') + digits;
+    if(digits.size() <= (size_t)exponent + 1)
+        return s + digits + string(exponent + 1 - digits.size(), '0') + ".0";
+    return s + digits.substr(0, exponent + 1) + "." + digits.substr(exponent + 1);
+}
+
+// Eisel-Lemire: mantissa * 10^exponent as the nearest double, when a
+// 128-bit product settles it; false leaves the hard cases to strtod
+bool decimal_to_double(uint64_t mantissa, int exponent, bool negative, double *result) {
+    const power_tables &t = power_tables::get();
+    if(exponent < power_tables::pow10_min || exponent > power_tables::pow10_max)
+        return false;
+    int clz = __builtin_clzll(mantissa);
+    mantissa <<= clz;
+    uint64_t exponent2 = (uint64_t)(((217706 * (long long)exponent) >> 16) + 64 + 1023 - clz);
+    unsigned __int128 power = t.pow10[exponent - power_tables::pow10_min];
+    unsigned __int128 x = (unsigned __int128)mantissa * (uint64_t)(power >> 64);
+    uint64_t x_high = (uint64_t)(x >> 64), x_low = (uint64_t)x;
+    // the low half of the power matters only if it could carry into
+    // the bits that are kept
+    if((x_high & 0x1ff) == 0x1ff && x_low + mantissa < mantissa){
+        unsigned __int128 y = (unsigned __int128)mantissa * (uint64_t)power;
+        uint64_t y_high = (uint64_t)(y >> 64), y_low = (uint64_t)y;
+        uint64_t merged_high = x_high, merged_low = x_low + y_high;
+        if(merged_low < x_low)
+            merged_high++;
+        if((merged_high & 0x1ff) == 0x1ff && merged_low + 1 == 0 && y_low + mantissa < mantissa)
+            return false;
+        x_high = merged_high;
+        x_low = merged_low;
+    }
+    uint64_t msb = x_high >> 63;
+    uint64_t bits = x_high >> (msb + 9);
+    exponent2 -= 1 ^ msb;
+    // a product just at a halfway point might be an approximation of
+    // one just off it
+    if(x_low == 0 && (x_high & 0x1ff) == 0 && (bits & 3) == 1)
+        return false;
+    bits += bits & 1;
+    bits >>= 1;
+    if(bits >> 53 > 0){
+        bits >>= 1;
+        exponent2++;
+    }
+    // subnormals, overflow and infinity go to strtod
+    if(exponent2 - 1 >= 0x7ff - 1)
+        return false;
+    bits = exponent2 << 52 | (bits & ((1ULL << 52) - 1));
+    if(negative)
+        bits |= 1ULL << 63;
+    memcpy(result, &bits, sizeof(bits));
+    return true;
+}
+
+// The double nearest to the decimal number [+-]digits[.digits][e[+-]digits]
+// filling text; false if text is not one. Most are read from their
+// first 19 digits with one exact or 128-bit multiplication.
+bool parse_float(text_ref text, double *result) {
+    static const double exact_powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char *p = text.data, *end = text.data + text.size;
+    bool negative = false;
+    if(p < end && (*p == '+' || *p == '-'))
+        negative = *p++ == '-';
+    uint64_t mantissa = 0;
+    int significant = 0, dropped = 0, exponent = 0;
+    bool truncated = false, any = false;
+    for(int part = 0; part < 2; part++){
+        for(; p < end && isdigit((unsigned char)*p); p++){
+            any = true;
+            if(mantissa == 0 && *p == '0'){
+                // leading zeros are not significant
+            }else if(significant < 19){
+                mantissa = mantissa * 10 + (*p - '0');
+                significant++;
+            }else{
+                truncated |= *p != '0';
+                dropped++;
+            }
+            if(part == 1)
+                exponent--;
+        }
+        if(part == 1 || p == end || *p != '.')
+            break;
+        p++;
+    }
+    if(!any)
+        return false;
+    exponent += dropped;
+    if(p < end && (*p == 'e' || *p == 'E')){
+        p++;
+        bool minus = false;
+        if(p < end && (*p == '+' || *p == '-'))
+            minus = *p++ == '-';
+        if(p == end || !isdigit((unsigned char)*p))
+            return false;
+        int e = 0;
+        for(; p < end && isdigit((unsigned char)*p); p++){
+            if(e < 100000)
+                e = e * 10 + (*p - '0');
+        }
+        exponent += minus ? -e : e;
+    }
+    if(p != end)
+        return false;
+    if(!truncated){
+        if(mantissa == 0){
+            *result = negative ? -0.0 : 0.0;
+            return true;
+        }
+        // both exactly representable, so one rounding
+        if(mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22){
+            double x = (double)mantissa;
+            x = exponent < 0 ? x / exact_powers[-exponent] : x * exact_powers[exponent];
+            *result = negative ? -x : x;
+            return true;
+        }
+        if(decimal_to_double(mantissa, exponent, negative, result))
+            return true;
+    }
+    *result = strtod(string(text.data, text.size).c_str(), NULL);
+    return true;
+}
+
+// A decimal int [+-]digits filling text; false if text is not one or
+// *overflow if it does not fit
+bool parse_int(text_ref text, long long *result, bool *overflow) {
+    const char *p = text.data, *end = text.data + text.size;
+    bool negative = false;
+    if(p < end && (*p == '+' || *p == '-'))
+        negative = *p++ == '-';
+    if(p == end)
+        return false;
+    // accumulated negatively so LLONG_MIN fits
+    long long n = 0;
+    *overflow = false;
+    for(; p < end; p++){
+        if(!isdigit((unsigned char)*p))
+            return false;
+        if(__builtin_mul_overflow(n, 10LL, &n) || __builtin_sub_overflow(n, (long long)(*p - '0'), &n))
+            *overflow = true;
+    }
+    if(!negative && !*overflow && __builtin_mul_overflow(n, -1LL, &n))
+        *overflow = true;
+    *result = n;
+    return true;
+}
+
+// quote a string the way Python's repr() does
+string quote_string(const string &s) {
+    char quote = s.find('\'') != string::npos && s.find('\"') == string::npos ? '\"' : '\'';
+    string r(1, quote);
+    for(char c : s){
+        if(c == quote || c == '\\'){
+            r += '\\';
+            r += c;
+        }else if(c == '\n'){
+            r += "\\n";
+        }else if(c == '\t'){
+            r += "\\t";
+        }else if(c == '\r'){
+            r += "\\r";
+        }else{
+            r += c;
+        }
+    }
+    return r + quote;
+}
+
+string repr(const value &v);
+
+// str(v): strings as they are, everything else as its repr
+string to_str(const value &v) {
+    if(v.is(o_str)){
+        text_ref t = str_text(v);
+        return string(t.data, t.size);
+    }
+    return repr(v);
+}
+
+// the repr of a list, tuple, dict or set, one level down
+string items_repr(py_object *o) {
+    switch(o->type){
+    case o_list: {
+        py_list *l = static_cast<py_list *>(o);
+        string s = "[";
+        for(size_t i = 0; i < l->size(); i++){
+            if(i > 0)
+                s += ", ";
+            s += repr(l->get(i));
+        }
+        return s + "]";
+    }
+    case o_tuple: {
+        py_tuple *t = static_cast<py_tuple *>(o);
+        string s = "(";
+        for(size_t i = 0; i < t->length; i++){
+            if(i > 0)
+                s += ", ";
+            s += repr(t->items()[i]);
+        }
+        return s + (t->length == 1 ? ",)" : ")");
+    }
+    case o_dict: {
+        string s = "{";
+        for(auto &e : static_cast<py_dict *>(o)->items){
+            if(s.size() > 1)
+                s += ", ";
+            s += repr(e.first) + ": " + repr(e.second);
+        }
+        return s + "}";
+    }
+    default: {
+        py_set *t = static_cast<py_set *>(o);
+        if(t->items.empty())
+            return "set()";
+        string s = "{";
+        t->items.for_each([&](const value &k) {
+            if(s.size() > 1)
+                s += ", ";
+            s += repr(k);
+        });
+        return s + "}";
+    }
+    }
+}
+
+// the containers repr is inside of, so that one inside itself shows as
+// [...] or {...}
+thread_local vector<py_object *> repr_active;
+
+// The repr of a list, tuple, dict or set. Containers nested past
+// max_call_depth raise and give "": print and str() look for the error.
+string nested_repr(py_object *o) {
+    if(std::find(repr_active.begin(), repr_active.end(), o) != repr_active.end())
+        return o->type == o_list ? "[...]" : o->type == o_tuple ? "(...)" : "{...}";
+    if(current->call_depth >= max_call_depth){
+        raise_error("maximum recursion depth exceeded while getting the repr of an object");
+        return "";
+    }
+    current->call_depth++;
+    repr_active.push_back(o);
+    string s = items_repr(o);
+    repr_active.pop_back();
+    current->call_depth--;
+    return s;
+}
+
+string repr(const value &v) {
+    switch(v.tag()){
+    case value::v_none:
+        return "None";
+    case value::v_bool:
+        return v.as_int() ? "True" : "False";
+    case value::v_int:
+        return to_string(v.as_int());
+    case value::v_float:
+        return format_float(v.as_float());
+    case value::v_object:
+        break;
+    default:
+        return "<NULL>";
+    }
+    py_object *o = v.as_object();
+    switch(o->type){
+    case o_str:
+        return quote_string(static_cast<py_str *>(o)->str());
+    case o_list:
+    case o_tuple:
+        return nested_repr(o);
+    case o_range: {
+        py_range *r = static_cast<py_range *>(o);
+        string s = "range(" + to_string(r->start) + ", " + to_string(r->stop);
+        if(r->step != 1)
+            s += ", " + to_string(r->step);
+        return s + ")";
+    }
+    case o_bound_method: {
+        py_bound_method *m = static_cast<py_bound_method *>(o);
+        return "<built-in method " + static_cast<py_builtin *>(m->function.as_object())->name + " of " + type_name(m->self) + " object>";
+    }
+    case o_function:
+        return "<function " + static_cast<py_function *>(o)->name + ">";
+    case o_generator:
+        return "<" + type_name(v) + " object " + static_cast<py_generator *>(o)->name + ">";
+    case o_dict:
+    case o_set:
+        return nested_repr(o);
+    case o_cell:
+    case o_code:
+    case o_instance:
+    case o_iterator:
+        return "<" + type_name(v) + " object>";
+    case o_class:
+        return "<class '" + static_cast<py_class *>(o)->name + "'>";
+    case o_method: {
+        py_method *m = static_cast<py_method *>(o);
+        return "<bound method " + static_cast<py_function *>(m->function.as_object())->name + " of " + repr(m->self) + ">";
+    }
+    default:
+        return "<built-in function " + static_cast<py_builtin *>(o)->name + ">";
+    }
+}
+
+// bool(v)
+bool truth_value(const value &v) {
+    switch(v.tag()){
+    case value::v_bool:
+    case value::v_int:
+        return v.as_int() != 0;
+    case value::v_float:
+        return v.as_float() != 0;
+    case value::v_object:
+        break;
+    default:
+        return false;
+    }
+    py_object *o = v.as_object();
+    switch(o->type){
+    case o_str:
+        return static_cast<py_str *>(o)->size() > 0;
+    case o_list:
+        return static_cast<py_list *>(o)->size() > 0;
+    case o_tuple:
+        return static_cast<py_tuple *>(o)->length > 0;
+    case o_range:
+        return static_cast<py_range *>(o)->length > 0;
+    case o_dict:
+        return !static_cast<py_dict *>(o)->items.empty();
+    case o_set:
+        return !static_cast<py_set *>(o)->items.empty();
+    default:
+        return true;
+    }
+}
+
+// The parameter of each keyword argument a call site passes, worked out
+// the first time it calls a function with the given code and reused for
+// as long as it keeps calling functions with that code.
+struct call_cache {
+    value code;
+    vector<int> slots;
+};
+
+value call_function(py_function *f, value *args, int nargs, py_tuple *kwnames, call_cache *cache = NULL);
+
+value call_value(const value &callee, value *args, int nargs, py_tuple *kwnames, call_cache *cache = NULL);
+
+int keyword_count(py_tuple *kwnames) {
+    return kwnames == NULL ? 0 : (int)kwnames->length;
+}
+
+// Call callee with self in front of the arguments. Short argument lists
+// are copied to a buffer on the C++ stack rather than the heap.
+value call_with_self(const value &callee, const value &self, value *args, int nargs, py_tuple *kwnames, call_cache *cache) {
+    enum { buffer_size = 8 };
+    int n = nargs + keyword_count(kwnames);
+    value buffer[buffer_size];
+    vector<value> spill;
+    value *a = buffer;
+    if(n + 1 > buffer_size){
+        spill.resize(n + 1);
+        a = spill.data();
+    }
+    a[0] = self;
+    for(int k = 0; k < n; k++)
+        a[k + 1] = args[k];
+    return call_value(callee, a, nargs + 1, kwnames, cache);
+}
+
+// Calling a class makes an instance and passes it to __init__, if the
+// class has one.
+value call_class(const value &cls, value *args, int nargs, py_tuple *kwnames, call_cache *cache) {
+    py_class *c = static_cast<py_class *>(cls.as_object());
+    value self(py_instance::make(cls));
+    value *init = c->lookup(init_name);
+    if(init == NULL){
+        if(nargs + keyword_count(kwnames) > 0)
+            return raise_error(c->name + "() takes no arguments");
+        return self;
+    }
+    value r = call_with_self(*init, self, args, nargs, kwnames, cache);
+    if(r.is_null())
+        return r;
+    if(!r.is_none())
+        return raise_error("__init__() should return None, not '" + type_name(r) + "'");
+    return self;
+}
+
+value call_value(const value &callee, value *args, int nargs, py_tuple *kwnames, call_cache *cache) {
+    if(callee.is(o_function))
+        return call_function(static_cast<py_function *>(callee.as_object()), args, nargs, kwnames, cache);
+    if(callee.is(o_builtin))
+        return static_cast<py_builtin *>(callee.as_object())->function(args, nargs, kwnames);
+    if(callee.is(o_method)){
+        py_method *m = static_cast<py_method *>(callee.as_object());
+        return call_with_self(m->function, m->self, args, nargs, kwnames, cache);
+    }
+    if(callee.is(o_bound_method)){
+        py_bound_method *m = static_cast<py_bound_method *>(callee.as_object());
+        return call_with_self(m->function, m->self, args, nargs, kwnames, NULL);
+    }
+    if(callee.is(o_class))
+        return call_class(callee, args, nargs, kwnames, cache);
+    return raise_error("'" + type_name(callee) + "' object is not callable");
+}
+
+// fail if a native function that takes no keyword arguments was given some
+bool no_keywords(const string &function, py_tuple *kwnames) {
+    if(kwnames == NULL || kwnames->length == 0)
+        return true;
+    raise_error(function + "() takes no keyword arguments");
+    return false;
+}
+
+// Copy the keyword arguments after the nargs positional ones into the
+// slots of the same index as their name in names.
+bool take_keywords(const string &function, value *args, int nargs, py_tuple *kwnames, const char *const names[], value slots[], int count) {
+    for(int k = 0; k < keyword_count(kwnames); k++){
+        const string &name = static_cast<py_str *>(kwnames->items()[k].as_object())->str();
+        int j = 0;
+        while(j < count && name != names[j])
+            j++;
+        if(j == count){
+            raise_error("'" + name + "' is an invalid keyword argument for " + function + "()");
+            return false;
+        }
+        slots[j] = args[nargs + k];
+    }
+    return true;
+}
+
+typedef enum {t_invalid_token=0, t_symbol,
+	t_integer, t_literal,
+	t_constant, t_punctuation,
+	t_whitespace, t_eol, t_indent, t_dedent, t_eof
+} t_type;
+
+// operator codes carried in the sub field of op_binary and op_compare
+typedef enum {b_add, b_sub, b_mul, b_div, b_mod, b_floordiv, b_pow,
+    b_lshift, b_rshift, b_and, b_or, b_xor} binary_op;
+typedef enum {c_eq, c_ne, c_lt, c_le, c_gt, c_ge, c_in, c_not_in} compare_op;
+
+compact_dict <istr, int> arithmetic_table = {{"+",b_add},{"-",b_sub},{"*",b_mul},{"/",b_div},{"%",b_mod},
+    {"//",b_floordiv},{"**",b_pow},{"<<",b_lshift},{">>",b_rshift},{"&",b_and},{"|",b_or},{"^",b_xor}};
+compact_dict <istr, int> augmented_table = {{"+=",b_add},{"-=",b_sub},{"*=",b_mul},{"/=",b_div},{"%=",b_mod},
+    {"//=",b_floordiv},{"**=",b_pow},{"<<=",b_lshift},{">>=",b_rshift},{"&=",b_and},{"|=",b_or},{"^=",b_xor}};
+compact_dict <istr, int> compare_table = {{"==",c_eq},{"!=",c_ne},{"<",c_lt},{"<=",c_le},{">",c_gt},{">=",c_ge}};
+compact_dict <istr, string> key_table = {{"False","False"},{"None","None"},{"True","True"},{"and","and"},
+    {"as","as"},{"assert","assert"},{"async","async"},{"await","await"},{"break","break"},{"class","class"},
+    {"continue","continue"},{"def","def"},{"del","del"},{"elif","elif"},{"else","else"},{"except","except"},
+    {"finally","finally"},{"for","for"},{"from","from"},{"global","global"},{"if","if"},{"import","import"},
+    {"in","in"},{"is","is"},{"lambda","lambda"},{"nonlocal","nonlocal"},{"not","not"},{"or","or"},
+    {"pass","pass"},{"raise","raise"},{"return","return"},{"try","try"},{"while","while"},{"with","with"},
+    {"yield","yield"}};
+
+deque<pair<int,string>> remove_whitespace(deque<pair<int,string>> tokens);
+
+deque<pair<int,string>> remove_whitespace(deque<pair<int,string>> tokens){
+    deque<pair<int,string>> newtokens;
+    while(!tokens.empty()){
+        if(tokens.at(0).first != t_whitespace){
+            newtokens.push_back(tokens.at(0));
+            tokens.pop_front();
+        }else{
+            tokens.pop_front();
+        }
+    }
+    return newtokens;
+}
+
+// Syntax tree built by script_parser. Every node is owned by the parser
+// that made it; kids only point at other nodes of the same parser.
+typedef enum {n_integer, n_string, n_name, n_constant, n_list, n_tuple,
+    n_call, n_keyword, n_attribute, n_subscript, n_slice, n_binary, n_compare, n_negate,
+    n_lambda, n_yield, n_yield_from, n_await, n_expression, n_assign, n_for, n_def,
+    n_async_def, n_class, n_return, n_global, n_nonlocal, n_pass, n_block,
+    n_dict, n_set, n_list_comp, n_set_comp, n_dict_comp, n_comp_for, n_comp_if, n_aug_assign,
+    n_chain, n_and, n_or, n_not, n_if, n_while, n_break, n_continue, n_float, n_del
+} node_kind;
+
+class ast_node
+{
+    public:
+        int kind;
+        int op;
+        string text;
+        vector<ast_node *> kids;
+        ast_node(int k, const string &t) : kind(k), op(0), text(t) { };
+};
+
+// How deeply a script may nest, as CPython limits it: brackets, blocks,
+// and the parser's own recursion, which a chain of unary minus or not
+// drives without brackets. The syntax tree is bounded separately, by the
+// compiler that walks it.
+enum { max_brackets = 200, max_indents = 100, max_parse_depth = 1000 };
+
+// counts a level of nesting for as long as it lives
+struct nesting_level {
+    int &level;
+    nesting_level(int &l) : level(l) { level++; };
+    ~nesting_level() { level--; };
+};
+
+// Recursive descent parser over the token list. Errors are reported by
+// returning NULL with the message kept in error.
+class script_parser
+{
+    private:
+        deque<pair<int,string>> tokens;
+        size_t pos;
+        vector<int> indents;
+        int pending_dedents;
+        int brackets;
+        int depth;
+        vector<unique_ptr<ast_node>> nodes;
+        string error;
+        ast_node* make_node(int kind, const string &text = "");
+        ast_node* fail(const string &message);
+        bool too_deep();
+        const pair<int,string>& peek() const { return tokens[pos]; };
+        pair<int,string> next();
+        bool at(int type) const { return tokens[pos].first == type; };
+        bool at(int type, const string &text) const;
+        bool accept(int type, const string &text);
+        bool expect(int type, const string &text);
+        bool end_statement();
+        ast_node* parse_statement();
+        ast_node* parse_simple_statement();
+        ast_node* parse_for();
+        ast_node* parse_if();
+        ast_node* parse_while();
+        ast_node* parse_loop_else(ast_node *loop);
+        ast_node* parse_def();
+        ast_node* parse_class();
+        ast_node* parse_parameters(const string &close);
+        ast_node* parse_names(int kind);
+        ast_node* parse_suite();
+        ast_node* parse_targets();
+        ast_node* parse_expression_list();
+        ast_node* parse_yield();
+        ast_node* parse_expression();
+        ast_node* parse_or();
+        ast_node* parse_and();
+        ast_node* parse_not();
+        int comparison_operator();
+        ast_node* parse_comparison();
+        ast_node* parse_bitwise(int level);
+        ast_node* parse_arith();
+        ast_node* parse_term();
+        ast_node* parse_unary();
+        ast_node* parse_power();
+        ast_node* parse_postfix();
+        ast_node* parse_atom();
+        ast_node* parse_braces();
+        ast_node* parse_comprehension(ast_node *n, const string &close);
+        bool parse_arguments(ast_node *call, const string &close);
+        bool parse_call_arguments(ast_node *call);
+        ast_node* parse_subscript();
+    public:
+        script_parser(const deque<pair<int,string>> &t);
+        ast_node* parse_program();
+        const string& get_error() const { return error; };
+};
+
+script_parser::script_parser(const deque<pair<int,string>> &t) : tokens(t), pos(0), pending_dedents(0), brackets(0), depth(0) {
+    if(tokens.empty() || tokens.back().first != t_eof)
+        tokens.push_back(make_pair((int)t_eof, string("0")));
+    indents.push_back(0);
+}
+
+ast_node* script_parser::make_node(int kind, const string &text) {
+    nodes.push_back(unique_ptr<ast_node>(new ast_node(kind, text)));
+    return nodes.back().get();
+}
+
+ast_node* script_parser::fail(const string &message) {
+    if(error.empty())
+        error = message;
+    return NULL;
+}
+
+// has the parser recursed, or the brackets nested, past their limit?
+bool script_parser::too_deep() {
+    if(brackets > max_brackets)
+        fail("too many nested parentheses");
+    else if(depth > max_parse_depth)
+        fail("source too complex to parse");
+    else
+        return false;
+    return true;
+}
+
+// consume a token; the final EOF is never consumed
+pair<int,string> script_parser::next() {
+    pair<int,string> t = tokens[pos];
+    if(t.first != t_eof)
+        pos++;
+    return t;
+}
+
+// is the current token the given punctuation or keyword?
+bool script_parser::at(int type, const string &text) const {
+    return tokens[pos].first == type && tokens[pos].second == text;
+}
+
+bool script_parser::accept(int type, const string &text) {
+    if(!at(type, text))
+        return false;
+    next();
+    return true;
+}
+
+bool script_parser::expect(int type, const string &text) {
+    if(accept(type, text))
+        return true;
+    fail("invalid syntax: expected '" + text + "'");
+    return false;
+}
+
+// A simple statement ends at a newline. A dedent or the end of the file
+// ends it too, but is left for the enclosing block to consume.
+bool script_parser::end_statement() {
+    if(at(t_eol)){
+        next();
+        return true;
+    }
+    if(at(t_eof) || at(t_dedent) || pending_dedents > 0)
+        return true;
+    fail(at(t_indent) ? "unexpected indent" : "invalid syntax");
+    return false;
+}
+
+ast_node* script_parser::parse_program() {
+    ast_node *block = make_node(n_block);
+    while(true){
+        if(at(t_eol) || at(t_dedent)){
+            next();
+            continue;
+        }
+        if(at(t_eof))
+            return block;
+        if(at(t_indent))
+            return fail("unexpected indent");
+        ast_node *s = parse_statement();
+        if(s == NULL)
+            return NULL;
+        block->kids.push_back(s);
+    }
+}
+
+ast_node* script_parser::parse_statement() {
+    if(at(t_symbol, "for"))
+        return parse_for();
+    if(at(t_symbol, "if"))
+        return parse_if();
+    if(at(t_symbol, "while"))
+        return parse_while();
+    if(at(t_symbol, "def"))
+        return parse_def();
+    if(accept(t_symbol, "async")){
+        if(!at(t_symbol, "def"))
+            return fail("invalid syntax");
+        ast_node *n = parse_def();
+        if(n != NULL)
+            n->kind = n_async_def;
+        return n;
+    }
+    if(at(t_symbol, "class"))
+        return parse_class();
+    return parse_simple_statement();
+}
+
+// can e be assigned to?
+bool is_target(ast_node *e) {
+    if(e->kind == n_name || e->kind == n_subscript || e->kind == n_attribute)
+        return true;
+    if(e->kind != n_tuple && e->kind != n_list)
+        return false;
+    for(ast_node *k : e->kids){
+        if(!is_target(k))
+            return false;
+    }
+    return true;
+}
+
+ast_node* script_parser::parse_simple_statement() {
+    ast_node *s;
+    if(accept(t_symbol, "pass")){
+        s = make_node(n_pass);
+    }else if(accept(t_symbol, "break")){
+        s = make_node(n_break);
+    }else if(accept(t_symbol, "continue")){
+        s = make_node(n_continue);
+    }else if(accept(t_symbol, "return")){
+        s = make_node(n_return);
+        if(!at(t_eol) && !at(t_eof) && !at(t_dedent)){
+            ast_node *e = parse_expression_list();
+            if(e == NULL)
+                return NULL;
+            s->kids.push_back(e);
+        }
+    }else if(accept(t_symbol, "del")){
+        // only subscripts: names and attributes have no delete path
+        ast_node *e = parse_expression_list();
+        if(e == NULL)
+            return NULL;
+        s = make_node(n_del);
+        if(e->kind == n_tuple)
+            s->kids = e->kids;
+        else
+            s->kids.push_back(e);
+        for(ast_node *k : s->kids){
+            if(k->kind != n_subscript)
+                return fail(k->kind == n_name || k->kind == n_attribute ? "del is only supported on subscripts" : "cannot delete expression");
+            if(k->kids[1]->kind == n_slice)
+                return fail("slice deletion is not supported");
+        }
+    }else if(accept(t_symbol, "global")){
+        s = parse_names(n_global);
+        if(s == NULL)
+            return NULL;
+    }else if(accept(t_symbol, "nonlocal")){
+        s = parse_names(n_nonlocal);
+        if(s == NULL)
+            return NULL;
+    }else{
+        ast_node *e = accept(t_symbol, "yield") ? parse_yield() : parse_expression_list();
+        if(e == NULL)
+            return NULL;
+        if(accept(t_punctuation, "=")){
+            if(!is_target(e))
+                return fail("cannot assign to expression");
+            ast_node *v = accept(t_symbol, "yield") ? parse_yield() : parse_expression_list();
+            if(v == NULL)
+                return NULL;
+            s = make_node(n_assign);
+            s->kids.push_back(e);
+            s->kids.push_back(v);
+        }else if(at(t_punctuation) && augmented_table.count(peek().second) > 0){
+            if(e->kind != n_name && e->kind != n_attribute && e->kind != n_subscript)
+                return fail("illegal expression for augmented assignment");
+            if(e->kind == n_subscript && e->kids[1]->kind == n_slice)
+                return fail("slice assignment is not supported");
+            s = make_node(n_aug_assign);
+            s->op = augmented_table.at(next().second);
+            ast_node *v = accept(t_symbol, "yield") ? parse_yield() : parse_expression_list();
+            if(v == NULL)
+                return NULL;
+            s->kids.push_back(e);
+            s->kids.push_back(v);
+        }else{
+            s = make_node(n_expression);
+            s->kids.push_back(e);
+        }
+    }
+    if(!end_statement())
+        return NULL;
+    return s;
+}
+
+ast_node* script_parser::parse_for() {
+    next();
+    ast_node *target = parse_targets();
+    if(target == NULL)
+        return NULL;
+    ast_node *n = make_node(n_for);
+    n->kids.push_back(target);
+    if(!expect(t_symbol, "in"))
+        return NULL;
+    ast_node *iterable = parse_expression();
+    if(iterable == NULL || !expect(t_punctuation, ":"))
+        return NULL;
+    ast_node *body = parse_suite();
+    if(body == NULL)
+        return NULL;
+    n->kids.push_back(iterable);
+    n->kids.push_back(body);
+    return parse_loop_else(n);
+}
+
+// if test: suite, then any elif and else parts. An elif is kept as an if
+// alone in the else block, so the kids are test, body and maybe orelse.
+// An else that follows more than one closing block belongs further out.
+ast_node* script_parser::parse_if() {
+    next();
+    ast_node *n = make_node(n_if);
+    ast_node *test = parse_expression();
+    if(test == NULL || !expect(t_punctuation, ":"))
+        return NULL;
+    ast_node *body = parse_suite();
+    if(body == NULL)
+        return NULL;
+    n->kids.push_back(test);
+    n->kids.push_back(body);
+    if(pending_dedents > 0)
+        return n;
+    if(at(t_symbol, "elif")){
+        ast_node *orelse = make_node(n_block);
+        ast_node *e = parse_if();
+        if(e == NULL)
+            return NULL;
+        orelse->kids.push_back(e);
+        n->kids.push_back(orelse);
+    }else if(accept(t_symbol, "else")){
+        if(!expect(t_punctuation, ":"))
+            return NULL;
+        ast_node *orelse = parse_suite();
+        if(orelse == NULL)
+            return NULL;
+        n->kids.push_back(orelse);
+    }
+    return n;
+}
+
+ast_node* script_parser::parse_while() {
+    next();
+    ast_node *n = make_node(n_while);
+    ast_node *test = parse_expression();
+    if(test == NULL || !expect(t_punctuation, ":"))
+        return NULL;
+    ast_node *body = parse_suite();
+    if(body == NULL)
+        return NULL;
+    n->kids.push_back(test);
+    n->kids.push_back(body);
+    return parse_loop_else(n);
+}
+
+// the else block of a loop, run unless it ends in a break, as its last kid
+ast_node* script_parser::parse_loop_else(ast_node *loop) {
+    if(pending_dedents > 0 || !accept(t_symbol, "else"))
+        return loop;
+    if(!expect(t_punctuation, ":"))
+        return NULL;
+    ast_node *orelse = parse_suite();
+    if(orelse == NULL)
+        return NULL;
+    loop->kids.push_back(orelse);
+    return loop;
+}
+
+// The body of a compound statement: the rest of the line, or an indented
+// block. A dedent token may close several blocks at once; the innermost
+// block consumes it and leaves pending_dedents for the ones around it.
+// def NAME(parameters): suite
+ast_node* script_parser::parse_def() {
+    next();
+    if(!at(t_symbol) || key_table.count(peek().second) > 0)
+        return fail("invalid syntax");
+    ast_node *n = make_node(n_def, next().second);
+    if(!expect(t_punctuation, "("))
+        return NULL;
+    ast_node *parameters = parse_parameters(")");
+    if(parameters == NULL || !expect(t_punctuation, ":"))
+        return NULL;
+    ast_node *body = parse_suite();
+    if(body == NULL)
+        return NULL;
+    n->kids.push_back(parameters);
+    n->kids.push_back(body);
+    return n;
+}
+
+// class NAME[(BASE)]: suite, with the body in kids[0] and the base, if
+// any, in kids[1]
+ast_node* script_parser::parse_class() {
+    next();
+    if(!at(t_symbol) || key_table.count(peek().second) > 0)
+        return fail("invalid syntax");
+    ast_node *n = make_node(n_class, next().second);
+    ast_node *base = NULL;
+    if(accept(t_punctuation, "(") && !accept(t_punctuation, ")")){
+        base = parse_expression();
+        if(base == NULL || !expect(t_punctuation, ")"))
+            return NULL;
+    }
+    if(!expect(t_punctuation, ":"))
+        return NULL;
+    ast_node *body = parse_suite();
+    if(body == NULL)
+        return NULL;
+    n->kids.push_back(body);
+    if(base != NULL)
+        n->kids.push_back(base);
+    return n;
+}
+
+// Comma separated parameter names up to close, which is consumed. A
+// parameter with a default value has it as its kid.
+ast_node* script_parser::parse_parameters(const string &close) {
+    ast_node *n = make_node(n_block);
+    while(!accept(t_punctuation, close)){
+        if(!at(t_symbol) || key_table.count(peek().second) > 0)
+            return fail("invalid syntax");
+        string name = next().second;
+        for(ast_node *k : n->kids){
+            if(k->text == name)
+                return fail("duplicate argument '" + name + "' in function definition");
+        }
+        ast_node *p = make_node(n_name, name);
+        if(accept(t_punctuation, "=")){
+            ast_node *e = parse_expression();
+            if(e == NULL)
+                return NULL;
+            p->kids.push_back(e);
+        }else if(!n->kids.empty() && !n->kids.back()->kids.empty()){
+            return fail("non-default argument follows default argument");
+        }
+        n->kids.push_back(p);
+        if(!at(t_punctuation, close) && !expect(t_punctuation, ","))
+            return NULL;
+    }
+    return n;
+}
+
+// the names of a global or nonlocal statement
+ast_node* script_parser::parse_names(int kind) {
+    ast_node *n = make_node(kind);
+    do {
+        if(!at(t_symbol) || key_table.count(peek().second) > 0)
+            return fail("invalid syntax");
+        n->kids.push_back(make_node(n_name, next().second));
+    } while(accept(t_punctuation, ","));
+    return n;
+}
+
+ast_node* script_parser::parse_suite() {
+    ast_node *block = make_node(n_block);
+    if(at(t_eol) || at(t_eof))
+        return fail("expected an indented block");
+    if(!at(t_indent)){
+        ast_node *s = parse_simple_statement();
+        if(s == NULL)
+            return NULL;
+        block->kids.push_back(s);
+        return block;
+    }
+    if(indents.size() > max_indents)
+        return fail("too many levels of indentation");
+    indents.push_back(stoi(next().second));
+    while(true){
+        if(pending_dedents > 0){
+            pending_dedents--;
+            break;
+        }
+        if(at(t_eol)){
+            next();
+            continue;
+        }
+        if(at(t_eof)){
+            indents.pop_back();
+            break;
+        }
+        if(at(t_dedent)){
+            int level = stoi(next().second);
+            int closed = 0;
+            while(indents.back() > level){
+                indents.pop_back();
+                closed++;
+            }
+            if(indents.back() != level)
+                return fail("unindent does not match any outer indentation level");
+            pending_dedents = closed - 1;
+            break;
+        }
+        if(at(t_indent))
+            return fail("unexpected indent");
+        ast_node *s = parse_statement();
+        if(s == NULL)
+            return NULL;
+        block->kids.push_back(s);
+    }
+    if(block->kids.empty())
+        return fail("expected an indented block");
+    return block;
+}
+
+// the target list of a for loop, stopping in front of 'in'
+ast_node* script_parser::parse_targets() {
+    ast_node *t = parse_postfix();
+    if(t == NULL)
+        return NULL;
+    if(at(t_punctuation, ",")){
+        ast_node *n = make_node(n_tuple);
+        n->kids.push_back(t);
+        while(accept(t_punctuation, ",") && !at(t_symbol, "in")){
+            t = parse_postfix();
+            if(t == NULL)
+                return NULL;
+            n->kids.push_back(t);
+        }
+        t = n;
+    }
+    if(!is_target(t))
+        return fail("cannot assign to expression");
+    return t;
+}
+
+// one expression, or several separated by commas forming a tuple
+ast_node* script_parser::parse_expression_list() {
+    ast_node *e = parse_expression();
+    if(e == NULL || !at(t_punctuation, ","))
+        return e;
+    ast_node *n = make_node(n_tuple);
+    n->kids.push_back(e);
+    while(accept(t_punctuation, ",")){
+        if(at(t_eol) || at(t_eof) || at(t_dedent) || at(t_punctuation, "=") || at(t_punctuation, ")"))
+            break;
+        e = parse_expression();
+        if(e == NULL)
+            return NULL;
+        n->kids.push_back(e);
+    }
+    return n;
+}
+
+// yield [expressions] or yield from expression, after the yield
+ast_node* script_parser::parse_yield() {
+    if(accept(t_symbol, "from")){
+        ast_node *e = parse_expression();
+        if(e == NULL)
+            return NULL;
+        ast_node *n = make_node(n_yield_from);
+        n->kids.push_back(e);
+        return n;
+    }
+    ast_node *n = make_node(n_yield);
+    if(!at(t_eol) && !at(t_eof) && !at(t_dedent) && !at(t_punctuation, ")") && !at(t_punctuation, "=")){
+        ast_node *e = parse_expression_list();
+        if(e == NULL)
+            return NULL;
+        n->kids.push_back(e);
+    }
+    return n;
+}
+
+ast_node* script_parser::parse_expression() {
+    nesting_level level(depth);
+    if(too_deep())
+        return NULL;
+    if(accept(t_symbol, "lambda")){
+        ast_node *n = make_node(n_lambda, "<lambda>");
+        ast_node *parameters = parse_parameters(":");
+        if(parameters == NULL)
+            return NULL;
+        ast_node *body = parse_expression();
+        if(body == NULL)
+            return NULL;
+        n->kids.push_back(parameters);
+        n->kids.push_back(body);
+        return n;
+    }
+    return parse_or();
+}
+
+// a or b or c becomes one n_or node over all of them, and likewise and
+ast_node* script_parser::parse_or() {
+    ast_node *left = parse_and();
+    if(left == NULL || !at(t_symbol, "or"))
+        return left;
+    ast_node *n = make_node(n_or);
+    n->kids.push_back(left);
+    while(accept(t_symbol, "or")){
+        ast_node *right = parse_and();
+        if(right == NULL)
+            return NULL;
+        n->kids.push_back(right);
+    }
+    return n;
+}
+
+ast_node* script_parser::parse_and() {
+    ast_node *left = parse_not();
+    if(left == NULL || !at(t_symbol, "and"))
+        return left;
+    ast_node *n = make_node(n_and);
+    n->kids.push_back(left);
+    while(accept(t_symbol, "and")){
+        ast_node *right = parse_not();
+        if(right == NULL)
+            return NULL;
+        n->kids.push_back(right);
+    }
+    return n;
+}
+
+ast_node* script_parser::parse_not() {
+    if(!accept(t_symbol, "not"))
+        return parse_comparison();
+    nesting_level level(depth);
+    if(too_deep())
+        return NULL;
+    ast_node *e = parse_not();
+    if(e == NULL)
+        return NULL;
+    ast_node *n = make_node(n_not);
+    n->kids.push_back(e);
+    return n;
+}
+
+// the comparison operator at the current token, if any, consuming it
+int script_parser::comparison_operator() {
+    if(at(t_punctuation) && compare_table.count(peek().second) > 0)
+        return compare_table.at(next().second);
+    if(accept(t_symbol, "in"))
+        return c_in;
+    if(at(t_symbol, "not") && tokens[pos + 1].first == t_symbol && tokens[pos + 1].second == "in"){
+        pos += 2;
+        return c_not_in;
+    }
+    return -1;
+}
+
+// A single comparison is an n_compare of its two operands. A chain such
+// as a < b < c is an n_chain of the first operand followed by an
+// n_compare for each link, holding the operator and its right operand.
+ast_node* script_parser::parse_comparison() {
+    ast_node *left = parse_bitwise(0);
+    if(left == NULL)
+        return NULL;
+    vector<ast_node *> links;
+    for(int op = comparison_operator(); op >= 0; op = comparison_operator()){
+        ast_node *link = make_node(n_compare);
+        link->op = op;
+        ast_node *right = parse_bitwise(0);
+        if(right == NULL)
+            return NULL;
+        link->kids.push_back(right);
+        links.push_back(link);
+    }
+    if(links.empty())
+        return left;
+    if(links.size() == 1){
+        links[0]->kids.insert(links[0]->kids.begin(), left);
+        return links[0];
+    }
+    ast_node *n = make_node(n_chain);
+    n->kids.push_back(left);
+    n->kids.insert(n->kids.end(), links.begin(), links.end());
+    return n;
+}
+
+// the operators of each level of bitwise_levels, loosest first
+const char *const bitwise_levels[][2] = {{"|", ""}, {"^", ""}, {"&", ""}, {"<<", ">>"}};
+
+// | ^ & and the shifts, which bind looser than + and - in that order
+ast_node* script_parser::parse_bitwise(int level) {
+    if(level == 4)
+        return parse_arith();
+    ast_node *left = parse_bitwise(level + 1);
+    while(left != NULL && (at(t_punctuation, bitwise_levels[level][0]) || at(t_punctuation, bitwise_levels[level][1]))){
+        ast_node *n = make_node(n_binary);
+        n->op = arithmetic_table.at(next().second);
+        ast_node *right = parse_bitwise(level + 1);
+        if(right == NULL)
+            return NULL;
+        n->kids.push_back(left);
+        n->kids.push_back(right);
+        left = n;
+    }
+    return left;
+}
+
+ast_node* script_parser::parse_arith() {
+    ast_node *left = parse_term();
+    while(left != NULL && (at(t_punctuation, "+") || at(t_punctuation, "-"))){
+        ast_node *n = make_node(n_binary);
+        n->op = arithmetic_table.at(next().second);
+        ast_node *right = parse_term();
+        if(right == NULL)
+            return NULL;
+        n->kids.push_back(left);
+        n->kids.push_back(right);
+        left = n;
+    }
+    return left;
+}
+
+ast_node* script_parser::parse_term() {
+    ast_node *left = parse_unary();
+    while(left != NULL && (at(t_punctuation, "*") || at(t_punctuation, "/") || at(t_punctuation, "%") || at(t_punctuation, "//"))){
+        ast_node *n = make_node(n_binary);
+        n->op = arithmetic_table.at(next().second);
+        ast_node *right = parse_unary();
+        if(right == NULL)
+            return NULL;
+        n->kids.push_back(left);
+        n->kids.push_back(right);
+        left = n;
+    }
+    return left;
+}
+
+ast_node* script_parser::parse_unary() {
+    nesting_level level(depth);
+    if(too_deep())
+        return NULL;
+    if(accept(t_punctuation, "+"))
+        return parse_unary();
+    if(accept(t_punctuation, "-")){
+        ast_node *operand = parse_unary();
+        if(operand == NULL)
+            return NULL;
+        ast_node *n = make_node(n_negate);
+        n->kids.push_back(operand);
+        return n;
+    }
+    return parse_power();
+}
+
+// x ** y binds tighter than a unary minus on its left but not on its
+// right, and groups from the right
+ast_node* script_parser::parse_power() {
+    ast_node *e;
+    if(accept(t_symbol, "await")){
+        ast_node *operand = parse_postfix();
+        if(operand == NULL)
+            return NULL;
+        e = make_node(n_await);
+        e->kids.push_back(operand);
+    }else if((e = parse_postfix()) == NULL){
+        return NULL;
+    }
+    if(!accept(t_punctuation, "**"))
+        return e;
+    ast_node *exponent = parse_unary();
+    if(exponent == NULL)
+        return NULL;
+    ast_node *n = make_node(n_binary);
+    n->op = b_pow;
+    n->kids.push_back(e);
+    n->kids.push_back(exponent);
+    return n;
+}
+
+ast_node* script_parser::parse_postfix() {
+    ast_node *e = parse_atom();
+    while(e != NULL){
+        nesting_level level(brackets);
+        if((at(t_punctuation, "(") || at(t_punctuation, "[")) && too_deep())
+            return NULL;
+        if(accept(t_punctuation, "(")){
+            ast_node *call = make_node(n_call);
+            call->kids.push_back(e);
+            if(!parse_call_arguments(call))
+                return NULL;
+            e = call;
+        }else if(accept(t_punctuation, ".")){
+            if(!at(t_symbol) || key_table.count(peek().second) > 0)
+                return fail("invalid syntax");
+            ast_node *n = make_node(n_attribute, next().second);
+            n->kids.push_back(e);
+            e = n;
+        }else if(accept(t_punctuation, "[")){
+            ast_node *n = make_node(n_subscript);
+            ast_node *index = parse_subscript();
+            if(index == NULL || !expect(t_punctuation, "]"))
+                return NULL;
+            n->kids.push_back(e);
+            n->kids.push_back(index);
+            e = n;
+        }else{
+            break;
+        }
+    }
+    return e;
+}
+
+// translate the escape sequences the lexer leaves in string literals
+string unescape(const string &s) {
+    string r;
+    for(size_t i = 0; i < s.size(); i++){
+        if(s[i] != '\\' || i + 1 == s.size()){
+            r += s[i];
+            continue;
+        }
+        char c = s[++i];
+        switch(c){
+        case 'n':
+            r += '\n';
+            break;
+        case 't':
+            r += '\t';
+            break;
+        case 'r':
+            r += '\r';
+            break;
+        case '0':
+            r += '\0';
+            break;
+        case '\\':
+        case '\'':
+        case '\"':
+            r += c;
+            break;
+        default:
+            r += '\\';
+            r += c;
+            break;
+        }
+    }
+    return r;
+}
+
+ast_node* script_parser::parse_atom() {
+    pair<int,string> t = next();
+    switch(t.first){
+    case t_integer: {
+        const string &s = t.second;
+        bool hex = s.size() > 1 && (s[1] == 'x' || s[1] == 'X');
+        bool real = !hex && s.find_first_of(".eE") != string::npos;
+        return make_node(real ? n_float : n_integer, s);
+    }
+    case t_literal:
+    case t_constant: {
+        // adjacent literals are concatenated
+        string s = unescape(t.second);
+        while(at(t_literal) || at(t_constant))
+            s += unescape(next().second);
+        return make_node(n_string, s);
+    }
+    case t_symbol:
+        if(t.second == "None" || t.second == "True" || t.second == "False")
+            return make_node(n_constant, t.second);
+        if(key_table.count(t.second) > 0)
+            return fail("invalid syntax near '" + t.second + "'");
+        return make_node(n_name, t.second);
+    case t_punctuation: {
+        nesting_level level(brackets);
+        if(too_deep())
+            return NULL;
+        if(t.second == "("){
+            if(accept(t_punctuation, ")"))
+                return make_node(n_tuple);
+            ast_node *e = accept(t_symbol, "yield") ? parse_yield() : parse_expression_list();
+            if(e == NULL || !expect(t_punctuation, ")"))
+                return NULL;
+            return e;
+        }
+        if(t.second == "["){
+            if(accept(t_punctuation, "]"))
+                return make_node(n_list);
+            ast_node *e = parse_expression();
+            if(e == NULL)
+                return NULL;
+            ast_node *n = make_node(at(t_symbol, "for") ? n_list_comp : n_list);
+            n->kids.push_back(e);
+            if(n->kind == n_list_comp)
+                return parse_comprehension(n, "]");
+            if(!at(t_punctuation, "]") && !expect(t_punctuation, ","))
+                return NULL;
+            if(!parse_arguments(n, "]"))
+                return NULL;
+            return n;
+        }
+        if(t.second == "{")
+            return parse_braces();
+        return fail("invalid syntax near '" + t.second + "'");
+    }
+    case t_eof:
+        return fail("unexpected end of file");
+    default:
+        return fail("invalid syntax");
+    }
+}
+
+// A dict or set display or comprehension, after the "{". The kids of a
+// dict are its keys and values alternately.
+ast_node* script_parser::parse_braces() {
+    if(accept(t_punctuation, "}"))
+        return make_node(n_dict);
+    ast_node *e = parse_expression();
+    if(e == NULL)
+        return NULL;
+    if(!accept(t_punctuation, ":")){
+        ast_node *n = make_node(at(t_symbol, "for") ? n_set_comp : n_set);
+        n->kids.push_back(e);
+        if(n->kind == n_set_comp)
+            return parse_comprehension(n, "}");
+        if(!at(t_punctuation, "}") && !expect(t_punctuation, ","))
+            return NULL;
+        if(!parse_arguments(n, "}"))
+            return NULL;
+        return n;
+    }
+    ast_node *v = parse_expression();
+    if(v == NULL)
+        return NULL;
+    ast_node *n = make_node(at(t_symbol, "for") ? n_dict_comp : n_dict);
+    n->kids.push_back(e);
+    n->kids.push_back(v);
+    if(n->kind == n_dict_comp)
+        return parse_comprehension(n, "}");
+    while(accept(t_punctuation, ",") && !at(t_punctuation, "}")){
+        if((e = parse_expression()) == NULL || !expect(t_punctuation, ":") || (v = parse_expression()) == NULL)
+            return NULL;
+        n->kids.push_back(e);
+        n->kids.push_back(v);
+    }
+    if(!expect(t_punctuation, "}"))
+        return NULL;
+    return n;
+}
+
+// The for and if clauses of a comprehension up to the closing bracket,
+// appended to n after its element. A for clause has the target and the
+// iterable as kids.
+ast_node* script_parser::parse_comprehension(ast_node *n, const string &close) {
+    while(!accept(t_punctuation, close)){
+        if(accept(t_symbol, "for")){
+            ast_node *c = make_node(n_comp_for);
+            ast_node *target = parse_targets();
+            if(target == NULL || !expect(t_symbol, "in"))
+                return NULL;
+            ast_node *iterable = parse_expression();
+            if(iterable == NULL)
+                return NULL;
+            c->kids.push_back(target);
+            c->kids.push_back(iterable);
+            n->kids.push_back(c);
+        }else if(accept(t_symbol, "if")){
+            ast_node *c = make_node(n_comp_if);
+            ast_node *condition = parse_expression();
+            if(condition == NULL)
+                return NULL;
+            c->kids.push_back(condition);
+            n->kids.push_back(c);
+        }else{
+            return fail("invalid syntax: expected '" + close + "'");
+        }
+    }
+    return n;
+}
+
+// comma separated expressions up to the closing bracket, appended to n
+bool script_parser::parse_arguments(ast_node *n, const string &close) {
+    while(!accept(t_punctuation, close)){
+        ast_node *e = parse_expression();
+        if(e == NULL)
+            return false;
+        n->kids.push_back(e);
+        if(!at(t_punctuation, close) && !expect(t_punctuation, ","))
+            return false;
+    }
+    return true;
+}
+
+// An index, or a slice start:stop:step whose missing parts are None. The
+// lexer reads a::b as the single token "::".
+ast_node* script_parser::parse_subscript() {
+    ast_node *n = make_node(n_slice);
+    for(int part = 0; part < 3; part++){
+        if(part > 0 && accept(t_punctuation, "::")){
+            n->kids.push_back(make_node(n_constant, "None"));
+            part++;
+        }else if(part > 0 && !accept(t_punctuation, ":")){
+            break;
+        }
+        if(at(t_punctuation, ":") || at(t_punctuation, "::") || at(t_punctuation, "]")){
+            n->kids.push_back(make_node(n_constant, "None"));
+            continue;
+        }
+        ast_node *e = parse_expression();
+        if(e == NULL)
+            return NULL;
+        n->kids.push_back(e);
+    }
+    if(n->kids.size() == 1)
+        return n->kids[0];
+    while(n->kids.size() < 3)
+        n->kids.push_back(make_node(n_constant, "None"));
+    return n;
+}
+
+// The arguments of a call: positional ones, then NAME=expression keyword
+// arguments as n_keyword nodes.
+bool script_parser::parse_call_arguments(ast_node *call) {
+    bool keywords = false;
+    while(!accept(t_punctuation, ")")){
+        if(at(t_symbol) && pos + 1 < tokens.size() && tokens[pos + 1].first == t_punctuation && tokens[pos + 1].second == "="){
+            string name = next().second;
+            next();
+            for(size_t i = 1; i < call->kids.size(); i++){
+                if(call->kids[i]->kind == n_keyword && call->kids[i]->text == name){
+                    fail("keyword argument repeated: " + name);
+                    return false;
+                }
+            }
+            ast_node *k = make_node(n_keyword, name);
+            ast_node *e = parse_expression();
+            if(e == NULL)
+                return false;
+            k->kids.push_back(e);
+            call->kids.push_back(k);
+            keywords = true;
+        }else{
+            if(keywords){
+                fail("positional argument follows keyword argument");
+                return false;
+            }
+            ast_node *e = parse_expression();
+            if(e == NULL)
+                return false;
+            call->kids.push_back(e);
+        }
+        if(!at(t_punctuation, ")") && !expect(t_punctuation, ","))
+            return false;
+    }
+    return true;
+}
+
+// Bytecode. An instruction is an opcode, a small sub-operand (the operator
+// of op_binary and op_compare) and an argument: a constant, name or
+// argument count, or the target of a jump.
+typedef enum {op_load_const, op_load_global, op_store_global, op_pop_top,
+    op_binary, op_compare, op_negate,
+    op_build_list, op_build_tuple, op_unpack_sequence, op_reverse,
+    op_load_fast, op_store_fast, op_load_deref, op_store_deref, op_load_closure,
+    op_make_function, op_build_class, op_store_class_attr, op_store_attr,
+    op_load_subscript, op_store_subscript, op_delete_subscript, op_load_slice, op_load_attr, op_call, op_call_kw,
+    op_load_method, op_call_method, op_call_method_kw,
+    op_get_iter, op_for_iter, op_for_iter_range, op_for_iter_list,
+    op_yield_value, op_get_yield_from_iter, op_get_awaitable, op_yield_from,
+    op_build_map, op_build_set, op_list_append, op_set_add, op_map_add, op_reserve,
+    op_pop_jump_if_false, op_inplace, op_inplace_fast, op_copy, op_rotate,
+    op_pop_jump_if_true, op_jump_if_false_or_pop, op_jump_if_true_or_pop, op_not, op_compare_jump,
+    op_jump, op_return
+} opcode;
+
+struct instruction {
+    unsigned short op;
+    unsigned short sub;
+    int arg;
+};
+
+// The inline cache of an attribute load or store, found through the sub
+// field of the instruction. It remembers the shape an instance last had
+// there and the slot the attribute is in; a store that added the
+// attribute also remembers the shape the instance moved to.
+struct attr_cache {
+    unsigned shape_id;
+    int slot;
+    shape *next;
+};
+
+enum { no_cache = 0xFFFF };
+
+// The inline cache of a method load: the function found on the receiver's
+// type, for receivers of the same type. For an instance that also means a
+// class still at the same version and a shape with no attribute of the
+// method's name; the native methods of list and str never change.
+struct method_cache {
+    int type;
+    unsigned version;
+    unsigned shape_id;
+    py_object *method;
+};
+
+// The memory of the parts of code objects that running code writes to:
+// the instructions, which specialise themselves in place, and the inline
+// caches. It comes from the heap, except while interpreter::freeze has
+// the arena open, when it is taken from a mapping of its own. There they
+// are packed together, so a --prefork child running frozen code dirties
+// those pages rather than ones it shares with constants and builtins.
+// What the arena hands out is never given back.
+struct code_arena {
+    char *begin, *next, *end;
+    bool open;
+    bool holds(const void *p) const { return p >= begin && p < end; };
+};
+
+code_arena frozen_code = {NULL, NULL, NULL, false};
+
+template <class T>
+struct code_allocator {
+    typedef T value_type;
+    code_allocator() { };
+    template <class U> code_allocator(const code_allocator<U> &) { };
+    T *allocate(size_t n) {
+        size_t bytes = (n * sizeof(T) + 15) & ~(size_t)15;
+        if(frozen_code.open && bytes <= (size_t)(frozen_code.end - frozen_code.next)){
+            T *p = reinterpret_cast<T *>(frozen_code.next);
+            frozen_code.next += bytes;
+            return p;
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    };
+    void deallocate(T *p, size_t) {
+        if(!frozen_code.holds(p))
+            ::operator delete(p);
+    };
+};
+
+template <class T, class U>
+bool operator==(const code_allocator<T> &, const code_allocator<U> &) { return true; }
+template <class T, class U>
+bool operator!=(const code_allocator<T> &, const code_allocator<U> &) { return false; }
+
+// A compiled module or function. A frame running it holds the fast
+// locals (varnames, parameters first), then the cells of the variables
+// captured by nested functions (cellnames) and of those it captures itself
+// (freenames), then its value stack, all in one array. A cell holding a
+// parameter starts out with the argument from the fast slot in cell_args.
+// Calling the code of a generator or coroutine only sets up its frame.
+class code_object : public py_object
+{
+    public:
+        string name;
+        vector<instruction, code_allocator<instruction>> code;
+        vector<value> constants;
+        vector<istr> names;
+        int stack_size;
+        int argcount;
+        vector<string> varnames;
+        vector<string> cellnames;
+        vector<string> freenames;
+        vector<int> cell_args;
+        vector<attr_cache, code_allocator<attr_cache>> caches;
+        vector<method_cache, code_allocator<method_cache>> method_caches;
+        vector<call_cache, code_allocator<call_cache>> call_caches;
+        bool generator;
+        bool coroutine;
+        code_object(const string &n) : py_object(o_code), name(n), stack_size(0), argcount(0), generator(false), coroutine(false) { };
+        size_t frame_size() const { return varnames.size() + cellnames.size() + freenames.size() + stack_size + 1; };
+};
+
+// how many values an instruction leaves on the stack, minus those it takes
+int stack_effect(const instruction &i) {
+    switch(i.op){
+    case op_load_const:
+    case op_load_global:
+    case op_load_fast:
+    case op_load_deref:
+    case op_load_closure:
+    case op_get_iter:
+    case op_for_iter:
+        return 1;
+    case op_store_global:
+    case op_store_fast:
+    case op_store_deref:
+    case op_return:
+    case op_pop_top:
+    case op_binary:
+    case op_compare:
+    case op_load_subscript:
+    case op_inplace:
+    case op_inplace_fast:
+    case op_list_append:
+    case op_set_add:
+    case op_pop_jump_if_false:
+    case op_pop_jump_if_true:
+    case op_jump_if_false_or_pop:
+    case op_jump_if_true_or_pop:
+        return -1;
+    case op_compare_jump:
+    case op_delete_subscript:
+        return -2;
+    case op_map_add:
+        return -2;
+    case op_store_subscript:
+    case op_load_slice:
+        return -3;
+    case op_yield_from:
+        return -1;
+    case op_store_attr:
+        return -2;
+    case op_store_class_attr:
+        return -1;
+    case op_build_list:
+    case op_build_tuple:
+    case op_build_set:
+        return 1 - i.arg;
+    case op_build_map:
+        return 1 - 2 * i.arg;
+    case op_unpack_sequence:
+        return i.arg - 1;
+    case op_copy:
+        return i.arg;
+    case op_load_method:
+        return 1;
+    case op_call:
+        return -i.arg;
+    case op_make_function:
+        return -i.arg - i.sub;
+    case op_call_kw:
+    case op_call_method:
+        return -i.arg - 1;
+    case op_call_method_kw:
+        return -i.arg - 2;
+    default:
+        return 0;
+    }
+}
+
+// What a function, or the module, does with each name, worked out over the
+// whole tree before any code is generated. Names assigned in a function
+// are its locals unless declared global or nonlocal; a local that a nested
+// function uses becomes a cell, and every function between the two passes
+// it on as a free variable.
+struct scope_info {
+    scope_info *parent;
+    bool function;
+    bool generator;
+    bool coroutine;
+    vector<string> locals;
+    vector<string> stores;
+    vector<string> uses;
+    vector<string> globals;
+    vector<string> nonlocals;
+    vector<string> cells;
+    vector<string> frees;
+    vector<string> hidden;
+};
+
+int index_of(const vector<string> &names, const string &name) {
+    for(size_t i = 0; i < names.size(); i++){
+        if(names[i] == name)
+            return (int)i;
+    }
+    return -1;
+}
+
+void add_unique(vector<string> &names, const string &name) {
+    if(index_of(names, name) < 0)
+        names.push_back(name);
+}
+
+// A loop being compiled: where continue goes, whether the loop keeps
+// iteration state on the stack for break to drop, and the jumps of its
+// breaks, patched to the end of the loop.
+struct loop_info {
+    int top;
+    bool iterates;
+    vector<int> breaks;
+};
+
+// Turns a syntax tree into a code object.
+class compiler
+{
+    private:
+        code_object *code;
+        int depth;
+        string error;
+        vector<unique_ptr<scope_info>> scopes;
+        scope_info *scope;
+        vector<string> comp_bound;
+        vector<pair<string,int>> comp_slots;
+        vector<loop_info> loops;
+        scope_info* new_scope(scope_info *parent, bool function);
+        bool analyze(ast_node *n, scope_info *s);
+        bool analyze_store(ast_node *target, scope_info *s);
+        bool analyze_function(ast_node *n, scope_info *s);
+        bool analyze_comprehension(ast_node *n, scope_info *s);
+        bool resolve_scopes();
+        void emit_name(const string &name, bool store);
+        bool compile_function(ast_node *n);
+        bool compile_class(ast_node *n);
+        bool compile_comprehension(ast_node *n);
+        bool compile_augmented(ast_node *n);
+        bool compile_condition(ast_node *n, bool when, vector<int> &jumps);
+        bool compile_chain(ast_node *n, bool branch, bool when, vector<int> &jumps);
+        void patch(const vector<int> &jumps, int target);
+        int add_cache();
+        int add_method_cache();
+        int add_call_cache();
+        int emit(int op, int arg = 0, int sub = 0);
+        int here() const { return (int)code->code.size(); };
+        int add_constant(const value &v);
+        int add_name(const string &name);
+        bool fail(const string &message);
+        bool compile_block(ast_node *block);
+        bool compile_statement(ast_node *n);
+        bool compile_expression(ast_node *n);
+        bool compile_store(ast_node *target);
+    public:
+        compiler() : code(NULL), depth(0), scope(NULL) { };
+        code_object* compile_module(ast_node *program);
+        const string& get_error() const { return error; };
+};
+
+// append an instruction, tracking the deepest the stack can get
+int compiler::emit(int op, int arg, int sub) {
+    instruction i;
+    i.op = (unsigned short)op;
+    i.sub = (unsigned short)sub;
+    i.arg = arg;
+    code->code.push_back(i);
+    depth += stack_effect(i);
+    if(depth > code->stack_size)
+        code->stack_size = depth;
+    return here() - 1;
+}
+
+int compiler::add_constant(const value &v) {
+    for(size_t i = 0; i < code->constants.size(); i++){
+        const value &c = code->constants[i];
+        if(c.tag() != v.tag())
+            continue;
+        if(v.is_int() && c.as_int() == v.as_int())
+            return (int)i;
+        // 0.0 and -0.0 are different constants
+        if(v.is_float()){
+            double x = c.as_float(), y = v.as_float();
+            if(memcmp(&x, &y, sizeof(double)) == 0)
+                return (int)i;
+        }
+        if(v.is(o_str) && c.is(o_str) && static_cast<py_str *>(c.as_object())->str() == static_cast<py_str *>(v.as_object())->str())
+            return (int)i;
+    }
+    code->constants.push_back(v);
+    return (int)code->constants.size() - 1;
+}
+
+int compiler::add_name(const string &name) {
+    istr s = intern(name);
+    for(size_t i = 0; i < code->names.size(); i++){
+        if(code->names[i] == s)
+            return (int)i;
+    }
+    code->names.push_back(s);
+    return (int)code->names.size() - 1;
+}
+
+bool compiler::fail(const string &message) {
+    if(error.empty())
+        error = message;
+    return false;
+}
+
+scope_info* compiler::new_scope(scope_info *parent, bool function) {
+    scope_info *s = new scope_info();
+    s->parent = parent;
+    s->function = function;
+    scopes.push_back(unique_ptr<scope_info>(s));
+    return s;
+}
+
+// Record the names each scope stores, uses and declares.
+bool compiler::analyze(ast_node *n, scope_info *s) {
+    switch(n->kind){
+    case n_name:
+        if(index_of(comp_bound, n->text) < 0)
+            add_unique(s->uses, n->text);
+        return true;
+    case n_list_comp:
+    case n_set_comp:
+    case n_dict_comp:
+        return analyze_comprehension(n, s);
+    case n_assign:
+        return analyze(n->kids[1], s) && analyze_store(n->kids[0], s);
+    case n_aug_assign:
+        return analyze(n->kids[1], s) && analyze(n->kids[0], s) && analyze_store(n->kids[0], s);
+    case n_for:
+        return analyze(n->kids[1], s) && analyze_store(n->kids[0], s) && analyze(n->kids[2], s);
+    case n_class:
+        // the body's names are class attributes, not variables of s
+        add_unique(s->stores, n->text);
+        if(n->kids.size() > 1 && !analyze(n->kids[1], s))
+            return false;
+        for(ast_node *k : n->kids[0]->kids){
+            bool ok;
+            if(k->kind == n_def || k->kind == n_async_def)
+                ok = analyze_function(k, s);
+            else if(k->kind == n_assign)
+                ok = analyze(k->kids[1], s);
+            else
+                ok = analyze(k, s);
+            if(!ok)
+                return false;
+        }
+        return true;
+    case n_def:
+    case n_async_def:
+        add_unique(s->stores, n->text);
+        return analyze_function(n, s);
+    case n_lambda:
+        return analyze_function(n, s);
+    case n_yield:
+    case n_yield_from:
+        if(!s->function)
+            return fail("'yield' outside function");
+        if(s->coroutine)
+            return fail(n->kind == n_yield ? "asynchronous generators are not supported" : "'yield from' inside async function");
+        s->generator = true;
+        return n->kids.empty() || analyze(n->kids[0], s);
+    case n_await:
+        if(!s->coroutine)
+            return fail(s->function ? "'await' outside async function" : "'await' outside function");
+        return analyze(n->kids[0], s);
+    case n_global:
+    case n_nonlocal:
+        for(ast_node *k : n->kids){
+            if(s->function && index_of(s->locals, k->text) >= 0)
+                return fail("name '" + k->text + "' is parameter and " + (n->kind == n_global ? "global" : "nonlocal"));
+            if(n->kind == n_nonlocal && !s->function)
+                return fail("nonlocal declaration not allowed at module level");
+            add_unique(n->kind == n_global ? s->globals : s->nonlocals, k->text);
+        }
+        return true;
+    case n_attribute:
+    case n_keyword:
+        return analyze(n->kids[0], s);
+    default:
+        for(ast_node *k : n->kids){
+            if(!analyze(k, s))
+                return false;
+        }
+        return true;
+    }
+}
+
+// A def or lambda gets a scope of its own, whose index is kept in its op.
+// The comprehension variables around it are remembered as hidden there.
+bool compiler::analyze_function(ast_node *n, scope_info *s) {
+    for(ast_node *p : n->kids[0]->kids){
+        if(!p->kids.empty() && !analyze(p->kids[0], s))
+            return false;
+    }
+    scope_info *inner = new_scope(s, true);
+    inner->coroutine = n->kind == n_async_def;
+    inner->hidden = comp_bound;
+    n->op = (int)scopes.size() - 1;
+    for(ast_node *p : n->kids[0]->kids)
+        inner->locals.push_back(p->text);
+    vector<string> outer_bound;
+    outer_bound.swap(comp_bound);
+    bool ok = analyze(n->kids[1], inner);
+    comp_bound.swap(outer_bound);
+    return ok;
+}
+
+void target_names(ast_node *target, vector<string> &names) {
+    if(target->kind == n_name)
+        names.push_back(target->text);
+    else if(target->kind == n_tuple || target->kind == n_list){
+        for(ast_node *k : target->kids)
+            target_names(k, names);
+    }
+}
+
+// The targets of a comprehension are bound only inside it, so they are
+// not variables of s; names are resolved the way they would be in the
+// function CPython makes of it. Each iterable sees only the targets of
+// the loops before it.
+bool compiler::analyze_comprehension(ast_node *n, scope_info *s) {
+    size_t outer = comp_bound.size();
+    for(size_t k = n->kind == n_dict_comp ? 2 : 1; k < n->kids.size(); k++){
+        ast_node *c = n->kids[k];
+        if(c->kind == n_comp_for){
+            if(!analyze(c->kids[1], s))
+                return false;
+            target_names(c->kids[0], comp_bound);
+            if(c->kids[0]->kind != n_name && c->kids[0]->kind != n_tuple && c->kids[0]->kind != n_list && !analyze(c->kids[0], s))
+                return false;
+        }else if(!analyze(c->kids[0], s)){
+            return false;
+        }
+    }
+    for(size_t k = 0; k < (n->kind == n_dict_comp ? 2u : 1u); k++){
+        if(!analyze(n->kids[k], s))
+            return false;
+    }
+    comp_bound.resize(outer);
+    return true;
+}
+
+bool compiler::analyze_store(ast_node *target, scope_info *s) {
+    if(target->kind == n_name){
+        add_unique(s->stores, target->text);
+        return true;
+    }
+    if(target->kind == n_tuple || target->kind == n_list){
+        for(ast_node *k : target->kids){
+            if(!analyze_store(k, s))
+                return false;
+        }
+        return true;
+    }
+    return analyze(target, s);
+}
+
+// Settle the locals of every function, then find where each name a
+// function uses without binding it is bound: in an enclosing function,
+// which makes it a cell there and free in the functions in between, or
+// else in the module.
+bool compiler::resolve_scopes() {
+    for(unique_ptr<scope_info> &s : scopes){
+        if(!s->function)
+            continue;
+        for(const string &name : s->stores){
+            if(index_of(s->globals, name) < 0 && index_of(s->nonlocals, name) < 0)
+                add_unique(s->locals, name);
+        }
+    }
+    for(unique_ptr<scope_info> &s : scopes){
+        if(!s->function)
+            continue;
+        vector<string> wanted = s->nonlocals;
+        for(const string &name : s->uses)
+            add_unique(wanted, name);
+        for(const string &name : wanted){
+            if(index_of(s->locals, name) >= 0 || index_of(s->globals, name) >= 0)
+                continue;
+            scope_info *owner = s.get();
+            do{
+                if(index_of(owner->hidden, name) >= 0)
+                    return fail("closures over comprehension variables are not supported");
+                owner = owner->parent;
+            }while(owner != NULL && owner->function && index_of(owner->locals, name) < 0 && index_of(owner->globals, name) < 0);
+            if(owner == NULL || !owner->function || index_of(owner->locals, name) < 0){
+                if(index_of(s->nonlocals, name) >= 0)
+                    return fail("no binding for nonlocal '" + name + "' found");
+                continue;
+            }
+            add_unique(owner->cells, name);
+            for(scope_info *t = s.get(); t != owner; t = t->parent)
+                add_unique(t->frees, name);
+        }
+    }
+    return true;
+}
+
+// load or store a name wherever the current scope keeps it
+void compiler::emit_name(const string &name, bool store) {
+    for(size_t k = comp_slots.size(); k-- > 0;){
+        if(comp_slots[k].first == name){
+            emit(store ? op_store_fast : op_load_fast, comp_slots[k].second);
+            return;
+        }
+    }
+    if(scope->function){
+        int i = index_of(scope->cells, name);
+        if(i < 0 && (i = index_of(scope->frees, name)) >= 0)
+            i += (int)scope->cells.size();
+        if(i >= 0){
+            emit(store ? op_store_deref : op_load_deref, i);
+            return;
+        }
+        i = index_of(scope->locals, name);
+        if(i >= 0 && index_of(scope->globals, name) < 0){
+            emit(store ? op_store_fast : op_load_fast, i);
+            return;
+        }
+    }
+    emit(store ? op_store_global : op_load_global, add_name(name));
+}
+
+// The compiler walks the syntax tree recursively, so a tree deeper than
+// this is refused up front. The parser bounds nesting, but not a long
+// chain of binary operators such as 1 + 1 + ... + 1.
+enum { max_tree_depth = 1000 };
+
+// how deep the tree under n goes, found without recursing
+size_t tree_depth(ast_node *n) {
+    vector<pair<ast_node *, size_t>> pending;
+    pending.push_back(make_pair(n, (size_t)1));
+    size_t deepest = 0;
+    while(!pending.empty()){
+        pair<ast_node *, size_t> p = pending.back();
+        pending.pop_back();
+        deepest = max(deepest, p.second);
+        for(ast_node *k : p.first->kids)
+            pending.push_back(make_pair(k, p.second + 1));
+    }
+    return deepest;
+}
+
+code_object* compiler::compile_module(ast_node *program) {
+    if(tree_depth(program) > max_tree_depth){
+        fail("maximum recursion depth exceeded during compilation");
+        return NULL;
+    }
+    scope = new_scope(NULL, false);
+    if(!analyze(program, scope) || !resolve_scopes())
+        return NULL;
+    unique_ptr<code_object> module(new code_object("<module>"));
+    code = module.get();
+    depth = 0;
+    if(!compile_block(program))
+        return NULL;
+    emit(op_load_const, add_constant(value::none()));
+    emit(op_return);
+    return module.release();
+}
+
+// Compile the body of a def or lambda into its own code object, then
+// emit code that builds the function: a tuple of its default values, if
+// it has any, then the cells it captures in the order of its free
+// variables, followed by the code.
+bool compiler::compile_function(ast_node *n) {
+    int defaults = 0;
+    for(ast_node *p : n->kids[0]->kids){
+        if(!p->kids.empty()){
+            if(!compile_expression(p->kids[0]))
+                return false;
+            defaults++;
+        }
+    }
+    if(defaults > 0)
+        emit(op_build_tuple, defaults);
+    scope_info *inner = scopes[n->op].get();
+    unique_ptr<code_object> body(new code_object(n->text));
+    body->argcount = (int)n->kids[0]->kids.size();
+    body->varnames = inner->locals;
+    body->cellnames = inner->cells;
+    body->freenames = inner->frees;
+    body->generator = inner->generator;
+    body->coroutine = inner->coroutine;
+    for(const string &name : inner->cells){
+        int i = index_of(inner->locals, name);
+        body->cell_args.push_back(i < body->argcount ? i : -1);
+    }
+    code_object *outer_code = code;
+    scope_info *outer_scope = scope;
+    int outer_depth = depth;
+    vector<pair<string,int>> outer_slots;
+    outer_slots.swap(comp_slots);
+    vector<loop_info> outer_loops;
+    outer_loops.swap(loops);
+    code = body.get();
+    scope = inner;
+    depth = 0;
+    bool ok;
+    if(n->kind == n_lambda){
+        ok = compile_expression(n->kids[1]);
+        emit(op_return);
+    }else{
+        ok = compile_block(n->kids[1]);
+        emit(op_load_const, add_constant(value::none()));
+        emit(op_return);
+    }
+    code = outer_code;
+    scope = outer_scope;
+    depth = outer_depth;
+    comp_slots.swap(outer_slots);
+    loops.swap(outer_loops);
+    if(!ok)
+        return false;
+    for(const string &name : inner->frees){
+        int i = index_of(scope->cells, name);
+        if(i < 0)
+            i = (int)scope->cells.size() + index_of(scope->frees, name);
+        emit(op_load_closure, i);
+    }
+    emit(op_load_const, add_constant(value(body.release())));
+    emit(op_make_function, (int)inner->frees.size(), defaults > 0);
+    return true;
+}
+
+bool compiler::compile_block(ast_node *block) {
+    for(ast_node *s : block->kids){
+        if(!compile_statement(s))
+            return false;
+    }
+    return true;
+}
+
+bool compiler::compile_statement(ast_node *n) {
+    switch(n->kind){
+    case n_expression:
+        if(!compile_expression(n->kids[0]))
+            return false;
+        emit(op_pop_top);
+        return true;
+    case n_assign: {
+        ast_node *target = n->kids[0], *v = n->kids[1];
+        bool sequence = target->kind == n_tuple || target->kind == n_list;
+        if(sequence && (v->kind == n_tuple || v->kind == n_list) && v->kids.size() == target->kids.size()){
+            // a, b = b, a: leave the values on the stack and move them
+            // straight into the targets without building a tuple
+            for(ast_node *k : v->kids){
+                if(!compile_expression(k))
+                    return false;
+            }
+            if(v->kids.size() > 1)
+                emit(op_reverse, (int)v->kids.size());
+            for(ast_node *k : target->kids){
+                if(!compile_store(k))
+                    return false;
+            }
+            return true;
+        }
+        return compile_expression(v) && compile_store(target);
+    }
+    case n_aug_assign:
+        return compile_augmented(n);
+    case n_for: {
+        // the loop keeps the iterable and the position in two stack slots
+        if(!compile_expression(n->kids[1]))
+            return false;
+        emit(op_get_iter);
+        int top = emit(op_for_iter);
+        loop_info loop = {top, true, vector<int>()};
+        loops.push_back(loop);
+        if(!compile_store(n->kids[0]) || !compile_block(n->kids[2]))
+            return false;
+        emit(op_jump, top);
+        code->code[top].arg = here();
+        depth -= 2;
+        vector<int> breaks = loops.back().breaks;
+        loops.pop_back();
+        if(n->kids.size() > 3 && !compile_block(n->kids[3]))
+            return false;
+        patch(breaks, here());
+        return true;
+    }
+    case n_if: {
+        vector<int> skip;
+        if(!compile_condition(n->kids[0], false, skip) || !compile_block(n->kids[1]))
+            return false;
+        if(n->kids.size() > 2){
+            int end = emit(op_jump);
+            patch(skip, here());
+            if(!compile_block(n->kids[2]))
+                return false;
+            code->code[end].arg = here();
+        }else{
+            patch(skip, here());
+        }
+        return true;
+    }
+    case n_while: {
+        loop_info loop = {here(), false, vector<int>()};
+        vector<int> exits;
+        if(!compile_condition(n->kids[0], false, exits))
+            return false;
+        loops.push_back(loop);
+        if(!compile_block(n->kids[1]))
+            return false;
+        emit(op_jump, loop.top);
+        patch(exits, here());
+        vector<int> breaks = loops.back().breaks;
+        loops.pop_back();
+        if(n->kids.size() > 2 && !compile_block(n->kids[2]))
+            return false;
+        patch(breaks, here());
+        return true;
+    }
+    case n_break:
+        if(loops.empty())
+            return fail("'break' outside loop");
+        if(loops.back().iterates){
+            // leave the loop's iterable and position behind
+            emit(op_pop_top);
+            emit(op_pop_top);
+            depth += 2;
+        }
+        loops.back().breaks.push_back(emit(op_jump));
+        return true;
+    case n_continue:
+        if(loops.empty())
+            return fail("'continue' not properly in loop");
+        emit(op_jump, loops.back().top);
+        return true;
+    case n_def:
+    case n_async_def:
+        if(!compile_function(n))
+            return false;
+        emit_name(n->text, true);
+        return true;
+    case n_return:
+        if(!scope->function)
+            return fail("'return' outside function");
+        if(n->kids.empty())
+            emit(op_load_const, add_constant(value::none()));
+        else if(!compile_expression(n->kids[0]))
+            return false;
+        emit(op_return);
+        return true;
+    case n_class:
+        return compile_class(n);
+    case n_del:
+        for(ast_node *k : n->kids){
+            if(!compile_expression(k->kids[0]) || !compile_expression(k->kids[1]))
+                return false;
+            emit(op_delete_subscript);
+        }
+        return true;
+    case n_global:
+    case n_nonlocal:
+    case n_pass:
+        return true;
+    default:
+        return fail("invalid statement");
+    }
+}
+
+// The class object is built first and its body's defs and assignments
+// are stored into it one by one; other statements are not supported in a
+// class body.
+bool compiler::compile_class(ast_node *n) {
+    if(n->kids.size() > 1){
+        if(!compile_expression(n->kids[1]))
+            return false;
+    }else{
+        emit(op_load_const, add_constant(value::none()));
+    }
+    emit(op_build_class, add_constant(make_str(n->text)));
+    for(ast_node *k : n->kids[0]->kids){
+        if(k->kind == n_def || k->kind == n_async_def){
+            if(!compile_function(k))
+                return false;
+            emit(op_store_class_attr, add_name(k->text));
+        }else if(k->kind == n_assign && k->kids[0]->kind == n_name){
+            if(!compile_expression(k->kids[1]))
+                return false;
+            emit(op_store_class_attr, add_name(k->kids[0]->text));
+        }else if(k->kind != n_pass){
+            return fail("only def and simple assignments are supported in a class body");
+        }
+    }
+    emit_name(n->text, true);
+    return true;
+}
+
+// A comprehension runs inline as nested for loops appending to the new
+// container, which stays on the stack below the loops. Its variables get
+// fast slots of their own at the end of varnames, so even at module level
+// they never touch the enclosing variables. A single loop with no
+// condition knows how many elements it makes and sizes the container
+// before it starts.
+bool compiler::compile_comprehension(ast_node *n) {
+    size_t first = n->kind == n_dict_comp ? 2 : 1;
+    emit(n->kind == n_list_comp ? op_build_list : n->kind == n_set_comp ? op_build_set : op_build_map, 0);
+    size_t outer_slots = comp_slots.size();
+    vector<int> tops;
+    bool sized = n->kids.size() == first + 1;
+    for(size_t k = first; k < n->kids.size(); k++){
+        ast_node *c = n->kids[k];
+        if(c->kind == n_comp_if){
+            if(!compile_expression(c->kids[0]))
+                return false;
+            emit(op_pop_jump_if_false, tops.back());
+            continue;
+        }
+        if(!compile_expression(c->kids[1]))
+            return false;
+        if(sized)
+            emit(op_reserve);
+        emit(op_get_iter);
+        tops.push_back(emit(op_for_iter));
+        vector<string> names;
+        target_names(c->kids[0], names);
+        for(const string &name : names){
+            comp_slots.push_back(make_pair(name, (int)code->varnames.size()));
+            code->varnames.push_back(name);
+        }
+        if(!compile_store(c->kids[0]))
+            return false;
+    }
+    for(size_t k = 0; k < first; k++){
+        if(!compile_expression(n->kids[k]))
+            return false;
+    }
+    int below = 2 * (int)tops.size() + 1;
+    emit(n->kind == n_list_comp ? op_list_append : n->kind == n_set_comp ? op_set_add : op_map_add, below);
+    for(size_t k = tops.size(); k-- > 0;){
+        emit(op_jump, tops[k]);
+        code->code[tops[k]].arg = here();
+        depth -= 2;
+    }
+    comp_slots.resize(outer_slots);
+    return true;
+}
+
+// x op= v. A fast local is updated in its slot by one instruction; other
+// targets load the old value, leaving the object and index they need
+// for the store below it, and store the result back.
+bool compiler::compile_augmented(ast_node *n) {
+    ast_node *target = n->kids[0];
+    if(target->kind == n_name){
+        int slot = -1;
+        if(scope->function && index_of(scope->cells, target->text) < 0 && index_of(scope->frees, target->text) < 0
+            && index_of(scope->globals, target->text) < 0)
+            slot = index_of(scope->locals, target->text);
+        if(slot >= 0){
+            if(!compile_expression(n->kids[1]))
+                return false;
+            emit(op_inplace_fast, slot, n->op);
+            return true;
+        }
+        emit_name(target->text, false);
+        if(!compile_expression(n->kids[1]))
+            return false;
+        emit(op_inplace, 0, n->op);
+        emit_name(target->text, true);
+        return true;
+    }
+    if(target->kind == n_attribute){
+        if(!compile_expression(target->kids[0]))
+            return false;
+        emit(op_copy, 1);
+        emit(op_load_attr, add_name(target->text), add_cache());
+        if(!compile_expression(n->kids[1]))
+            return false;
+        emit(op_inplace, 0, n->op);
+        emit(op_rotate, 2);
+        emit(op_store_attr, add_name(target->text), add_cache());
+        return true;
+    }
+    if(!compile_expression(target->kids[0]) || !compile_expression(target->kids[1]))
+        return false;
+    emit(op_copy, 2);
+    emit(op_load_subscript);
+    if(!compile_expression(n->kids[1]))
+        return false;
+    emit(op_inplace, 0, n->op);
+    emit(op_rotate, 3);
+    emit(op_store_subscript);
+    return true;
+}
+
+void compiler::patch(const vector<int> &jumps, int target) {
+    for(int j : jumps)
+        code->code[j].arg = target;
+}
+
+// Emit a test of n that jumps when its truth is when, adding the jumps to
+// be patched to jumps, and falls through otherwise. The test never makes
+// the bool it stands for: not swaps the sense, and and or chain their
+// parts' jumps; a comparison compares and branches in one instruction.
+bool compiler::compile_condition(ast_node *n, bool when, vector<int> &jumps) {
+    switch(n->kind){
+    case n_not:
+        return compile_condition(n->kids[0], !when, jumps);
+    case n_and:
+    case n_or: {
+        // the truth of a part that settles the whole: false for and
+        bool settles = n->kind == n_or;
+        if(settles == when){
+            for(ast_node *k : n->kids){
+                if(!compile_condition(k, when, jumps))
+                    return false;
+            }
+            return true;
+        }
+        // a part that settles it early makes the test fall through
+        vector<int> settled;
+        for(size_t k = 0; k + 1 < n->kids.size(); k++){
+            if(!compile_condition(n->kids[k], settles, settled))
+                return false;
+        }
+        if(!compile_condition(n->kids.back(), when, jumps))
+            return false;
+        patch(settled, here());
+        return true;
+    }
+    case n_compare:
+        if(!compile_expression(n->kids[0]) || !compile_expression(n->kids[1]))
+            return false;
+        jumps.push_back(emit(op_compare_jump, 0, n->op | (when ? 8 : 0)));
+        return true;
+    case n_chain:
+        return compile_chain(n, true, when, jumps);
+    case n_constant:
+        if(n->text == "True" || n->text == "False"){
+            if((n->text == "True") == when)
+                jumps.push_back(emit(op_jump));
+            return true;
+        }
+        break;
+    }
+    if(!compile_expression(n))
+        return false;
+    jumps.push_back(emit(when ? op_pop_jump_if_true : op_pop_jump_if_false));
+    return true;
+}
+
+// a < b < c: each middle operand is computed once and kept under the
+// comparison that uses it, for the next link. As a branch this jumps
+// like compile_condition; otherwise it leaves the result.
+bool compiler::compile_chain(ast_node *n, bool branch, bool when, vector<int> &jumps) {
+    if(!compile_expression(n->kids[0]))
+        return false;
+    vector<int> failed;
+    size_t last = n->kids.size() - 1;
+    for(size_t k = 1; k < last; k++){
+        if(!compile_expression(n->kids[k]->kids[0]))
+            return false;
+        emit(op_copy, 1);
+        emit(op_rotate, 3);
+        if(branch){
+            failed.push_back(emit(op_compare_jump, 0, n->kids[k]->op));
+        }else{
+            emit(op_compare, 0, n->kids[k]->op);
+            failed.push_back(emit(op_jump_if_false_or_pop));
+        }
+    }
+    if(!compile_expression(n->kids[last]->kids[0]))
+        return false;
+    if(branch)
+        jumps.push_back(emit(op_compare_jump, 0, n->kids[last]->op | (when ? 8 : 0)));
+    else
+        emit(op_compare, 0, n->kids[last]->op);
+    // a link that failed early left its right operand on the stack, under
+    // the false result when not branching
+    int end = emit(op_jump);
+    patch(failed, here());
+    depth += 1;
+    if(!branch)
+        emit(op_rotate, 2);
+    emit(op_pop_top);
+    if(branch && !when)
+        jumps.push_back(emit(op_jump));
+    code->code[end].arg = here();
+    return true;
+}
+
+int compiler::add_cache() {
+    if(code->caches.size() >= no_cache)
+        return no_cache;
+    attr_cache c = {0, 0, NULL};
+    code->caches.push_back(c);
+    return (int)code->caches.size() - 1;
+}
+
+int compiler::add_method_cache() {
+    if(code->method_caches.size() >= no_cache)
+        return no_cache;
+    method_cache c = {-1, 0, 0, NULL};
+    code->method_caches.push_back(c);
+    return (int)code->method_caches.size() - 1;
+}
+
+int compiler::add_call_cache() {
+    if(code->call_caches.size() >= no_cache)
+        return no_cache;
+    code->call_caches.emplace_back();
+    return (int)code->call_caches.size() - 1;
+}
+
+bool compiler::compile_store(ast_node *target) {
+    if(target->kind == n_name){
+        emit_name(target->text, true);
+        return true;
+    }
+    if(target->kind == n_tuple || target->kind == n_list){
+        emit(op_unpack_sequence, (int)target->kids.size());
+        for(ast_node *k : target->kids){
+            if(!compile_store(k))
+                return false;
+        }
+        return true;
+    }
+    if(target->kind == n_attribute){
+        if(!compile_expression(target->kids[0]))
+            return false;
+        emit(op_store_attr, add_name(target->text), add_cache());
+        return true;
+    }
+    if(target->kids[1]->kind == n_slice)
+        return fail("slice assignment is not supported");
+    if(!compile_expression(target->kids[0]) || !compile_expression(target->kids[1]))
+        return false;
+    emit(op_store_subscript);
+    return true;
+}
+
+bool compiler::compile_expression(ast_node *n) {
+    switch(n->kind){
+    case n_integer: {
+        const string &s = n->text;
+        bool hex = s.size() > 1 && (s[1] == 'x' || s[1] == 'X');
+        long long v;
+        bool overflow = false;
+        if(hex){
+            errno = 0;
+            v = strtoll(s.c_str(), NULL, 16);
+            overflow = errno == ERANGE;
+        }else{
+            text_ref t = {s.data(), s.size()};
+            parse_int(t, &v, &overflow);
+        }
+        if(overflow)
+            return fail("integer literal too large: " + s);
+        emit(op_load_const, add_constant(value::from_int(v)));
+        return true;
+    }
+    case n_float: {
+        text_ref t = {n->text.data(), n->text.size()};
+        double x;
+        parse_float(t, &x);
+        emit(op_load_const, add_constant(value::from_float(x)));
+        return true;
+    }
+    case n_string:
+        emit(op_load_const, add_constant(make_str(n->text)));
+        return true;
+    case n_constant:
+        if(n->text == "None")
+            emit(op_load_const, add_constant(value::none()));
+        else
+            emit(op_load_const, add_constant(value::from_bool(n->text == "True")));
+        return true;
+    case n_name:
+        emit_name(n->text, false);
+        return true;
+    case n_lambda:
+        return compile_function(n);
+    case n_yield:
+        if(n->kids.empty())
+            emit(op_load_const, add_constant(value::none()));
+        else if(!compile_expression(n->kids[0]))
+            return false;
+        emit(op_yield_value);
+        return true;
+    case n_yield_from:
+    case n_await:
+        // delegate to the iterator or awaitable, starting it with None
+        if(!compile_expression(n->kids[0]))
+            return false;
+        emit(n->kind == n_await ? op_get_awaitable : op_get_yield_from_iter);
+        emit(op_load_const, add_constant(value::none()));
+        emit(op_yield_from);
+        return true;
+    case n_list_comp:
+    case n_set_comp:
+    case n_dict_comp:
+        return compile_comprehension(n);
+    case n_dict:
+    case n_set:
+        for(ast_node *k : n->kids){
+            if(!compile_expression(k))
+                return false;
+        }
+        emit(n->kind == n_dict ? op_build_map : op_build_set, n->kind == n_dict ? (int)n->kids.size() / 2 : (int)n->kids.size());
+        return true;
+    case n_list:
+    case n_tuple:
+        for(ast_node *k : n->kids){
+            if(!compile_expression(k))
+                return false;
+        }
+        emit(n->kind == n_list ? op_build_list : op_build_tuple, (int)n->kids.size());
+        return true;
+    case n_call: {
+        // keyword arguments are passed as their values after the positional
+        // ones, followed by a constant tuple of their names
+        py_tuple *names = NULL;
+        value kwnames;
+        if(n->kids.back()->kind == n_keyword){
+            size_t count = 0;
+            for(ast_node *k : n->kids)
+                count += k->kind == n_keyword;
+            names = py_tuple::make(count);
+            kwnames = value(names);
+            count = 0;
+            for(ast_node *k : n->kids){
+                if(k->kind == n_keyword)
+                    names->items()[count++] = make_str(k->text);
+            }
+        }
+        // a call of an attribute looks it up as a method, so that calling
+        // it needs no bound method object
+        bool method = n->kids[0]->kind == n_attribute;
+        if(method){
+            if(!compile_expression(n->kids[0]->kids[0]))
+                return false;
+            emit(op_load_method, add_name(n->kids[0]->text), add_method_cache());
+        }
+        for(size_t j = method ? 1 : 0; j < n->kids.size(); j++){
+            ast_node *k = n->kids[j];
+            if(!compile_expression(k->kind == n_keyword ? k->kids[0] : k))
+                return false;
+        }
+        int argc = (int)n->kids.size() - 1;
+        if(names == NULL){
+            emit(method ? op_call_method : op_call, argc);
+        }else{
+            emit(op_load_const, add_constant(kwnames));
+            emit(method ? op_call_method_kw : op_call_kw, argc, add_call_cache());
+        }
+        return true;
+    }
+    case n_attribute:
+        if(!compile_expression(n->kids[0]))
+            return false;
+        emit(op_load_attr, add_name(n->text), add_cache());
+        return true;
+    case n_subscript:
+        if(n->kids[1]->kind == n_slice){
+            if(!compile_expression(n->kids[0]))
+                return false;
+            for(ast_node *k : n->kids[1]->kids){
+                if(!compile_expression(k))
+                    return false;
+            }
+            emit(op_load_slice);
+            return true;
+        }
+        if(!compile_expression(n->kids[0]) || !compile_expression(n->kids[1]))
+            return false;
+        emit(op_load_subscript);
+        return true;
+    case n_binary:
+    case n_compare:
+        if(!compile_expression(n->kids[0]) || !compile_expression(n->kids[1]))
+            return false;
+        emit(n->kind == n_binary ? op_binary : op_compare, 0, n->op);
+        return true;
+    case n_negate:
+        if(!compile_expression(n->kids[0]))
+            return false;
+        emit(op_negate);
+        return true;
+    case n_not:
+        if(!compile_expression(n->kids[0]))
+            return false;
+        emit(op_not);
+        return true;
+    case n_and:
+    case n_or: {
+        // the value of and/or is the part that settled it
+        vector<int> settled;
+        for(size_t k = 0; k < n->kids.size(); k++){
+            if(!compile_expression(n->kids[k]))
+                return false;
+            if(k + 1 < n->kids.size())
+                settled.push_back(emit(n->kind == n_and ? op_jump_if_false_or_pop : op_jump_if_true_or_pop));
+        }
+        patch(settled, here());
+        return true;
+    }
+    case n_chain: {
+        vector<int> none;
+        return compile_chain(n, false, false, none);
+    }
+    default:
+        return fail("invalid expression");
+    }
+}
+
+const char *binary_symbols[] = {"+", "-", "*", "/", "%", "//", "**", "<<", ">>", "&", "|", "^"};
+const char *compare_symbols[] = {"==", "!=", "<", "<=", ">", ">="};
+
+// bools take part in arithmetic as 0 and 1
+bool is_integer(const value &v) {
+    return v.is_int() || v.is_bool();
+}
+
+// a / b correctly rounded, like CPython's long_true_divide. Below 2**53
+// both convert exactly and one double division rounds once; above it the
+// quotient is taken in integers, with at least 64 bits and a sticky bit
+// for any remainder, so converting it rounds once as well.
+double true_divide(long long a, long long b) {
+    const long long exact = 1LL << 53;
+    if(a >= -exact && a <= exact && b >= -exact && b <= exact)
+        return (double)a / (double)b;
+    unsigned long long n = a < 0 ? 0 - (unsigned long long)a : a, d = b < 0 ? 0 - (unsigned long long)b : b;
+    if(n == 0)
+        return (a < 0) != (b < 0) ? -0.0 : 0.0;
+    int shift = 64 + __builtin_clzll(n);
+    unsigned __int128 scaled = (unsigned __int128)(n << (shift - 64)) << 64;
+    unsigned __int128 q = scaled / d;
+    if(scaled % d != 0)
+        q |= 1;
+    double r = ldexp((double)q, -shift);
+    return (a < 0) != (b < 0) ? -r : r;
+}
+
+// a Op b on ints; the switch folds away in each instantiation
+template <int Op>
+value int_arith(long long a, long long b) {
+    long long r = 0;
+    switch(Op){
+    case b_add:
+        if(__builtin_add_overflow(a, b, &r))
+            return raise_error("integer overflow");
+        break;
+    case b_sub:
+        if(__builtin_sub_overflow(a, b, &r))
+            return raise_error("integer overflow");
+        break;
+    case b_mul:
+        if(__builtin_mul_overflow(a, b, &r))
+            return raise_error("integer overflow");
+        break;
+    case b_div:
+        if(b == 0)
+            return raise_error("division by zero");
+        return value::from_float(true_divide(a, b));
+    case b_floordiv:
+    case b_mod:
+        if(b == 0)
+            return raise_error("integer division or modulo by zero");
+        if(a == LLONG_MIN && b == -1)
+            return Op == b_floordiv ? raise_error("integer overflow") : value::from_int(0);
+        // Python rounds the quotient down and gives the remainder the
+        // sign of the divisor
+        r = Op == b_floordiv ? a / b : a % b;
+        if(a % b != 0 && ((a < 0) != (b < 0)))
+            r = Op == b_floordiv ? r - 1 : r + b;
+        break;
+    case b_pow:
+        if(b < 0){
+            if(a == 0)
+                return raise_error("0.0 cannot be raised to a negative power");
+            return value::from_float(pow((double)a, (double)b));
+        }
+        // square and multiply; every square computed is used later
+        r = 1;
+        while(b > 0){
+            if((b & 1) && __builtin_mul_overflow(r, a, &r))
+                return raise_error("integer overflow");
+            b >>= 1;
+            if(b > 0 && __builtin_mul_overflow(a, a, &a))
+                return raise_error("integer overflow");
+        }
+        break;
+    case b_lshift:
+        if(b < 0)
+            return raise_error("negative shift count");
+        if(a != 0){
+            if(b >= 63)
+                return raise_error("integer overflow");
+            r = (long long)((unsigned long long)a << b);
+            if(r >> b != a)
+                return raise_error("integer overflow");
+        }
+        break;
+    case b_rshift:
+        if(b < 0)
+            return raise_error("negative shift count");
+        r = a >> (b > 63 ? 63 : b);
+        break;
+    case b_and:
+        r = a & b;
+        break;
+    case b_or:
+        r = a | b;
+        break;
+    case b_xor:
+        r = a ^ b;
+        break;
+    }
+    return value::from_int(r);
+}
+
+// a Op b on floats, with Python's rounding of // and sign of %
+template <int Op>
+value float_arith(double a, double b) {
+    switch(Op){
+    case b_add:
+        return value::from_float(a + b);
+    case b_sub:
+        return value::from_float(a - b);
+    case b_mul:
+        return value::from_float(a * b);
+    case b_div:
+        if(b == 0)
+            return raise_error("float division by zero");
+        return value::from_float(a / b);
+    case b_mod:
+    case b_floordiv: {
+        if(b == 0)
+            return raise_error(Op == b_mod ? "float modulo" : "float floor division by zero");
+        double mod = fmod(a, b);
+        double div = (a - mod) / b;
+        if(mod != 0){
+            if((b < 0) != (mod < 0)){
+                mod += b;
+                div -= 1.0;
+            }
+        }else{
+            mod = copysign(0.0, b);
+        }
+        if(Op == b_mod)
+            return value::from_float(mod);
+        if(div == 0)
+            return value::from_float(copysign(0.0, a / b));
+        double floored = floor(div);
+        if(div - floored > 0.5)
+            floored += 1.0;
+        return value::from_float(floored);
+    }
+    case b_pow: {
+        if(a == 0 && b < 0)
+            return raise_error("0.0 cannot be raised to a negative power");
+        if(a < 0 && b != floor(b) && std::isfinite(b))
+            return raise_error("negative number cannot be raised to a fractional power");
+        double r = pow(a, b);
+        if(std::isinf(r) && std::isfinite(a) && std::isfinite(b))
+            return raise_error("Numerical result out of range");
+        return value::from_float(r);
+    }
+    default:
+        return value();
+    }
+}
+
+inline bool is_number(const value &v) {
+    return is_integer(v) || v.is_float();
+}
+
+// an int, bool or float as a double
+inline double number_of(const value &v) {
+    return v.is_float() ? v.as_float() : (double)v.as_int();
+}
+
+// Order an int against a float exactly, like CPython's float_richcompare:
+// -1, 0 or 1, or 2 when x is a NaN. Converting i to a double is only
+// exact up to 2**53; beyond that x is compared in integers instead.
+inline int int_float_order(long long i, double x) {
+    if(x != x)
+        return 2;
+    const long long exact = 1LL << 53;
+    if(i >= -exact && i <= exact){
+        double y = (double)i;
+        return y < x ? -1 : y > x ? 1 : 0;
+    }
+    if(x >= 9223372036854775808.0)
+        return -1;
+    if(x < -9223372036854775808.0)
+        return 1;
+    double whole = floor(x);
+    long long w = (long long)whole;
+    if(i != w)
+        return i < w ? -1 : 1;
+    return whole < x ? -1 : 0;
+}
+
+// order two ints, bools or floats: -1, 0 or 1, or 2 when either is a NaN
+inline int number_order(const value &a, const value &b) {
+    if(a.is_float() && b.is_float()){
+        double x = a.as_float(), y = b.as_float();
+        return x < y ? -1 : x > y ? 1 : x == y ? 0 : 2;
+    }
+    if(b.is_float())
+        return int_float_order(a.as_int(), b.as_float());
+    if(a.is_float()){
+        int c = int_float_order(b.as_int(), a.as_float());
+        return c == 2 ? 2 : -c;
+    }
+    return a.as_int() < b.as_int() ? -1 : a.as_int() > b.as_int() ? 1 : 0;
+}
+
+// The float cases of + - * and / that cannot fail, which the interpreter
+// loop does inline; an int on one side is converted.
+inline bool float_fast(int op, const value &a, const value &b, double *r) {
+    bool fa = a.is_float(), fb = b.is_float();
+    if(!(fa || fb) || !(fa || a.is_int()) || !(fb || b.is_int()))
+        return false;
+    double x = fa ? a.as_float() : (double)a.as_int(), y = fb ? b.as_float() : (double)b.as_int();
+    switch(op){
+    case b_add:
+        *r = x + y;
+        return true;
+    case b_sub:
+        *r = x - y;
+        return true;
+    case b_mul:
+        *r = x * y;
+        return true;
+    case b_div:
+        if(y == 0)
+            return false;
+        *r = x / y;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// The int cases of an in-place operation that need no checks beyond
+// overflow; false sends the rest down the general path.
+inline bool int_inplace(int op, long long a, long long b, long long *r) {
+    switch(op){
+    case b_add:
+        return !__builtin_add_overflow(a, b, r);
+    case b_sub:
+        return !__builtin_sub_overflow(a, b, r);
+    case b_mul:
+        return !__builtin_mul_overflow(a, b, r);
+    case b_and:
+        *r = a & b;
+        return true;
+    case b_or:
+        *r = a | b;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// lists and tuples share element access for concatenation and comparison
+bool is_sequence(const value &v) {
+    return v.is(o_list) || v.is(o_tuple);
+}
+
+size_t sequence_length(const value &v) {
+    if(v.is(o_tuple))
+        return static_cast<py_tuple *>(v.as_object())->length;
+    return static_cast<py_list *>(v.as_object())->size();
+}
+
+value sequence_item(const value &v, size_t i) {
+    if(v.is(o_tuple))
+        return static_cast<py_tuple *>(v.as_object())->items()[i];
+    return static_cast<py_list *>(v.as_object())->get(i);
+}
+
+// the most elements a list or tuple can be asked for
+const size_t max_sequence_length = PTRDIFF_MAX / sizeof(value);
+
+// a list or tuple (like kind) of the elements of a followed by those of b,
+// repeated n times
+value concatenate(const value &kind, const value &a, const value &b, long long n) {
+    size_t la = a.is_null() ? 0 : sequence_length(a), lb = b.is_null() ? 0 : sequence_length(b);
+    size_t total;
+    if(__builtin_mul_overflow(la + lb, (size_t)n, &total) || total > max_sequence_length)
+        return raise_error("MemoryError");
+    if(kind.is(o_tuple)){
+        py_tuple *t = py_tuple::make(total);
+        value result(t);
+        size_t k = 0;
+        for(long long r = 0; r < n; r++){
+            for(size_t i = 0; i < la; i++)
+                t->items()[k++] = sequence_item(a, i);
+            for(size_t i = 0; i < lb; i++)
+                t->items()[k++] = sequence_item(b, i);
+        }
+        return result;
+    }
+    py_list *l = new py_list();
+    value result(l);
+    l->reserve(total);
+    for(long long r = 0; r < n; r++){
+        for(size_t i = 0; i < la; i++)
+            l->append(sequence_item(a, i));
+        for(size_t i = 0; i < lb; i++)
+            l->append(sequence_item(b, i));
+    }
+    return result;
+}
+
+// Repeat a sequence n times. Sizes that overflow raise like CPython's;
+// a size that fits can still be more memory than there is, which raises
+// MemoryError rather than ending the process.
+value repeat(const value &seq, long long n) {
+    if(n < 0)
+        n = 0;
+    try{
+        if(seq.is(o_str)){
+            text_ref s = str_text(seq);
+            size_t total;
+            if(__builtin_mul_overflow(s.size, (size_t)n, &total) || total > string().max_size())
+                return raise_error("OverflowError: repeated string is too long");
+            string r;
+            r.reserve(total);
+            for(long long i = 0; i < n; i++)
+                r.append(s.data, s.size);
+            return make_str(std::move(r));
+        }
+        return concatenate(seq, seq, value(), n);
+    }catch(const std::bad_alloc &){
+        return raise_error("MemoryError");
+    }
+}
+
+// The kinds of operand the operator tables tell apart. Bools count as
+// ints, and values of types with no operators of their own share k_other.
+typedef enum {k_int, k_float, k_str, k_list, k_tuple, k_other} operand_kind;
+enum { kind_count = k_other + 1 };
+
+inline int kind_of(const value &v) {
+    switch(v.tag()){
+    case value::v_int:
+    case value::v_bool:
+        return k_int;
+    case value::v_float:
+        return k_float;
+    case value::v_object:
+        switch(v.as_object()->type){
+        case o_str:
+            return k_str;
+        case o_list:
+            return k_list;
+        case o_tuple:
+            return k_tuple;
+        default:
+            return k_other;
+        }
+    default:
+        return k_other;
+    }
+}
+
+// the cell of an operator's table for the kinds of a and b
+inline int kind_pair(const value &a, const value &b) {
+    return kind_of(a) * kind_count + kind_of(b);
+}
+
+typedef value (*operator_handler)(const value &a, const value &b);
+
+// The rule of every pair an operator has no rule for. It leaves raising
+// the TypeError to the caller, which knows how the operator was spelt.
+struct unsupported_rule {
+    static value apply(const value &, const value &) { return value(); };
+};
+
+// arithmetic with a float on either side and an int or float on the other
+template <int Op>
+struct float_rule {
+    static value apply(const value &a, const value &b) { return float_arith<Op>(number_of(a), number_of(b)); };
+};
+
+// the operand kinds that mix in arithmetic: ints and floats
+template <int L, int R>
+struct mixed_numbers {
+    static const bool value = L <= k_float && R <= k_float && (L == k_float || R == k_float);
+};
+
+// binary_rule<Op, L, R>::apply works out a Op b for a left operand of
+// kind L and a right one of kind R. A new type gets an operand kind and
+// specialisations here; the tables and the interpreter loop pick them up.
+template <int Op, int L, int R>
+struct binary_rule : std::conditional<Op <= b_pow && mixed_numbers<L, R>::value, float_rule<Op>, unsupported_rule>::type { };
+
+template <int Op>
+struct binary_rule<Op, k_int, k_int> {
+    static value apply(const value &a, const value &b) { return int_arith<Op>(a.as_int(), b.as_int()); };
+};
+
+// & | ^ of two bools is a bool; with an int on either side it is an int
+template <int Op>
+struct bitwise_rule {
+    static value apply(const value &a, const value &b) {
+        if(a.is_bool() && b.is_bool())
+            return value::from_bool(int_arith<Op>(a.as_int(), b.as_int()).as_int() != 0);
+        return int_arith<Op>(a.as_int(), b.as_int());
+    };
+};
+
+template <> struct binary_rule<b_and, k_int, k_int> : bitwise_rule<b_and> { };
+template <> struct binary_rule<b_or, k_int, k_int> : bitwise_rule<b_or> { };
+template <> struct binary_rule<b_xor, k_int, k_int> : bitwise_rule<b_xor> { };
+
+template <>
+struct binary_rule<b_add, k_str, k_str> {
+    static value apply(const value &a, const value &b) {
+        text_ref x = str_text(a), y = str_text(b);
+        string r;
+        r.reserve(x.size + y.size);
+        r.append(x.data, x.size);
+        r.append(y.data, y.size);
+        return make_str(std::move(r));
+    };
+};
+
+struct concatenate_rule {
+    static value apply(const value &a, const value &b) { return concatenate(a, a, b, 1); };
+};
+
+struct repeat_left_rule {
+    static value apply(const value &a, const value &b) { return repeat(a, b.as_int()); };
+};
+
+struct repeat_right_rule {
+    static value apply(const value &a, const value &b) { return repeat(b, a.as_int()); };
+};
+
+template <> struct binary_rule<b_add, k_list, k_list> : concatenate_rule { };
+template <> struct binary_rule<b_add, k_tuple, k_tuple> : concatenate_rule { };
+template <> struct binary_rule<b_mul, k_str, k_int> : repeat_left_rule { };
+template <> struct binary_rule<b_mul, k_list, k_int> : repeat_left_rule { };
+template <> struct binary_rule<b_mul, k_tuple, k_int> : repeat_left_rule { };
+template <> struct binary_rule<b_mul, k_int, k_str> : repeat_right_rule { };
+template <> struct binary_rule<b_mul, k_int, k_list> : repeat_right_rule { };
+template <> struct binary_rule<b_mul, k_int, k_tuple> : repeat_right_rule { };
+
+// 0 .. N-1 as a parameter pack
+template <int... I> struct index_list { };
+template <int N, int... I> struct make_indices : make_indices<N - 1, N - 1, I...> { };
+template <int... I> struct make_indices<0, I...> { typedef index_list<I...> type; };
+typedef make_indices<kind_count * kind_count>::type kind_pairs;
+
+// An operator's table: the rule of every pair of kinds, generated from
+// the rule templates when the program is compiled.
+template <template <int, int, int> class Rule, int Op, class Pairs> struct operator_table;
+
+template <template <int, int, int> class Rule, int Op, int... I>
+struct operator_table<Rule, Op, index_list<I...>> {
+    static const operator_handler cells[kind_count * kind_count];
+};
+
+template <template <int, int, int> class Rule, int Op, int... I>
+const operator_handler operator_table<Rule, Op, index_list<I...>>::cells[kind_count * kind_count] = {
+    &Rule<Op, I / kind_count, I % kind_count>::apply...
+};
+
+// the tables of the binary operators, in the order of binary_op
+const operator_handler *const binary_table[] = {
+    operator_table<binary_rule, b_add, kind_pairs>::cells, operator_table<binary_rule, b_sub, kind_pairs>::cells,
+    operator_table<binary_rule, b_mul, kind_pairs>::cells, operator_table<binary_rule, b_div, kind_pairs>::cells,
+    operator_table<binary_rule, b_mod, kind_pairs>::cells, operator_table<binary_rule, b_floordiv, kind_pairs>::cells,
+    operator_table<binary_rule, b_pow, kind_pairs>::cells, operator_table<binary_rule, b_lshift, kind_pairs>::cells,
+    operator_table<binary_rule, b_rshift, kind_pairs>::cells, operator_table<binary_rule, b_and, kind_pairs>::cells,
+    operator_table<binary_rule, b_or, kind_pairs>::cells, operator_table<binary_rule, b_xor, kind_pairs>::cells
+};
+
+// a op b, or a op= b when inplace says so, through one call of the rule
+// for their kinds
+inline value binary_operation(int op, const value &a, const value &b, bool inplace = false) {
+    operator_handler rule = binary_table[op][kind_pair(a, b)];
+    value r = rule(a, b);
+    if(r.is_null() && rule == &unsupported_rule::apply)
+        return raise_error(string("unsupported operand type(s) for ") + binary_symbols[op] + (inplace ? "=" : "") + ": '" + type_name(a) + "' and '" + type_name(b) + "'");
+    return r;
+}
+
+value make_list(const value &iterable);
+
+// a op= b: a list is extended in place by any iterable, and a str that
+// nothing else refers to grows in place; the rest is a op b
+value inplace_operation(int op, const value &a, const value &b) {
+    if(op == b_add && a.is(o_list)){
+        value items = is_sequence(b) ? b : make_list(b);
+        if(items.is_null())
+            return value();
+        py_list *l = static_cast<py_list *>(a.as_object());
+        size_t n = sequence_length(items);
+        l->reserve(l->size() + n);
+        for(size_t i = 0; i < n; i++)
+            l->append(sequence_item(items, i));
+        return a;
+    }
+    if(op == b_add && a.is(o_str) && b.is(o_str) && static_cast<py_str *>(a.as_object())->append(str_text(b)))
+        return a;
+    return binary_operation(op, a, b, true);
+}
+
+int compare_equal(const value &a, const value &b);
+
+// a == b for two lists, tuples, dicts or sets of the same type, one
+// level of nesting deeper than the caller
+int equal_items(const value &a, const value &b) {
+    if(current->call_depth >= max_call_depth){
+        raise_error("maximum recursion depth exceeded in comparison");
+        return -1;
+    }
+    current->call_depth++;
+    int same = 1;
+    if(a.is(o_dict)){
+        py_dict *x = static_cast<py_dict *>(a.as_object()), *y = static_cast<py_dict *>(b.as_object());
+        same = x->items.size() == y->items.size();
+        for(auto &e : x->items){
+            if(same <= 0)
+                break;
+            value *v = y->items.find(e.first);
+            same = v == NULL ? 0 : compare_equal(*v, e.second);
+        }
+    }else if(a.is(o_set)){
+        py_set *x = static_cast<py_set *>(a.as_object()), *y = static_cast<py_set *>(b.as_object());
+        same = x->items.size() == y->items.size();
+        x->items.for_each([&](const value &k) { same = same && y->items.count(k) > 0; });
+    }else{
+        size_t n = sequence_length(a);
+        same = n == sequence_length(b);
+        for(size_t i = 0; i < n && same > 0; i++)
+            same = compare_equal(sequence_item(a, i), sequence_item(b, i));
+    }
+    current->call_depth--;
+    return same;
+}
+
+// 1 when a == b, 0 when not, and -1 when comparing them raised an error,
+// which only containers nested too deeply do. Like CPython, a container
+// is equal to itself without looking inside.
+int compare_equal(const value &a, const value &b) {
+    if(is_integer(a) && is_integer(b))
+        return a.as_int() == b.as_int();
+    if(is_number(a) && is_number(b))
+        return number_order(a, b) == 0;
+    if(a.tag() != b.tag())
+        return 0;
+    if(!a.is_object())
+        return a.is_none();
+    if(a.as_object() == b.as_object())
+        return 1;
+    if(a.is(o_str) && b.is(o_str))
+        return equal_text(str_text(a), str_text(b));
+    int type = a.as_object()->type;
+    if(b.is(type) && (is_sequence(a) || type == o_dict || type == o_set))
+        return equal_items(a, b);
+    return 0;
+}
+
+// equality for dict keys and set members, which are hashable and so
+// cannot contain themselves
+bool values_equal(const value &a, const value &b) {
+    return compare_equal(a, b) > 0;
+}
+
+// hash(v) for a dict key or set member: values that compare equal hash
+// alike, and objects that are only equal to themselves hash by identity
+size_t hash_value(const value &v) {
+    if(is_integer(v))
+        return std::hash<long long>()(v.as_int());
+    if(v.is_float()){
+        // a float equal to an int hashes like it; every integral float
+        // in the long long range equals exactly one
+        double x = v.as_float();
+        if(x == floor(x) && x >= -9223372036854775808.0 && x < 9223372036854775808.0)
+            return std::hash<long long>()((long long)x);
+        return std::hash<double>()(x);
+    }
+    if(v.is_none())
+        return 0x2545F491;
+    if(v.is(o_str)){
+        text_ref t = str_text(v);
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for(size_t i = 0; i < t.size; i++)
+            h = (h ^ (unsigned char)t.data[i]) * 0x100000001b3ULL;
+        return (size_t)h;
+    }
+    if(v.is(o_tuple)){
+        py_tuple *t = static_cast<py_tuple *>(v.as_object());
+        size_t h = 0x345678;
+        for(size_t i = 0; i < t->length; i++)
+            h = (h ^ hash_value(t->items()[i])) * 1000003;
+        return h;
+    }
+    return std::hash<const void *>()(v.as_object());
+}
+
+// Fail unless v can be a dict key or set member. Keys nest no deeper
+// than max_call_depth, so hashing and comparing them stays off the
+// bottom of the C++ stack.
+bool check_hashable(const value &v) {
+    if(v.is(o_list) || v.is(o_dict) || v.is(o_set)){
+        raise_error("unhashable type: '" + type_name(v) + "'");
+        return false;
+    }
+    if(v.is(o_tuple)){
+        if(current->call_depth >= max_call_depth){
+            raise_error("maximum recursion depth exceeded while hashing");
+            return false;
+        }
+        current->call_depth++;
+        py_tuple *t = static_cast<py_tuple *>(v.as_object());
+        bool ok = true;
+        for(size_t i = 0; i < t->length && ok; i++)
+            ok = check_hashable(t->items()[i]);
+        current->call_depth--;
+        return ok;
+    }
+    return true;
+}
+
+// Order two values: -1, 0 or 1, or -2 when they cannot be ordered. -3
+// means comparing them raised an error: sequences nested too deeply.
+int compare_values(const value &a, const value &b) {
+    if(is_integer(a) && is_integer(b))
+        return a.as_int() < b.as_int() ? -1 : a.as_int() > b.as_int() ? 1 : 0;
+    if(is_number(a) && is_number(b)){
+        // a NaN is neither less nor greater, as with the < of sort
+        int c = number_order(a, b);
+        return c == 2 ? 0 : c;
+    }
+    if(a.is(o_str) && b.is(o_str))
+        return compare_text(str_text(a), str_text(b));
+    if(is_sequence(a) && b.is(a.as_object()->type)){
+        if(a.as_object() == b.as_object())
+            return 0;
+        if(current->call_depth >= max_call_depth){
+            raise_error("maximum recursion depth exceeded in comparison");
+            return -3;
+        }
+        current->call_depth++;
+        size_t x = sequence_length(a), y = sequence_length(b);
+        int c = x < y ? -1 : x > y ? 1 : 0;
+        for(size_t i = 0; i < x && i < y; i++){
+            value p = sequence_item(a, i), q = sequence_item(b, i);
+            int same = compare_equal(p, q);
+            if(same != 1){
+                c = same < 0 ? -3 : compare_values(p, q);
+                break;
+            }
+        }
+        current->call_depth--;
+        return c;
+    }
+    return -2;
+}
+
+value unorderable(int op, const value &a, const value &b) {
+    return raise_error(string("'") + compare_symbols[op] + "' not supported between instances of '" + type_name(a) + "' and '" + type_name(b) + "'");
+}
+
+// x Op y for anything with the built-in comparison operators
+template <int Op, class T>
+inline bool compare_as(const T &x, const T &y) {
+    switch(Op){
+    case c_eq:
+        return x == y;
+    case c_ne:
+        return x != y;
+    case c_lt:
+        return x < y;
+    case c_le:
+        return x <= y;
+    case c_gt:
+        return x > y;
+    default:
+        return x >= y;
+    }
+}
+
+template <int Op>
+struct equality_rule {
+    static value apply(const value &a, const value &b) {
+        int same = compare_equal(a, b);
+        return same < 0 ? value() : value::from_bool((same == 1) == (Op == c_eq));
+    };
+};
+
+// a float against a float or an int; only != holds for a NaN
+template <int Op>
+struct float_compare_rule {
+    static value apply(const value &a, const value &b) {
+        if(a.is_float() && b.is_float())
+            return value::from_bool(compare_as<Op>(a.as_float(), b.as_float()));
+        int c = number_order(a, b);
+        return value::from_bool(c == 2 ? Op == c_ne : compare_as<Op>(c, 0));
+    };
+};
+
+// compare_rule<Op, L, R> is the binary_rule of the comparisons. Any two
+// values can be tested for equality; only numbers and the pairs
+// specialised here can be ordered.
+template <int Op, int L, int R>
+struct compare_rule : std::conditional<mixed_numbers<L, R>::value, float_compare_rule<Op>,
+    typename std::conditional<Op == c_eq || Op == c_ne, equality_rule<Op>, unsupported_rule>::type>::type { };
+
+template <int Op>
+struct compare_rule<Op, k_int, k_int> {
+    static value apply(const value &a, const value &b) { return value::from_bool(compare_as<Op>(a.as_int(), b.as_int())); };
+};
+
+template <int Op>
+struct compare_rule<Op, k_str, k_str> {
+    static value apply(const value &a, const value &b) {
+        if(Op == c_eq || Op == c_ne)
+            return value::from_bool(equal_text(str_text(a), str_text(b)) == (Op == c_eq));
+        return value::from_bool(compare_as<Op>(compare_text(str_text(a), str_text(b)), 0));
+    };
+};
+
+// lists and tuples compare element by element
+template <int Op>
+struct sequence_compare_rule {
+    static value apply(const value &a, const value &b) {
+        if(Op == c_eq || Op == c_ne)
+            return equality_rule<Op>::apply(a, b);
+        int c = compare_values(a, b);
+        if(c == -3)
+            return value();
+        if(c == -2)
+            return unorderable(Op, a, b);
+        return value::from_bool(compare_as<Op>(c, 0));
+    };
+};
+
+template <int Op> struct compare_rule<Op, k_list, k_list> : sequence_compare_rule<Op> { };
+template <int Op> struct compare_rule<Op, k_tuple, k_tuple> : sequence_compare_rule<Op> { };
+
+// the tables of the comparisons, in the order of compare_op
+const operator_handler *const comparison_table[] = {
+    operator_table<compare_rule, c_eq, kind_pairs>::cells, operator_table<compare_rule, c_ne, kind_pairs>::cells,
+    operator_table<compare_rule, c_lt, kind_pairs>::cells, operator_table<compare_rule, c_le, kind_pairs>::cells,
+    operator_table<compare_rule, c_gt, kind_pairs>::cells, operator_table<compare_rule, c_ge, kind_pairs>::cells
+};
+
+template <class T>
+inline bool compare_numbers(int op, T a, T b) {
+    switch(op){
+    case c_eq:
+        return a == b;
+    case c_ne:
+        return a != b;
+    case c_lt:
+        return a < b;
+    case c_le:
+        return a <= b;
+    case c_gt:
+        return a > b;
+    default:
+        return a >= b;
+    }
+}
+
+bool is_iterator(const value &v);
+value next_value(const value &it, const value &sent, bool *done);
+
+// is x an element of range r? Only numbers can be, and a float only when
+// it is integral, so this is arithmetic rather than a scan
+bool range_contains(const py_range *r, const value &x) {
+    long long k;
+    if(is_integer(x))
+        k = x.as_int();
+    else if(x.is_float() && x.as_float() == floor(x.as_float()) && fabs(x.as_float()) < 9.2233720368547758e18)
+        k = (long long)x.as_float();
+    else
+        return false;
+    if(r->step > 0 ? k < r->start || k >= r->stop : k > r->start || k <= r->stop)
+        return false;
+    if(r->step > 0)
+        return ((unsigned long long)k - r->start) % r->step == 0;
+    return ((unsigned long long)r->start - k) % (0 - (unsigned long long)r->step) == 0;
+}
+
+// item in container: 1 or 0, or -1 when it raised an error
+int contains(const value &container, const value &item) {
+    if(container.is(o_dict) || container.is(o_set)){
+        if(!check_hashable(item))
+            return -1;
+        if(container.is(o_dict))
+            return static_cast<py_dict *>(container.as_object())->items.count(item) > 0;
+        return static_cast<py_set *>(container.as_object())->items.count(item) > 0;
+    }
+    if(container.is(o_str)){
+        if(!item.is(o_str)){
+            raise_error("'in <string>' requires string as left operand, not " + type_name(item));
+            return -1;
+        }
+        text_ref s = str_text(container), sub = str_text(item);
+        return text_find(s.data, s.size, sub.data, sub.size, 0) != string::npos;
+    }
+    if(container.is(o_range))
+        return range_contains(static_cast<py_range *>(container.as_object()), item);
+    if(container.is(o_list) && item.is_int() && static_cast<py_list *>(container.as_object())->storage() == py_list::l_int){
+        py_list *l = static_cast<py_list *>(container.as_object());
+        const long long *p = l->int_items();
+        return std::find(p, p + l->size(), item.as_int()) != p + l->size();
+    }
+    if(is_sequence(container)){
+        // the list may change under a comparison, so its length is re-read
+        for(size_t i = 0; i < sequence_length(container); i++){
+            int same = compare_equal(sequence_item(container, i), item);
+            if(same != 0)
+                return same;
+        }
+        return 0;
+    }
+    if(is_iterator(container)){
+        while(true){
+            bool done;
+            value v = next_value(container, value::none(), &done);
+            if(v.is_null())
+                return -1;
+            if(done)
+                return 0;
+            int same = compare_equal(v, item);
+            if(same != 0)
+                return same;
+        }
+    }
+    raise_error("argument of type '" + type_name(container) + "' is not iterable");
+    return -1;
+}
+
+inline value compare_operation(int op, const value &a, const value &b) {
+    if(op >= c_in){
+        int found = contains(b, a);
+        return found < 0 ? value() : value::from_bool((found == 1) == (op == c_in));
+    }
+    operator_handler rule = comparison_table[op][kind_pair(a, b)];
+    value r = rule(a, b);
+    if(r.is_null() && rule == &unsupported_rule::apply)
+        return unorderable(op, a, b);
+    return r;
+}
+
+// resolve a possibly negative index against a sequence of length n
+bool sequence_index(const value &index, size_t n, size_t *i) {
+    if(!is_integer(index)){
+        raise_error("indices must be integers, not " + type_name(index));
+        return false;
+    }
+    long long k = index.as_int();
+    if(k < 0)
+        k += (long long)n;
+    if(k < 0 || k >= (long long)n){
+        raise_error("index out of range");
+        return false;
+    }
+    *i = (size_t)k;
+    return true;
+}
+
+value load_subscript(const value &container, const value &index) {
+    size_t i;
+    if(container.is(o_list)){
+        py_list *l = static_cast<py_list *>(container.as_object());
+        if(!sequence_index(index, l->size(), &i))
+            return value();
+        return l->get(i);
+    }
+    if(container.is(o_tuple)){
+        py_tuple *t = static_cast<py_tuple *>(container.as_object());
+        if(!sequence_index(index, t->length, &i))
+            return value();
+        return t->items()[i];
+    }
+    if(container.is(o_str)){
+        text_ref s = str_text(container);
+        if(!sequence_index(index, s.size, &i))
+            return value();
+        return make_str(string(1, s.data[i]));
+    }
+    if(container.is(o_range)){
+        py_range *r = static_cast<py_range *>(container.as_object());
+        if(!sequence_index(index, (size_t)r->length, &i))
+            return value();
+        return value::from_int(r->at((long long)i));
+    }
+    if(container.is(o_dict)){
+        if(!check_hashable(index))
+            return value();
+        value *v = static_cast<py_dict *>(container.as_object())->items.find(index);
+        if(v == NULL)
+            return raise_error("KeyError: " + repr(index));
+        return *v;
+    }
+    return raise_error("'" + type_name(container) + "' object is not subscriptable");
+}
+
+// Resolve slice bounds against a sequence of length n the way Python does:
+// the first index, the clamped stop index, the step and the number of
+// elements selected.
+bool slice_indices(const value &start, const value &stop, const value &step, long long n, long long *first, long long *end, long long *by, long long *count) {
+    const value *parts[3] = {&start, &stop, &step};
+    for(const value *p : parts){
+        if(!p->is_none() && !is_integer(*p)){
+            raise_error("slice indices must be integers or None");
+            return false;
+        }
+    }
+    long long s = step.is_none() ? 1 : step.as_int();
+    if(s == 0 || s == LLONG_MIN){
+        raise_error(s == 0 ? "slice step cannot be zero" : "slice step out of range");
+        return false;
+    }
+    long long bounds[2];
+    for(int k = 0; k < 2; k++){
+        const value &v = *parts[k];
+        if(v.is_none()){
+            if(k == 0)
+                bounds[k] = s > 0 ? 0 : n - 1;
+            else
+                bounds[k] = s > 0 ? n : -1;
+            continue;
+        }
+        long long b = v.as_int();
+        if(b < 0){
+            b += n;
+            if(b < 0)
+                b = s > 0 ? 0 : -1;
+        }else if(b >= n){
+            b = s > 0 ? n : n - 1;
+        }
+        bounds[k] = b;
+    }
+    *first = bounds[0];
+    *end = bounds[1];
+    *by = s;
+    if(s > 0)
+        *count = bounds[1] > bounds[0] ? (bounds[1] - bounds[0] - 1) / s + 1 : 0;
+    else
+        *count = bounds[0] > bounds[1] ? (bounds[0] - bounds[1] - 1) / -s + 1 : 0;
+    return true;
+}
+
+// container[start:stop:step]. Contiguous slices of a str share its text
+// (see str_slice).
+value load_slice(const value &container, const value &start, const value &stop, const value &step) {
+    long long n, first, end, by, count;
+    if(container.is(o_str))
+        n = (long long)static_cast<py_str *>(container.as_object())->size();
+    else if(is_sequence(container))
+        n = (long long)sequence_length(container);
+    else if(container.is(o_range))
+        n = static_cast<py_range *>(container.as_object())->length;
+    else
+        return raise_error("'" + type_name(container) + "' object is not subscriptable");
+    if(!slice_indices(start, stop, step, n, &first, &end, &by, &count))
+        return value();
+    if(container.is(o_str)){
+        if(by == 1)
+            return str_slice(container, (size_t)first, (size_t)count);
+        text_ref s = str_text(container);
+        string r;
+        r.resize((size_t)count);
+        for(long long i = 0; i < count; i++)
+            r[i] = s.data[first + i * by];
+        return make_str(std::move(r));
+    }
+    if(container.is(o_range)){
+        // Every element is a long long, but the stop one step past the
+        // slice may not be. It is saturated then, which only shows in
+        // repr(): the length is count either way.
+        py_range *r = static_cast<py_range *>(container.as_object());
+        long long step, bounds[2] = {first, end};
+        if(__builtin_mul_overflow(r->step, by, &step))
+            return raise_error("OverflowError: range slice step too large");
+        for(long long &b : bounds){
+            long long offset, at;
+            if(__builtin_mul_overflow(b, r->step, &offset) || __builtin_add_overflow(r->start, offset, &at))
+                at = (b < 0) != (r->step < 0) ? LLONG_MIN : LLONG_MAX;
+            b = at;
+        }
+        return value(new py_range(bounds[0], bounds[1], step, count));
+    }
+    if(container.is(o_tuple)){
+        py_tuple *t = py_tuple::make((size_t)count);
+        value result(t);
+        for(long long i = 0; i < count; i++)
+            t->items()[i] = sequence_item(container, (size_t)(first + i * by));
+        return result;
+    }
+    py_list *source = static_cast<py_list *>(container.as_object());
+    py_list *l = new py_list();
+    value result(l);
+    l->reserve((size_t)count);
+    for(long long i = 0; i < count; i++)
+        l->append(source->get((size_t)(first + i * by)));
+    return result;
+}
+
+bool store_subscript(const value &container, const value &index, const value &v) {
+    size_t i;
+    if(container.is(o_dict)){
+        if(!check_hashable(index))
+            return false;
+        static_cast<py_dict *>(container.as_object())->items[index] = v;
+        return true;
+    }
+    if(!container.is(o_list)){
+        raise_error("'" + type_name(container) + "' object does not support item assignment");
+        return false;
+    }
+    py_list *l = static_cast<py_list *>(container.as_object());
+    if(!sequence_index(index, l->size(), &i))
+        return false;
+    l->set(i, v);
+    return true;
+}
+
+// del container[index]
+bool delete_subscript(const value &container, const value &index) {
+    size_t i;
+    if(container.is(o_dict)){
+        if(!check_hashable(index))
+            return false;
+        if(static_cast<py_dict *>(container.as_object())->items.erase(index) == 0){
+            raise_error("KeyError: " + repr(index));
+            return false;
+        }
+        return true;
+    }
+    if(!container.is(o_list)){
+        raise_error("'" + type_name(container) + "' object doesn't support item deletion");
+        return false;
+    }
+    py_list *l = static_cast<py_list *>(container.as_object());
+    if(!sequence_index(index, l->size(), &i))
+        return false;
+    l->pop(i);
+    return true;
+}
+
+// the native method called name of a built-in object, if it has one
+value* native_method(const value &object, istr name) {
+    if(object.is(o_list))
+        return current->list_methods.find(name);
+    if(object.is(o_str))
+        return current->str_methods.find(name);
+    if(object.is(o_generator))
+        return current->generator_methods.find(name);
+    if(object.is(o_dict))
+        return current->dict_methods.find(name);
+    if(object.is(o_set))
+        return current->set_methods.find(name);
+    return NULL;
+}
+
+// Look up an attribute: on an instance its own attributes come first,
+// then those of its class, where functions are bound to the instance; on
+// other objects only native methods exist. Each method lookup binds a new
+// method object to the receiver.
+value load_attribute(const value &object, istr name) {
+    if(object.is(o_instance)){
+        py_instance *o = static_cast<py_instance *>(object.as_object());
+        value *v = o->find(name);
+        if(v != NULL)
+            return *v;
+        v = static_cast<py_class *>(o->cls.as_object())->lookup(name);
+        if(v == NULL)
+            return raise_error("'" + type_name(object) + "' object has no attribute '" + name.str() + "'");
+        if(v->is(o_function))
+            return value(new py_method(*v, object));
+        return *v;
+    }
+    if(object.is(o_class)){
+        value *v = static_cast<py_class *>(object.as_object())->lookup(name);
+        if(v == NULL)
+            return raise_error("type object '" + static_cast<py_class *>(object.as_object())->name + "' has no attribute '" + name.str() + "'");
+        return *v;
+    }
+    value *f = native_method(object, name);
+    if(f == NULL)
+        return raise_error("'" + type_name(object) + "' object has no attribute '" + name.str() + "'");
+    return value(new py_bound_method(*f, object));
+}
+
+// Look up name on object to call it. A method is returned unbound, with
+// unbound set, so the caller can pass object as its first argument without
+// making a method object; anything else comes back as from load_attribute.
+value load_method(const value &object, istr name, bool &unbound) {
+    unbound = false;
+    if(object.is(o_instance)){
+        py_instance *o = static_cast<py_instance *>(object.as_object());
+        if(o->find(name) == NULL){
+            value *v = static_cast<py_class *>(o->cls.as_object())->lookup(name);
+            if(v != NULL && v->is(o_function)){
+                unbound = true;
+                return *v;
+            }
+        }
+    }else{
+        value *f = native_method(object, name);
+        if(f != NULL){
+            unbound = true;
+            return *f;
+        }
+    }
+    return load_attribute(object, name);
+}
+
+bool store_attribute(const value &object, istr name, const value &v) {
+    if(object.is(o_instance)){
+        static_cast<py_instance *>(object.as_object())->set(name, v);
+        return true;
+    }
+    if(object.is(o_class)){
+        static_cast<py_class *>(object.as_object())->set_attribute(name, v);
+        return true;
+    }
+    raise_error("'" + type_name(object) + "' object has no attribute '" + name.str() + "'");
+    return false;
+}
+
+value awaitable(const value &v);
+value make_list(const value &iterable);
+
+// the most elements op_reserve sizes a container for in advance
+enum { max_reserve = 1 << 20 };
+
+// how many elements iterating v gives, or -1 when that is not known
+long long known_length(const value &v) {
+    if(is_sequence(v))
+        return (long long)sequence_length(v);
+    if(v.is(o_range))
+        return static_cast<py_range *>(v.as_object())->length;
+    if(v.is(o_dict))
+        return (long long)static_cast<py_dict *>(v.as_object())->items.size();
+    if(v.is(o_set))
+        return (long long)static_cast<py_set *>(v.as_object())->items.size();
+    return -1;
+}
+
+// Execute a code object. frame holds its fast locals and cells followed by
+// room for its value stack (see code_object); names that are not local go
+// to the module globals. Returns the value returned, or a null value after
+// a runtime error, whose message is in current->error_message.
+//
+// A for loop keeps its iterable and the position reached in two stack
+// slots, so iterating needs no iterator object. op_for_iter rewrites
+// itself into a variant specialised for the type it finds: the range and
+// list variants compute the next element straight from the position, and
+// fall back to the generic instruction if a later run of the same loop
+// sees a different type. Generators and iterators are stepped instead.
+//
+// The frame of a generator or coroutine is its gen's, and running it
+// carries on from where gen stopped. Yielding saves the position in gen
+// and returns the value yielded; gen->finished tells a return from it.
+value run_frame(code_object *code, value *frame, py_generator *gen) {
+    value *fast = frame;
+    value *cells = frame + code->varnames.size();
+    instruction *base = code->code.data();
+    value *sp = gen != NULL ? frame + gen->sp : cells + code->cellnames.size() + code->freenames.size();
+    instruction *ip = base + (gen != NULL ? gen->ip : 0);
+    while(true){
+        instruction *i = ip++;
+        switch(i->op){
+        case op_load_const:
+            *sp++ = code->constants[i->arg];
+            break;
+        case op_load_global: {
+            value *v = current->var_table.find(code->names[i->arg]);
+            if(v == NULL)
+                v = current->builtin_table.find(code->names[i->arg]);
+            if(v == NULL){
+                raise_error("name '" + code->names[i->arg].str() + "' is not defined");
+                return value();
+            }
+            *sp++ = *v;
+            break;
+        }
+        case op_store_global:
+            current->var_table[code->names[i->arg]] = std::move(*--sp);
+            break;
+        case op_load_fast:
+            if(fast[i->arg].is_null()){
+                raise_error("local variable '" + code->varnames[i->arg] + "' referenced before assignment");
+                return value();
+            }
+            *sp++ = fast[i->arg];
+            break;
+        case op_store_fast:
+            fast[i->arg] = std::move(*--sp);
+            break;
+        case op_load_deref: {
+            const value &v = static_cast<py_cell *>(cells[i->arg].as_object())->contents;
+            if(v.is_null()){
+                size_t n = code->cellnames.size();
+                const string &name = (size_t)i->arg < n ? code->cellnames[i->arg] : code->freenames[i->arg - n];
+                raise_error("free variable '" + name + "' referenced before assignment in enclosing scope");
+                return value();
+            }
+            *sp++ = v;
+            break;
+        }
+        case op_store_deref:
+            static_cast<py_cell *>(cells[i->arg].as_object())->contents = std::move(*--sp);
+            break;
+        case op_load_closure:
+            *sp++ = cells[i->arg];
+            break;
+        case op_make_function: {
+            code_object *c = static_cast<code_object *>(sp[-1].as_object());
+            py_function *f = new py_function(sp[-1], c->name);
+            value v(f);
+            value *captured = sp - 1 - i->arg;
+            f->closure.assign(make_move_iterator(captured), make_move_iterator(sp - 1));
+            sp[-1] = value();
+            sp = captured;
+            if(i->sub)
+                f->defaults = std::move(*--sp);
+            *sp++ = std::move(v);
+            break;
+        }
+        case op_pop_top:
+            *--sp = value();
+            break;
+        case op_binary:
+        case op_compare: {
+            double x;
+            if(i->op == op_binary && float_fast(i->sub, sp[-2], sp[-1], &x)){
+                --sp;
+                sp[-1] = value::from_float(x);
+                break;
+            }
+            value r = i->op == op_binary ? binary_operation(i->sub, sp[-2], sp[-1]) : compare_operation(i->sub, sp[-2], sp[-1]);
+            if(r.is_null())
+                return value();
+            *--sp = value();
+            sp[-1] = std::move(r);
+            break;
+        }
+        case op_inplace: {
+            double x;
+            if(float_fast(i->sub, sp[-2], sp[-1], &x)){
+                --sp;
+                sp[-1] = value::from_float(x);
+                break;
+            }
+            value r = inplace_operation(i->sub, sp[-2], sp[-1]);
+            if(r.is_null())
+                return value();
+            *--sp = value();
+            sp[-1] = std::move(r);
+            break;
+        }
+        case op_inplace_fast: {
+            // fast[arg] op= the value on top, updating the slot itself
+            value &target = fast[i->arg];
+            long long r;
+            double x;
+            if(target.is_int() && sp[-1].is_int() && int_inplace(i->sub, target.as_int(), sp[-1].as_int(), &r)){
+                target = value::from_int(r);
+                --sp;
+                break;
+            }
+            if(float_fast(i->sub, target, sp[-1], &x)){
+                target = value::from_float(x);
+                --sp;
+                break;
+            }
+            if(target.is_null()){
+                raise_error("local variable '" + code->varnames[i->arg] + "' referenced before assignment");
+                return value();
+            }
+            value v = inplace_operation(i->sub, target, sp[-1]);
+            if(v.is_null())
+                return value();
+            *--sp = value();
+            target = std::move(v);
+            break;
+        }
+        case op_copy:
+            // push copies of the top arg values
+            for(int k = 0; k < i->arg; k++, sp++)
+                sp[0] = sp[-i->arg];
+            break;
+        case op_rotate: {
+            // move the top value down under the arg - 1 below it
+            value v = std::move(sp[-1]);
+            for(value *p = sp - 1; p > sp - i->arg; p--)
+                *p = std::move(p[-1]);
+            sp[-i->arg] = std::move(v);
+            break;
+        }
+        case op_negate:
+            if(sp[-1].is_float()){
+                sp[-1] = value::from_float(-sp[-1].as_float());
+                break;
+            }
+            if(!is_integer(sp[-1])){
+                raise_error("bad operand type for unary -: '" + type_name(sp[-1]) + "'");
+                return value();
+            }
+            if(sp[-1].as_int() == LLONG_MIN){
+                raise_error("integer overflow");
+                return value();
+            }
+            sp[-1] = value::from_int(-sp[-1].as_int());
+            break;
+        case op_build_list: {
+            py_list *l = new py_list();
+            value v(l);
+            l->reserve(i->arg);
+            for(value *p = sp - i->arg; p < sp; p++){
+                l->append(*p);
+                *p = value();
+            }
+            sp -= i->arg;
+            *sp++ = std::move(v);
+            break;
+        }
+        case op_build_tuple: {
+            py_tuple *t = py_tuple::make(i->arg);
+            value v(t);
+            value *p = sp - i->arg;
+            for(int k = 0; k < i->arg; k++)
+                t->items()[k] = std::move(p[k]);
+            sp = p;
+            *sp++ = std::move(v);
+            break;
+        }
+        case op_unpack_sequence: {
+            // push the elements so that the first ends up on top
+            value seq = std::move(*--sp);
+            size_t n;
+            if(is_sequence(seq)){
+                n = sequence_length(seq);
+            }else if(seq.is(o_str)){
+                n = static_cast<py_str *>(seq.as_object())->size();
+            }else if(seq.is(o_range)){
+                n = (size_t)static_cast<py_range *>(seq.as_object())->length;
+            }else{
+                raise_error("cannot unpack non-iterable " + type_name(seq) + " object");
+                return value();
+            }
+            if(n != (size_t)i->arg){
+                if(n < (size_t)i->arg)
+                    raise_error("not enough values to unpack (expected " + to_string(i->arg) + ", got " + to_string(n) + ")");
+                else
+                    raise_error("too many values to unpack (expected " + to_string(i->arg) + ")");
+                return value();
+            }
+            while(n > 0){
+                n--;
+                *sp++ = is_sequence(seq) ? sequence_item(seq, n) : load_subscript(seq, value::from_int((long long)n));
+            }
+            break;
+        }
+        case op_reverse:
+            reverse(sp - i->arg, sp);
+            break;
+        case op_load_subscript: {
+            // list[int] in range, which numeric loops do most
+            if(sp[-2].is(o_list) && sp[-1].is_int()){
+                py_list *l = static_cast<py_list *>(sp[-2].as_object());
+                long long n = sp[-1].as_int();
+                if(n >= 0 && (size_t)n < l->size()){
+                    value r = l->get((size_t)n);
+                    --sp;
+                    sp[-1] = std::move(r);
+                    break;
+                }
+            }
+            value r = load_subscript(sp[-2], sp[-1]);
+            if(r.is_null())
+                return value();
+            *--sp = value();
+            sp[-1] = std::move(r);
+            break;
+        }
+        case op_load_slice: {
+            value r = load_slice(sp[-4], sp[-3], sp[-2], sp[-1]);
+            if(r.is_null())
+                return value();
+            sp[-1] = value();
+            sp[-2] = value();
+            sp[-3] = value();
+            sp -= 3;
+            sp[-1] = std::move(r);
+            break;
+        }
+        case op_store_subscript:
+            if(!store_subscript(sp[-2], sp[-1], sp[-3]))
+                return value();
+            sp[-1] = value();
+            sp[-2] = value();
+            sp[-3] = value();
+            sp -= 3;
+            break;
+        case op_delete_subscript:
+            if(!delete_subscript(sp[-2], sp[-1]))
+                return value();
+            sp[-1] = value();
+            sp[-2] = value();
+            sp -= 2;
+            break;
+        case op_load_attr: {
+            // an instance with the shape this instruction last saw has
+            // the attribute in the same slot
+            if(sp[-1].is(o_instance) && i->sub != no_cache){
+                py_instance *o = static_cast<py_instance *>(sp[-1].as_object());
+                attr_cache &c = code->caches[i->sub];
+                if(o->layout != NULL){
+                    if(o->layout->id != c.shape_id){
+                        int k = o->layout->find(code->names[i->arg]);
+                        if(k >= 0){
+                            c.shape_id = o->layout->id;
+                            c.slot = k;
+                        }
+                    }
+                    if(o->layout->id == c.shape_id){
+                        value v = o->slot(c.slot);
+                        sp[-1] = std::move(v);
+                        break;
+                    }
+                }
+            }
+            value r = load_attribute(sp[-1], code->names[i->arg]);
+            if(r.is_null())
+                return value();
+            sp[-1] = std::move(r);
+            break;
+        }
+        case op_store_attr: {
+            // the cache holds either the slot of an attribute the shape
+            // already has, or the transition that adds it
+            if(sp[-1].is(o_instance) && i->sub != no_cache){
+                py_instance *o = static_cast<py_instance *>(sp[-1].as_object());
+                attr_cache &c = code->caches[i->sub];
+                if(o->layout != NULL && o->layout->id == c.shape_id){
+                    if(c.next != NULL){
+                        if(c.slot >= o->capacity)
+                            o->overflow.emplace_back();
+                        o->layout = c.next;
+                    }
+                    o->slot(c.slot) = std::move(sp[-2]);
+                }else{
+                    unsigned before = o->layout != NULL ? o->layout->id : 0;
+                    o->set(code->names[i->arg], sp[-2]);
+                    if(before != 0 && o->layout != NULL){
+                        c.shape_id = before;
+                        c.slot = o->layout->find(code->names[i->arg]);
+                        c.next = o->layout->id != before ? o->layout : NULL;
+                    }
+                }
+            }else if(!store_attribute(sp[-1], code->names[i->arg], sp[-2])){
+                return value();
+            }
+            sp[-1] = value();
+            sp[-2] = value();
+            sp -= 2;
+            break;
+        }
+        case op_build_class: {
+            if(!sp[-1].is_none() && !sp[-1].is(o_class)){
+                raise_error("bases must be classes, not " + type_name(sp[-1]));
+                return value();
+            }
+            const string &name = static_cast<py_str *>(code->constants[i->arg].as_object())->str();
+            sp[-1] = value(new py_class(name, sp[-1]));
+            break;
+        }
+        case op_store_class_attr:
+            static_cast<py_class *>(sp[-2].as_object())->set_attribute(code->names[i->arg], sp[-1]);
+            *--sp = value();
+            break;
+        case op_call:
+        case op_call_kw: {
+            value kwnames;
+            if(i->op == op_call_kw)
+                kwnames = std::move(*--sp);
+            py_tuple *names = kwnames.is_null() ? NULL : static_cast<py_tuple *>(kwnames.as_object());
+            value *args = sp - i->arg;
+            call_cache *cache = i->sub != no_cache && names != NULL ? &code->call_caches[i->sub] : NULL;
+            value r = call_value(args[-1], args, i->arg - keyword_count(names), names, cache);
+            if(r.is_null())
+                return value();
+            while(sp > args)
+                *--sp = value();
+            sp[-1] = std::move(r);
+            break;
+        }
+        case op_load_method: {
+            // leaves the method and the receiver, or a null value and the
+            // attribute when it is not a method, for op_call_method
+            method_cache *c = i->sub != no_cache ? &code->method_caches[i->sub] : NULL;
+            py_object *m = NULL;
+            if(c != NULL && sp[-1].is_object() && sp[-1].as_object()->type == c->type){
+                if(c->type != o_instance){
+                    m = c->method;
+                }else{
+                    py_instance *o = static_cast<py_instance *>(sp[-1].as_object());
+                    if(o->layout != NULL && o->layout->id == c->shape_id && static_cast<py_class *>(o->cls.as_object())->version == c->version)
+                        m = c->method;
+                }
+            }
+            if(m != NULL){
+                *sp = std::move(sp[-1]);
+                sp[-1] = value(m);
+                sp++;
+                break;
+            }
+            bool unbound;
+            value r = load_method(sp[-1], code->names[i->arg], unbound);
+            if(r.is_null())
+                return value();
+            if(!unbound){
+                sp[-1] = value();
+                *sp++ = std::move(r);
+                break;
+            }
+            if(c != NULL){
+                c->type = sp[-1].as_object()->type;
+                c->method = r.as_object();
+                if(c->type == o_instance){
+                    py_instance *o = static_cast<py_instance *>(sp[-1].as_object());
+                    c->version = static_cast<py_class *>(o->cls.as_object())->version;
+                    c->shape_id = o->layout != NULL ? o->layout->id : 0;
+                }
+            }
+            *sp = std::move(sp[-1]);
+            sp[-1] = std::move(r);
+            sp++;
+            break;
+        }
+        case op_call_method:
+        case op_call_method_kw: {
+            // the receiver, when there is one, is already in place as the
+            // first argument
+            value kwnames;
+            if(i->op == op_call_method_kw)
+                kwnames = std::move(*--sp);
+            py_tuple *names = kwnames.is_null() ? NULL : static_cast<py_tuple *>(kwnames.as_object());
+            value *args = sp - i->arg;
+            int nargs = i->arg - keyword_count(names);
+            call_cache *cache = i->sub != no_cache && names != NULL ? &code->call_caches[i->sub] : NULL;
+            value r = args[-2].is_null() ? call_value(args[-1], args, nargs, names, cache) : call_value(args[-2], args - 1, nargs + 1, names, cache);
+            if(r.is_null())
+                return value();
+            while(sp > args - 1)
+                *--sp = value();
+            sp[-1] = std::move(r);
+            break;
+        }
+        case op_build_map: {
+            py_dict *d = new py_dict();
+            value v(d);
+            value *p = sp - 2 * i->arg;
+            d->items.reserve(i->arg);
+            for(value *k = p; k < sp; k += 2){
+                if(!check_hashable(k[0]))
+                    return value();
+                d->items[k[0]] = std::move(k[1]);
+            }
+            while(sp > p)
+                *--sp = value();
+            *sp++ = std::move(v);
+            break;
+        }
+        case op_build_set: {
+            py_set *t = new py_set();
+            value v(t);
+            value *p = sp - i->arg;
+            t->items.reserve(i->arg);
+            for(value *k = p; k < sp; k++){
+                if(!check_hashable(*k))
+                    return value();
+                t->items.insert(*k);
+            }
+            while(sp > p)
+                *--sp = value();
+            *sp++ = std::move(v);
+            break;
+        }
+        case op_list_append: {
+            // the list of a comprehension, below the loops it runs
+            value v = std::move(*--sp);
+            static_cast<py_list *>(sp[-i->arg].as_object())->append(v);
+            break;
+        }
+        case op_set_add: {
+            if(!check_hashable(sp[-1]))
+                return value();
+            value v = std::move(*--sp);
+            static_cast<py_set *>(sp[-i->arg].as_object())->items.insert(v);
+            break;
+        }
+        case op_map_add: {
+            if(!check_hashable(sp[-2]))
+                return value();
+            py_dict *d = static_cast<py_dict *>(sp[-i->arg - 2].as_object());
+            d->items[sp[-2]] = std::move(sp[-1]);
+            sp[-2] = value();
+            sp -= 2;
+            break;
+        }
+        case op_reserve: {
+            // size the comprehension's container for the iterable on top;
+            // the length is only a hint, so past max_reserve elements the
+            // container grows as it fills instead of failing up front
+            long long n = min(known_length(sp[-1]), (long long)max_reserve);
+            if(n > 0){
+                py_object *o = sp[-2].as_object();
+                if(o->type == o_list)
+                    static_cast<py_list *>(o)->reserve((size_t)n);
+                else if(o->type == o_set)
+                    static_cast<py_set *>(o)->items.reserve((size_t)n);
+                else
+                    static_cast<py_dict *>(o)->items.reserve((size_t)n);
+            }
+            break;
+        }
+        case op_pop_jump_if_false:
+        case op_pop_jump_if_true: {
+            bool t = sp[-1].is_bool() ? sp[-1].as_int() != 0 : truth_value(sp[-1]);
+            *--sp = value();
+            if(t == (i->op == op_pop_jump_if_true))
+                ip = base + i->arg;
+            break;
+        }
+        case op_jump_if_false_or_pop:
+        case op_jump_if_true_or_pop:
+            if(truth_value(sp[-1]) == (i->op == op_jump_if_true_or_pop))
+                ip = base + i->arg;
+            else
+                *--sp = value();
+            break;
+        case op_not:
+            sp[-1] = value::from_bool(!truth_value(sp[-1]));
+            break;
+        case op_compare_jump: {
+            // compare the top two and branch when the result is sub & 8;
+            // ints compare without going through the tables
+            bool t;
+            if((i->sub & 7) <= c_ge && sp[-2].is_int() && sp[-1].is_int()){
+                t = compare_numbers(i->sub & 7, sp[-2].as_int(), sp[-1].as_int());
+                sp -= 2;
+            }else if((i->sub & 7) <= c_ge && sp[-2].is_float() && sp[-1].is_float()){
+                t = compare_numbers(i->sub & 7, sp[-2].as_float(), sp[-1].as_float());
+                sp -= 2;
+            }else{
+                value r = compare_operation(i->sub & 7, sp[-2], sp[-1]);
+                if(r.is_null())
+                    return value();
+                t = truth_value(r);
+                *--sp = value();
+                *--sp = value();
+            }
+            if(t == ((i->sub & 8) != 0))
+                ip = base + i->arg;
+            break;
+        }
+        case op_get_iter:
+            if(!sp[-1].is(o_range) && !is_sequence(sp[-1]) && !sp[-1].is(o_str) && !is_iterator(sp[-1])
+                && !sp[-1].is(o_dict) && !sp[-1].is(o_set)){
+                raise_error("'" + type_name(sp[-1]) + "' object is not iterable");
+                return value();
+            }
+            *sp++ = value::from_int(0);
+            break;
+        case op_for_iter: {
+            if(sp[-2].is(o_range) || sp[-2].is(o_list)){
+                i->op = sp[-2].is(o_range) ? op_for_iter_range : op_for_iter_list;
+                ip = i;
+                break;
+            }
+            long long k = sp[-1].as_int();
+            if(is_iterator(sp[-2])){
+                bool done;
+                value v = next_value(sp[-2], value::none(), &done);
+                if(v.is_null())
+                    return value();
+                if(!done){
+                    *sp++ = std::move(v);
+                    break;
+                }
+            }else if(sp[-2].is(o_tuple)){
+                py_tuple *t = static_cast<py_tuple *>(sp[-2].as_object());
+                if(k < (long long)t->length){
+                    sp[-1] = value::from_int(k + 1);
+                    *sp++ = t->items()[k];
+                    break;
+                }
+            }else if(sp[-2].is(o_dict)){
+                // the position is that of the next entry, skipping the
+                // dead ones; the set's is that of the next slot
+                compact_dict<value, value> &d = static_cast<py_dict *>(sp[-2].as_object())->items;
+                while(k < (long long)d.entry_count() && !d.entry_at((size_t)k).live)
+                    k++;
+                if(k < (long long)d.entry_count()){
+                    sp[-1] = value::from_int(k + 1);
+                    *sp++ = d.entry_at((size_t)k).first;
+                    break;
+                }
+            }else if(sp[-2].is(o_set)){
+                swiss_set<value> &t = static_cast<py_set *>(sp[-2].as_object())->items;
+                while(k < (long long)t.capacity() && !t.full((size_t)k))
+                    k++;
+                if(k < (long long)t.capacity()){
+                    sp[-1] = value::from_int(k + 1);
+                    *sp++ = t.slot((size_t)k);
+                    break;
+                }
+            }else{
+                text_ref s = str_text(sp[-2]);
+                if(k < (long long)s.size){
+                    sp[-1] = value::from_int(k + 1);
+                    *sp++ = make_str(string(1, s.data[k]));
+                    break;
+                }
+            }
+            sp[-1] = value();
+            sp[-2] = value();
+            sp -= 2;
+            ip = base + i->arg;
+            break;
+        }
+        case op_for_iter_range: {
+            if(!sp[-2].is(o_range)){
+                i->op = op_for_iter;
+                ip = i;
+                break;
+            }
+            py_range *r = static_cast<py_range *>(sp[-2].as_object());
+            long long k = sp[-1].as_int();
+            if(k < r->length){
+                sp[-1] = value::from_int(k + 1);
+                *sp++ = value::from_int(r->at(k));
+                break;
+            }
+            sp[-2] = value();
+            sp -= 2;
+            ip = base + i->arg;
+            break;
+        }
+        case op_for_iter_list: {
+            if(!sp[-2].is(o_list)){
+                i->op = op_for_iter;
+                ip = i;
+                break;
+            }
+            py_list *l = static_cast<py_list *>(sp[-2].as_object());
+            long long k = sp[-1].as_int();
+            if(k < (long long)l->size()){
+                sp[-1] = value::from_int(k + 1);
+                *sp++ = l->get((size_t)k);
+                break;
+            }
+            sp[-2] = value();
+            sp -= 2;
+            ip = base + i->arg;
+            break;
+        }
+        case op_yield_value: {
+            value v = std::move(*--sp);
+            gen->ip = (int)(ip - base);
+            gen->sp = (int)(sp - frame);
+            return v;
+        }
+        case op_get_yield_from_iter:
+            if(sp[-1].is(o_generator)){
+                if(static_cast<py_generator *>(sp[-1].as_object())->coroutine){
+                    raise_error("cannot 'yield from' a coroutine object in a non-coroutine generator");
+                    return value();
+                }
+            }else if(sp[-1].is(o_range) || is_sequence(sp[-1]) || sp[-1].is(o_str)){
+                sp[-1] = value(new py_iterator(sp[-1]));
+            }else if(sp[-1].is(o_dict) || sp[-1].is(o_set)){
+                sp[-1] = value(new py_iterator(make_list(sp[-1])));
+            }else if(!sp[-1].is(o_iterator)){
+                raise_error("'" + type_name(sp[-1]) + "' object is not iterable");
+                return value();
+            }
+            break;
+        case op_get_awaitable: {
+            value r = awaitable(sp[-1]);
+            if(r.is_null())
+                return value();
+            sp[-1] = std::move(r);
+            break;
+        }
+        case op_yield_from: {
+            // sp[-2] is the iterator delegated to and sp[-1] the value to
+            // send it. What it yields goes straight out to our caller, and
+            // this instruction runs again on resuming, until the iterator
+            // finishes and its result replaces it.
+            bool done;
+            value r = next_value(sp[-2], sp[-1], &done);
+            if(r.is_null())
+                return value();
+            *--sp = value();
+            if(done){
+                sp[-1] = std::move(r);
+                break;
+            }
+            gen->ip = (int)(i - base);
+            gen->sp = (int)(sp - frame);
+            return r;
+        }
+        case op_jump:
+            // every loop goes round through a jump
+            if(!on_time())
+                return value();
+            ip = base + i->arg;
+            break;
+        case op_return:
+            if(gen != NULL)
+                gen->finished = true;
+            return std::move(sp[-1]);
+        }
+    }
+}
+
+// Put the keyword arguments of a call into the fast slots of their
+// parameters. With a cache, matching the names against the parameters is
+// only done when the call site meets a function with different code.
+bool bind_keywords(py_function *f, value *kwargs, py_tuple *kwnames, call_cache *cache, value *frame) {
+    code_object *code = static_cast<code_object *>(f->code.as_object());
+    vector<int> found;
+    const vector<int> *slots = &found;
+    if(cache != NULL && cache->code.as_object() == code){
+        slots = &cache->slots;
+    }else{
+        for(size_t k = 0; k < kwnames->length; k++){
+            const string &name = static_cast<py_str *>(kwnames->items()[k].as_object())->str();
+            int j = index_of(code->varnames, name);
+            if(j < 0 || j >= code->argcount){
+                raise_error(f->name + "() got an unexpected keyword argument '" + name + "'");
+                return false;
+            }
+            found.push_back(j);
+        }
+        if(cache != NULL){
+            cache->code = f->code;
+            cache->slots.swap(found);
+            slots = &cache->slots;
+        }
+    }
+    for(size_t k = 0; k < kwnames->length; k++){
+        int j = (*slots)[k];
+        if(!frame[j].is_null()){
+            raise_error(f->name + "() got multiple values for argument '" + code->varnames[j] + "'");
+            return false;
+        }
+        frame[j] = kwargs[k];
+    }
+    return true;
+}
+
+// fill the parameters no argument was given for from the defaults
+bool bind_defaults(py_function *f, int nargs, value *frame) {
+    code_object *code = static_cast<code_object *>(f->code.as_object());
+    py_tuple *defaults = f->defaults.is_null() ? NULL : static_cast<py_tuple *>(f->defaults.as_object());
+    int first = code->argcount - (defaults == NULL ? 0 : (int)defaults->length);
+    vector<string> missing;
+    for(int j = nargs; j < code->argcount; j++){
+        if(!frame[j].is_null())
+            continue;
+        if(j >= first)
+            frame[j] = defaults->items()[j - first];
+        else
+            missing.push_back("'" + code->varnames[j] + "'");
+    }
+    if(missing.empty())
+        return true;
+    string names;
+    for(size_t k = 0; k < missing.size(); k++){
+        if(k > 0)
+            names += missing.size() == 2 ? " and " : k + 1 == missing.size() ? ", and " : ", ";
+        names += missing[k];
+    }
+    raise_error(f->name + "() missing " + to_string(missing.size()) + " required positional argument" + (missing.size() == 1 ? "" : "s") + ": " + names);
+    return false;
+}
+
+// Call a script function: the arguments go into the fast slots of a new
+// frame, the cells of its captured locals are created and the closure's
+// cells are copied in after them.
+value call_function(py_function *f, value *args, int nargs, py_tuple *kwnames, call_cache *cache) {
+    code_object *code = static_cast<code_object *>(f->code.as_object());
+    if(nargs > code->argcount){
+        int optional = f->defaults.is_null() ? 0 : (int)static_cast<py_tuple *>(f->defaults.as_object())->length;
+        string takes = optional == 0 ? to_string(code->argcount) : "from " + to_string(code->argcount - optional) + " to " + to_string(code->argcount);
+        return raise_error(f->name + "() takes " + takes + " positional argument" + (code->argcount == 1 && optional == 0 ? "" : "s") + " but " + to_string(nargs) + (nargs == 1 ? " was" : " were") + " given");
+    }
+    if(current->call_depth >= max_call_depth)
+        return raise_error("maximum recursion depth exceeded");
+    if(!on_time())
+        return value();
+    vector<value> frame(code->frame_size());
+    for(int k = 0; k < nargs; k++)
+        frame[k] = args[k];
+    if(kwnames != NULL && kwnames->length > 0 && !bind_keywords(f, args + nargs, kwnames, cache, frame.data()))
+        return value();
+    if(nargs < code->argcount && !bind_defaults(f, nargs, frame.data()))
+        return value();
+    value *cells = frame.data() + code->varnames.size();
+    for(size_t k = 0; k < code->cellnames.size(); k++){
+        py_cell *c = new py_cell();
+        cells[k] = value(c);
+        if(code->cell_args[k] >= 0)
+            c->contents = std::move(frame[code->cell_args[k]]);
+    }
+    for(size_t k = 0; k < f->closure.size(); k++)
+        cells[code->cellnames.size() + k] = f->closure[k];
+    if(code->generator || code->coroutine){
+        py_generator *g = new py_generator(value(f), f->name, code->coroutine);
+        g->frame.swap(frame);
+        g->sp = (int)(code->varnames.size() + code->cellnames.size() + code->freenames.size());
+        return value(g);
+    }
+    current->call_depth++;
+    value r = run_frame(code, frame.data(), NULL);
+    current->call_depth--;
+    return r;
+}
+
+// Run a generator or coroutine until it yields or returns, sending it
+// sent (None to start it). done tells which of the two it did; once
+// finished, a generator returns None. Returns a null value after an
+// error, which finishes it too.
+value resume_generator(py_generator *g, const value &sent, bool *done) {
+    *done = true;
+    if(g->finished){
+        if(g->coroutine)
+            return raise_error("cannot reuse already awaited coroutine");
+        return value::none();
+    }
+    const char *kind = g->coroutine ? "coroutine" : "generator";
+    if(g->running)
+        return raise_error(string(kind) + " already executing");
+    if(!g->started && !sent.is_none())
+        return raise_error(string("can't send non-None value to a just-started ") + kind);
+    if(current->call_depth >= max_call_depth)
+        return raise_error("maximum recursion depth exceeded");
+    if(g->started)
+        g->frame[g->sp++] = sent;
+    g->started = true;
+    g->running = true;
+    current->call_depth++;
+    code_object *code = static_cast<code_object *>(static_cast<py_function *>(g->function.as_object())->code.as_object());
+    value r = run_frame(code, g->frame.data(), g);
+    current->call_depth--;
+    g->running = false;
+    if(r.is_null())
+        g->finished = true;
+    if(g->finished)
+        vector<value>().swap(g->frame);
+    *done = g->finished;
+    return r;
+}
+
+// can a for loop or next() step v? (a coroutine is only awaited)
+bool is_iterator(const value &v) {
+    if(v.is(o_generator))
+        return !static_cast<py_generator *>(v.as_object())->coroutine;
+    return v.is(o_iterator);
+}
+
+// The next value of a generator, coroutine or iterator, with done set
+// and the final result instead once there are no more.
+value next_value(const value &it, const value &sent, bool *done) {
+    if(it.is(o_generator))
+        return resume_generator(static_cast<py_generator *>(it.as_object()), sent, done);
+    py_iterator *t = static_cast<py_iterator *>(it.as_object());
+    if(!sent.is_none())
+        return raise_error("'" + type_name(it) + "' object has no attribute 'send'");
+    const value &v = t->sequence;
+    size_t i = t->position;
+    *done = false;
+    if(v.is(o_str)){
+        text_ref s = str_text(v);
+        if(i < s.size){
+            t->position++;
+            return make_str(string(1, s.data[i]));
+        }
+    }else if(v.is(o_range)){
+        py_range *r = static_cast<py_range *>(v.as_object());
+        if((long long)i < r->length){
+            t->position++;
+            return value::from_int(r->at((long long)i));
+        }
+    }else if(i < sequence_length(v)){
+        t->position++;
+        return sequence_item(v, i);
+    }
+    *done = true;
+    return value::none();
+}
+
+// What await waits on for v: a coroutine itself, or the iterator the
+// __await__ method of an instance returns.
+value awaitable(const value &v) {
+    if(v.is(o_generator) && static_cast<py_generator *>(v.as_object())->coroutine)
+        return v;
+    if(v.is(o_instance)){
+        value *m = static_cast<py_class *>(static_cast<py_instance *>(v.as_object())->cls.as_object())->lookup(await_name);
+        if(m != NULL){
+            value self = v;
+            value r = call_value(*m, &self, 1, NULL);
+            if(r.is_null() || is_iterator(r))
+                return r;
+            return raise_error("__await__() returned non-iterator of type '" + type_name(r) + "'");
+        }
+    }
+    return raise_error("object " + type_name(v) + " can't be used in 'await' expression");
+}
+
+// the error for a generator that finished with result
+value stop_iteration(const value &result) {
+    return raise_error(result.is_none() ? string("StopIteration") : "StopIteration: " + to_str(result));
+}
+
+// run the module code of a script
+bool run_code(code_object *code) {
+    vector<value> frame(code->frame_size());
+    return !run_frame(code, frame.data(), NULL).is_null();
+}
+
+value builtin_print(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("print", kwnames))
+        return value();
+    string line;
+    for(int i = 0; i < nargs; i++){
+        if(i > 0)
+            line += ' ';
+        line += to_str(args[i]);
+    }
+    if(!current->error_message.empty())
+        return value();
+    line += '\n';
+    *current->out << line;
+    return value::none();
+}
+
+value builtin_range(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("range", kwnames))
+        return value();
+    if(nargs < 1 || nargs > 3)
+        return raise_error("range expected 1 to 3 arguments, got " + to_string(nargs));
+    for(int i = 0; i < nargs; i++){
+        if(!is_integer(args[i]))
+            return raise_error("'" + type_name(args[i]) + "' object cannot be interpreted as an integer");
+    }
+    if(nargs == 1)
+        return value(new py_range(0, args[0].as_int(), 1));
+    long long step = nargs == 3 ? args[2].as_int() : 1;
+    if(step == 0)
+        return raise_error("range() arg 3 must not be zero");
+    // the length is kept as a long long so len() and indexing can use it
+    if(range_length(args[0].as_int(), args[1].as_int(), step) > (unsigned long long)LLONG_MAX)
+        return raise_error("OverflowError: range() result has too many items");
+    return value(new py_range(args[0].as_int(), args[1].as_int(), step));
+}
+
+value builtin_len(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("len", kwnames))
+        return value();
+    if(nargs != 1)
+        return raise_error("len() takes exactly one argument (" + to_string(nargs) + " given)");
+    if(args[0].is(o_str))
+        return value::from_int((long long)static_cast<py_str *>(args[0].as_object())->size());
+    if(is_sequence(args[0]))
+        return value::from_int((long long)sequence_length(args[0]));
+    if(args[0].is(o_range))
+        return value::from_int(static_cast<py_range *>(args[0].as_object())->length);
+    if(args[0].is(o_dict))
+        return value::from_int((long long)static_cast<py_dict *>(args[0].as_object())->items.size());
+    if(args[0].is(o_set))
+        return value::from_int((long long)static_cast<py_set *>(args[0].as_object())->items.size());
+    return raise_error("object of type '" + type_name(args[0]) + "' has no len()");
+}
+
+// the body of make_list(), which may throw bad_alloc
+value list_of(const value &iterable) {
+    py_list *l = new py_list();
+    value result(l);
+    if(is_sequence(iterable)){
+        size_t n = sequence_length(iterable);
+        l->reserve(n);
+        for(size_t i = 0; i < n; i++)
+            l->append(sequence_item(iterable, i));
+    }else if(iterable.is(o_str)){
+        text_ref s = str_text(iterable);
+        l->reserve(s.size);
+        for(size_t i = 0; i < s.size; i++)
+            l->append(make_str(string(1, s.data[i])));
+    }else if(iterable.is(o_range)){
+        py_range *r = static_cast<py_range *>(iterable.as_object());
+        if((unsigned long long)r->length > max_sequence_length)
+            return raise_error("MemoryError");
+        l->reserve((size_t)r->length);
+        for(long long i = 0; i < r->length; i++)
+            l->append(value::from_int(r->at(i)));
+    }else if(iterable.is(o_dict)){
+        py_dict *d = static_cast<py_dict *>(iterable.as_object());
+        l->reserve(d->items.size());
+        for(auto &e : d->items)
+            l->append(e.first);
+    }else if(iterable.is(o_set)){
+        py_set *t = static_cast<py_set *>(iterable.as_object());
+        l->reserve(t->items.size());
+        t->items.for_each([&](const value &k) { l->append(k); });
+    }else if(is_iterator(iterable)){
+        while(true){
+            bool done;
+            value v = next_value(iterable, value::none(), &done);
+            if(v.is_null())
+                return v;
+            if(done)
+                break;
+            l->append(v);
+        }
+    }else{
+        return raise_error("'" + type_name(iterable) + "' object is not iterable");
+    }
+    return result;
+}
+
+// A new list of the elements of a list, tuple, str or range, the keys of
+// a dict or set, or the values left in a generator or iterator. As with
+// repeat(), a list too big for memory raises MemoryError.
+value make_list(const value &iterable) {
+    try{
+        return list_of(iterable);
+    }catch(const std::bad_alloc &){
+        return raise_error("MemoryError");
+    }
+}
+
+value builtin_abs(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("abs", kwnames))
+        return value();
+    if(nargs != 1)
+        return raise_error("abs() takes exactly one argument (" + to_string(nargs) + " given)");
+    if(is_integer(args[0])){
+        long long v = args[0].as_int();
+        if(v == LLONG_MIN)
+            return raise_error("integer overflow");
+        return value::from_int(v < 0 ? -v : v);
+    }
+    if(args[0].is_float())
+        return value::from_float(fabs(args[0].as_float()));
+    return raise_error("bad operand type for abs(): '" + type_name(args[0]) + "'");
+}
+
+// min() and max(): the smallest (sign -1) or largest (sign 1) of the
+// arguments, or of the items of a single iterable argument, compared by
+// key when one is given. Ties keep the first.
+value extreme(const string &function, value *args, int nargs, py_tuple *kwnames, int sign) {
+    static const char *const names[] = {"key", "default"};
+    value slots[2] = {value::none(), value()};
+    if(!take_keywords(function, args, nargs, kwnames, names, slots, 2))
+        return value();
+    if(nargs == 0)
+        return raise_error(function + " expected at least 1 argument, got 0");
+    if(nargs > 1 && !slots[1].is_null())
+        return raise_error("Cannot specify a default for " + function + "() with multiple positional arguments");
+    value items;
+    const value *first = args;
+    size_t n = nargs;
+    if(nargs == 1){
+        items = is_sequence(args[0]) ? args[0] : make_list(args[0]);
+        if(items.is_null())
+            return value();
+        n = sequence_length(items);
+        first = NULL;
+    }
+    if(n == 0){
+        if(!slots[1].is_null())
+            return slots[1];
+        return raise_error(function + "() arg is an empty sequence");
+    }
+    value best, best_key;
+    for(size_t i = 0; i < n; i++){
+        value v = first != NULL ? first[i] : sequence_item(items, i);
+        value k = slots[0].is_none() ? v : call_value(slots[0], &v, 1, NULL);
+        if(k.is_null())
+            return value();
+        if(i > 0){
+            int c = compare_values(k, best_key);
+            if(c == -3)
+                return value();
+            if(c == -2)
+                return raise_error(string("'") + (sign < 0 ? "<" : ">") + "' not supported between instances of '" + type_name(k) + "' and '" + type_name(best_key) + "'");
+            if(c != sign)
+                continue;
+        }
+        best = std::move(v);
+        best_key = std::move(k);
+    }
+    return best;
+}
+
+value builtin_min(value *args, int nargs, py_tuple *kwnames) {
+    return extreme("min", args, nargs, kwnames, -1);
+}
+
+value builtin_max(value *args, int nargs, py_tuple *kwnames) {
+    return extreme("max", args, nargs, kwnames, 1);
+}
+
+// Orders (key, position) pairs by key only; timsort's stability keeps
+// equal keys in their original order. Reversed sorts swap the operands
+// rather than reversing the result, which keeps them stable too.
+template <class K>
+struct key_less {
+    bool reverse;
+    bool operator()(const pair<K, size_t> &a, const pair<K, size_t> &b) const {
+        return reverse ? b.first < a.first : a.first < b.first;
+    };
+};
+
+struct str_key_less {
+    bool reverse;
+    bool operator()(const pair<text_ref, size_t> &a, const pair<text_ref, size_t> &b) const {
+        return (reverse ? compare_text(b.first, a.first) : compare_text(a.first, b.first)) < 0;
+    };
+};
+
+// keys of mixed type go through compare_values; the first pair that
+// cannot be ordered is reported once the sort finishes
+struct value_key_less {
+    bool reverse;
+    bool *failed;
+    bool operator()(const pair<const value *, size_t> &a, const pair<const value *, size_t> &b) const {
+        if(*failed)
+            return false;
+        int c = reverse ? compare_values(*b.first, *a.first) : compare_values(*a.first, *b.first);
+        if(c == -3){
+            *failed = true;
+            return false;
+        }
+        if(c == -2){
+            *failed = true;
+            raise_error("'<' not supported between instances of '" + type_name(*a.first) + "' and '" + type_name(*b.first) + "'");
+            return false;
+        }
+        return c < 0;
+    };
+};
+
+// put elements back into l as they were
+void restore(py_list *l, const vector<value> &elements) {
+    l->clear();
+    for(const value &v : elements)
+        l->append(v);
+}
+
+// put the elements of l in the order given by the positions in keys
+template <class K>
+void undecorate(py_list *l, vector<value> &elements, const vector<pair<K, size_t>> &keys) {
+    l->clear();
+    for(const pair<K, size_t> &k : keys)
+        l->append(std::move(elements[k.second]));
+}
+
+// Sort a list in place, stably. An unboxed list sorted without a key is
+// sorted directly as an array of numbers. Otherwise the key function is
+// called once per element (decorate), (key, position) pairs are sorted
+// with a comparison specialised for all-int or all-str keys, and the list
+// is rebuilt in the sorted order (undecorate). As in CPython, the list is
+// empty while the key function runs, and anything it adds to the list
+// raises ValueError afterwards. On error the list is left as it was.
+bool sort_list(py_list *l, const value &key, bool reverse) {
+    size_t n = l->size();
+    if(n < 2 && key.is_none())
+        return true;
+    if(key.is_none() && l->storage() == py_list::l_int){
+        if(reverse)
+            tim_sort(l->int_items(), n, [](long long a, long long b) { return b < a; });
+        else
+            tim_sort(l->int_items(), n, [](long long a, long long b) { return a < b; });
+        return true;
+    }
+    if(key.is_none() && l->storage() == py_list::l_float){
+        if(reverse)
+            tim_sort(l->float_items(), n, [](double a, double b) { return b < a; });
+        else
+            tim_sort(l->float_items(), n, [](double a, double b) { return a < b; });
+        return true;
+    }
+    vector<value> elements;
+    elements.reserve(n);
+    for(size_t i = 0; i < n; i++)
+        elements.push_back(l->get(i));
+    vector<value> computed;
+    const vector<value> *keys = &elements;
+    if(!key.is_none()){
+        computed.reserve(n);
+        l->clear();
+        for(size_t i = 0; i < n; i++){
+            value k = call_value(key, &elements[i], 1, NULL);
+            if(k.is_null()){
+                restore(l, elements);
+                return false;
+            }
+            computed.push_back(std::move(k));
+        }
+        if(l->size() != 0){
+            restore(l, elements);
+            raise_error("ValueError: list modified during sort");
+            return false;
+        }
+        keys = &computed;
+    }
+    // a single element is sorted, but its key was still computed above
+    if(n < 2){
+        restore(l, elements);
+        return true;
+    }
+    bool ints = true, strs = true;
+    for(const value &k : *keys){
+        ints = ints && is_integer(k);
+        strs = strs && k.is(o_str);
+    }
+    if(ints){
+        vector<pair<long long, size_t>> d(n);
+        for(size_t i = 0; i < n; i++)
+            d[i] = make_pair((*keys)[i].as_int(), i);
+        key_less<long long> less = {reverse};
+        tim_sort(d.data(), n, less);
+        undecorate(l, elements, d);
+    }else if(strs){
+        vector<pair<text_ref, size_t>> d(n);
+        for(size_t i = 0; i < n; i++)
+            d[i] = make_pair(str_text((*keys)[i]), i);
+        str_key_less less = {reverse};
+        tim_sort(d.data(), n, less);
+        undecorate(l, elements, d);
+    }else{
+        bool failed = false;
+        vector<pair<const value *, size_t>> d(n);
+        for(size_t i = 0; i < n; i++)
+            d[i] = make_pair(&(*keys)[i], i);
+        value_key_less less = {reverse, &failed};
+        tim_sort(d.data(), n, less);
+        if(failed){
+            restore(l, elements);
+            return false;
+        }
+        undecorate(l, elements, d);
+    }
+    return true;
+}
+
+// the key and reverse keyword arguments of list.sort and sorted
+bool sort_arguments(const string &function, value *args, int nargs, py_tuple *kwnames, value *key, bool *reverse) {
+    static const char *const names[] = {"key", "reverse"};
+    value slots[2] = {value::none(), value::from_bool(false)};
+    if(!take_keywords(function, args, nargs, kwnames, names, slots, 2))
+        return false;
+    *key = slots[0];
+    *reverse = truth_value(slots[1]);
+    return true;
+}
+
+value list_sort(value *args, int nargs, py_tuple *kwnames) {
+    value key;
+    bool reverse;
+    if(!sort_arguments("sort", args, nargs, kwnames, &key, &reverse))
+        return value();
+    if(nargs != 1)
+        return raise_error("sort() takes no positional arguments");
+    if(!sort_list(static_cast<py_list *>(args[0].as_object()), key, reverse))
+        return value();
+    return value::none();
+}
+
+value list_append(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("append", kwnames))
+        return value();
+    if(nargs != 2)
+        return raise_error("append() takes exactly one argument (" + to_string(nargs - 1) + " given)");
+    static_cast<py_list *>(args[0].as_object())->append(args[1]);
+    return value::none();
+}
+
+// Bind the arguments of a native method after self to named slots:
+// positional ones in order, then keywords by name. Slots not given are
+// left as they were.
+bool bind_arguments(const string &function, value *args, int nargs, py_tuple *kwnames, const char *const names[], value slots[], int count) {
+    size_t positional = nargs;
+    if(positional - 1 > (size_t)count){
+        raise_error(function + "() takes at most " + to_string(count) + " arguments (" + to_string(positional - 1) + " given)");
+        return false;
+    }
+    for(size_t i = 1; i < positional; i++)
+        slots[i - 1] = args[i];
+    for(size_t k = 0; kwnames != NULL && k < kwnames->length; k++){
+        const string &name = static_cast<py_str *>(kwnames->items()[k].as_object())->str();
+        int j = 0;
+        while(j < count && name != names[j])
+            j++;
+        if(j == count){
+            raise_error("'" + name + "' is an invalid keyword argument for " + function + "()");
+            return false;
+        }
+        if((size_t)j + 1 < positional){
+            raise_error("argument for " + function + "() given by name ('" + name + "') and position (" + to_string(j + 1) + ")");
+            return false;
+        }
+        slots[j] = args[positional + k];
+    }
+    return true;
+}
+
+// check that a native method got between min and max arguments after self
+bool method_arity(const string &function, int nargs, size_t min, size_t max) {
+    size_t n = nargs - 1;
+    if(n < min){
+        raise_error(function + "() takes at least " + to_string(min) + " argument" + (min == 1 ? "" : "s") + " (" + to_string(n) + " given)");
+        return false;
+    }
+    if(n > max){
+        raise_error(function + "() takes at most " + to_string(max) + " argument" + (max == 1 ? "" : "s") + " (" + to_string(n) + " given)");
+        return false;
+    }
+    return true;
+}
+
+bool str_argument(const string &function, const value &v) {
+    if(v.is(o_str))
+        return true;
+    raise_error(function + "() argument must be str, not " + type_name(v));
+    return false;
+}
+
+// The optional start and end arguments of find and count at args[first]
+// and after, resolved like slice bounds. start may end up past n.
+bool search_bounds(const value *args, int nargs, int first, size_t n, size_t *start, size_t *end) {
+    long long bounds[2] = {0, (long long)n};
+    for(int k = 0; k < 2 && first + k < nargs; k++){
+        const value &v = args[first + k];
+        if(v.is_none())
+            continue;
+        if(!is_integer(v)){
+            raise_error("slice indices must be integers or None");
+            return false;
+        }
+        long long b = v.as_int();
+        if(b < 0){
+            b += (long long)n;
+            if(b < 0)
+                b = 0;
+        }
+        bounds[k] = b;
+    }
+    *start = (size_t)bounds[0];
+    *end = bounds[1] > (long long)n ? n : (size_t)bounds[1];
+    return true;
+}
+
+value str_find(value *args, int nargs, py_tuple *kwnames) {
+    size_t start, end;
+    if(!no_keywords("find", kwnames) || !method_arity("find", nargs, 1, 3) || !str_argument("find", args[1]))
+        return value();
+    text_ref s = str_text(args[0]), sub = str_text(args[1]);
+    if(!search_bounds(args, nargs, 2, s.size, &start, &end))
+        return value();
+    size_t k = start > end ? string::npos : text_find(s.data, end, sub.data, sub.size, start);
+    return value::from_int(k == string::npos ? -1 : (long long)k);
+}
+
+value str_count(value *args, int nargs, py_tuple *kwnames) {
+    size_t start, end;
+    if(!no_keywords("count", kwnames) || !method_arity("count", nargs, 1, 3) || !str_argument("count", args[1]))
+        return value();
+    text_ref s = str_text(args[0]), sub = str_text(args[1]);
+    if(!search_bounds(args, nargs, 2, s.size, &start, &end))
+        return value();
+    if(start > end)
+        return value::from_int(0);
+    return value::from_int((long long)text_count(s.data, end, sub.data, sub.size, start));
+}
+
+inline bool is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// split on runs of whitespace, ignoring it at the start and end; the
+// piece left after maxsplit splits keeps its trailing whitespace
+void split_whitespace(py_list *l, const value &v, long long maxsplit) {
+    text_ref s = str_text(v);
+    size_t i = 0, n = s.size;
+    while(true){
+        while(i < n && is_space(s.data[i]))
+            i++;
+        if(i == n)
+            return;
+        if(maxsplit == 0){
+            l->append(str_slice(v, i, n - i));
+            return;
+        }
+        size_t j = i;
+        while(j < n && !is_space(s.data[j]))
+            j++;
+        l->append(str_slice(v, i, j - i));
+        maxsplit--;
+        i = j;
+    }
+}
+
+value str_split(value *args, int nargs, py_tuple *kwnames) {
+    static const char *const names[] = {"sep", "maxsplit"};
+    value slots[2] = {value::none(), value::from_int(-1)};
+    if(!bind_arguments("split", args, nargs, kwnames, names, slots, 2))
+        return value();
+    if(!slots[0].is_none() && !str_argument("split", slots[0]))
+        return value();
+    if(!is_integer(slots[1]))
+        return raise_error("'" + type_name(slots[1]) + "' object cannot be interpreted as an integer");
+    text_ref s = str_text(args[0]);
+    long long maxsplit = slots[1].as_int();
+    if(maxsplit < 0)
+        maxsplit = LLONG_MAX;
+    py_list *l = new py_list();
+    value result(l);
+    if(slots[0].is_none()){
+        split_whitespace(l, args[0], maxsplit);
+        return result;
+    }
+    text_ref sep = str_text(slots[0]);
+    if(sep.size == 0)
+        return raise_error("empty separator");
+    size_t piece = 0;
+    if(sep.size == 1){
+        // count first so the list is allocated once
+        size_t pieces = text_count_byte(s.data, s.size, sep.data[0]);
+        l->reserve((size_t)min((long long)pieces, maxsplit) + 1);
+        for_each_byte(s.data, s.size, sep.data[0], [&](size_t k) {
+            if(maxsplit == 0)
+                return false;
+            l->append(str_slice(args[0], piece, k - piece));
+            piece = k + 1;
+            maxsplit--;
+            return true;
+        });
+    }else{
+        for(size_t k = text_find(s.data, s.size, sep.data, sep.size, 0); k != string::npos && maxsplit > 0; k = text_find(s.data, s.size, sep.data, sep.size, piece)){
+            l->append(str_slice(args[0], piece, k - piece));
+            piece = k + sep.size;
+            maxsplit--;
+        }
+    }
+    l->append(str_slice(args[0], piece, s.size - piece));
+    return result;
+}
+
+// The positions of the replaced occurrences are found first, so the result
+// is allocated once at its final size.
+value str_replace(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("replace", kwnames) || !method_arity("replace", nargs, 2, 3) || !str_argument("replace", args[1]) || !str_argument("replace", args[2]))
+        return value();
+    if(nargs == 4 && !is_integer(args[3]))
+        return raise_error("'" + type_name(args[3]) + "' object cannot be interpreted as an integer");
+    text_ref s = str_text(args[0]), from = str_text(args[1]), to = str_text(args[2]);
+    long long limit = nargs == 4 ? args[3].as_int() : -1;
+    if(limit < 0)
+        limit = LLONG_MAX;
+    vector<size_t> found;
+    if(from.size == 0){
+        // an empty pattern matches before every character and at the end
+        for(size_t k = 0; k <= s.size && (long long)found.size() < limit; k++)
+            found.push_back(k);
+    }else{
+        for(size_t k = text_find(s.data, s.size, from.data, from.size, 0); k != string::npos && (long long)found.size() < limit; k = text_find(s.data, s.size, from.data, from.size, k + from.size))
+            found.push_back(k);
+    }
+    if(found.empty())
+        return args[0];
+    string r;
+    r.resize(s.size + found.size() * to.size - found.size() * from.size);
+    char *out = &r[0];
+    size_t piece = 0;
+    for(size_t k : found){
+        memcpy(out, s.data + piece, k - piece);
+        out += k - piece;
+        memcpy(out, to.data, to.size);
+        out += to.size;
+        piece = k + from.size;
+    }
+    memcpy(out, s.data + piece, s.size - piece);
+    return make_str(std::move(r));
+}
+
+// Two passes over the pieces: the first checks their types and adds up
+// the length, the second copies them into a string allocated once.
+value str_join(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("join", kwnames) || !method_arity("join", nargs, 1, 1))
+        return value();
+    value pieces = is_sequence(args[1]) ? args[1] : make_list(args[1]);
+    if(pieces.is_null())
+        return value();
+    text_ref sep = str_text(args[0]);
+    size_t n = sequence_length(pieces);
+    bool tuple = pieces.is(o_tuple);
+    if(!tuple && static_cast<py_list *>(pieces.as_object())->storage() != py_list::l_boxed && n > 0)
+        return raise_error("sequence item 0: expected str instance, " + type_name(sequence_item(pieces, 0)) + " found");
+    const value *items = tuple ? static_cast<py_tuple *>(pieces.as_object())->items() : static_cast<py_list *>(pieces.as_object())->boxed_items();
+    size_t total = n > 0 ? sep.size * (n - 1) : 0;
+    for(size_t i = 0; i < n; i++){
+        if(!items[i].is(o_str))
+            return raise_error("sequence item " + to_string(i) + ": expected str instance, " + type_name(items[i]) + " found");
+        total += static_cast<py_str *>(items[i].as_object())->size();
+    }
+    string r;
+    r.resize(total);
+    char *out = &r[0];
+    for(size_t i = 0; i < n; i++){
+        if(i > 0){
+            memcpy(out, sep.data, sep.size);
+            out += sep.size;
+        }
+        text_ref p = str_text(items[i]);
+        memcpy(out, p.data, p.size);
+        out += p.size;
+    }
+    return make_str(std::move(r));
+}
+
+value convert_case(const string &function, value *args, int nargs, py_tuple *kwnames, bool upper) {
+    if(!no_keywords(function, kwnames) || !method_arity(function, nargs, 0, 0))
+        return value();
+    text_ref s = str_text(args[0]);
+    string r;
+    r.resize(s.size);
+    text_convert_case(s.data, s.size, &r[0], upper);
+    return make_str(std::move(r));
+}
+
+value str_upper(value *args, int nargs, py_tuple *kwnames) {
+    return convert_case("upper", args, nargs, kwnames, true);
+}
+
+value str_lower(value *args, int nargs, py_tuple *kwnames) {
+    return convert_case("lower", args, nargs, kwnames, false);
+}
+
+// next(iterator[, default])
+value builtin_next(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("next", kwnames))
+        return value();
+    if(nargs < 1 || nargs > 2)
+        return raise_error(nargs < 1 ? "next expected at least 1 argument, got 0" : "next expected at most 2 arguments, got " + to_string(nargs));
+    if(!is_iterator(args[0]))
+        return raise_error("'" + type_name(args[0]) + "' object is not an iterator");
+    bool done;
+    value r = next_value(args[0], value::none(), &done);
+    if(r.is_null() || !done)
+        return r;
+    if(nargs == 2)
+        return args[1];
+    return stop_iteration(r);
+}
+
+value generator_send(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("send", kwnames))
+        return value();
+    if(nargs != 2)
+        return raise_error("send() takes exactly one argument (" + to_string(nargs - 1) + " given)");
+    bool done;
+    value r = resume_generator(static_cast<py_generator *>(args[0].as_object()), args[1], &done);
+    if(r.is_null() || !done)
+        return r;
+    return stop_iteration(r);
+}
+
+// Finish a generator without running it further. There are no exceptions
+// to raise inside it, so its frame is simply dropped.
+value generator_close(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("close", kwnames) || !method_arity("close", nargs, 0, 0))
+        return value();
+    py_generator *g = static_cast<py_generator *>(args[0].as_object());
+    if(g->running)
+        return raise_error(string(g->coroutine ? "coroutine" : "generator") + " already executing");
+    g->finished = true;
+    vector<value>().swap(g->frame);
+    return value::none();
+}
+
+value dict_get(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("get", kwnames) || !method_arity("get", nargs, 1, 2) || !check_hashable(args[1]))
+        return value();
+    value *v = static_cast<py_dict *>(args[0].as_object())->items.find(args[1]);
+    if(v != NULL)
+        return *v;
+    return nargs == 3 ? args[2] : value::none();
+}
+
+// pop(key[, default])
+value dict_pop(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("pop", kwnames) || !method_arity("pop", nargs, 1, 2) || !check_hashable(args[1]))
+        return value();
+    compact_dict<value, value> &d = static_cast<py_dict *>(args[0].as_object())->items;
+    value *v = d.find(args[1]);
+    if(v == NULL)
+        return nargs == 3 ? args[2] : raise_error("KeyError: " + repr(args[1]));
+    value r = *v;
+    d.erase(args[1]);
+    return r;
+}
+
+// keys(), values() and items() give lists rather than views
+value dict_contents(const string &function, value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords(function, kwnames) || !method_arity(function, nargs, 0, 0))
+        return value();
+    py_dict *d = static_cast<py_dict *>(args[0].as_object());
+    py_list *l = new py_list();
+    value r(l);
+    l->reserve(d->items.size());
+    for(auto &e : d->items){
+        if(function == "keys")
+            l->append(e.first);
+        else if(function == "values")
+            l->append(e.second);
+        else{
+            py_tuple *t = py_tuple::make(2);
+            t->items()[0] = e.first;
+            t->items()[1] = e.second;
+            l->append(value(t));
+        }
+    }
+    return r;
+}
+
+value dict_keys(value *args, int nargs, py_tuple *kwnames) {
+    return dict_contents("keys", args, nargs, kwnames);
+}
+
+value dict_values(value *args, int nargs, py_tuple *kwnames) {
+    return dict_contents("values", args, nargs, kwnames);
+}
+
+value dict_items(value *args, int nargs, py_tuple *kwnames) {
+    return dict_contents("items", args, nargs, kwnames);
+}
+
+value set_add(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("add", kwnames))
+        return value();
+    if(nargs != 2)
+        return raise_error("add() takes exactly one argument (" + to_string(nargs - 1) + " given)");
+    if(!check_hashable(args[1]))
+        return value();
+    static_cast<py_set *>(args[0].as_object())->items.insert(args[1]);
+    return value::none();
+}
+
+// remove(x), which fails when x is missing, or discard(x), which does not
+value remove_member(const string &function, value *args, int nargs, py_tuple *kwnames, bool required) {
+    if(!no_keywords(function, kwnames) || !method_arity(function, nargs, 1, 1) || !check_hashable(args[1]))
+        return value();
+    if(static_cast<py_set *>(args[0].as_object())->items.erase(args[1]) == 0 && required)
+        return raise_error("KeyError: " + repr(args[1]));
+    return value::none();
+}
+
+value set_remove(value *args, int nargs, py_tuple *kwnames) {
+    return remove_member("remove", args, nargs, kwnames, true);
+}
+
+value set_discard(value *args, int nargs, py_tuple *kwnames) {
+    return remove_member("discard", args, nargs, kwnames, false);
+}
+
+// text without the white space around it
+text_ref strip_space(text_ref t) {
+    while(t.size > 0 && isspace((unsigned char)t.data[0])){
+        t.data++;
+        t.size--;
+    }
+    while(t.size > 0 && isspace((unsigned char)t.data[t.size - 1]))
+        t.size--;
+    return t;
+}
+
+// the signed inf, infinity and nan that float() accepts in any case
+bool parse_special_float(text_ref t, double *result) {
+    bool negative = t.size > 0 && t.data[0] == '-';
+    if(t.size > 0 && (t.data[0] == '-' || t.data[0] == '+')){
+        t.data++;
+        t.size--;
+    }
+    string name(t.data, t.size);
+    for(char &c : name)
+        c = (char)tolower((unsigned char)c);
+    if(name == "inf" || name == "infinity")
+        *result = HUGE_VAL;
+    else if(name == "nan")
+        *result = NAN;
+    else
+        return false;
+    if(negative)
+        *result = -*result;
+    return true;
+}
+
+// str() or str(object)
+value builtin_str(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("str", kwnames))
+        return value();
+    if(nargs > 1)
+        return raise_error("str expected at most 1 argument, got " + to_string(nargs));
+    if(nargs == 0)
+        return make_str("");
+    if(args[0].is(o_str))
+        return args[0];
+    string s = to_str(args[0]);
+    if(!current->error_message.empty())
+        return value();
+    return make_str(std::move(s));
+}
+
+// float(), float(number) or float(str)
+value builtin_float(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("float", kwnames))
+        return value();
+    if(nargs > 1)
+        return raise_error("float expected at most 1 argument, got " + to_string(nargs));
+    if(nargs == 0)
+        return value::from_float(0);
+    if(is_number(args[0]))
+        return value::from_float(number_of(args[0]));
+    if(!args[0].is(o_str))
+        return raise_error("float() argument must be a string or a real number, not '" + type_name(args[0]) + "'");
+    text_ref t = strip_space(str_text(args[0]));
+    double x;
+    if(!parse_float(t, &x) && !parse_special_float(t, &x))
+        return raise_error("could not convert string to float: " + quote_string(to_str(args[0])));
+    return value::from_float(x);
+}
+
+// int(), int(number) rounding toward zero, or int(str) in base 10
+value builtin_int(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("int", kwnames))
+        return value();
+    if(nargs > 1)
+        return raise_error("int expected at most 1 argument, got " + to_string(nargs));
+    if(nargs == 0)
+        return value::from_int(0);
+    if(is_integer(args[0]))
+        return value::from_int(args[0].as_int());
+    if(args[0].is_float()){
+        double x = args[0].as_float();
+        if(std::isnan(x))
+            return raise_error("cannot convert float NaN to integer");
+        if(std::isinf(x))
+            return raise_error("cannot convert float infinity to integer");
+        if(fabs(x) >= 9.2233720368547758e18)
+            return raise_error("integer overflow");
+        return value::from_int((long long)x);
+    }
+    if(!args[0].is(o_str))
+        return raise_error("int() argument must be a string or a real number, not '" + type_name(args[0]) + "'");
+    long long n;
+    bool overflow;
+    if(!parse_int(strip_space(str_text(args[0])), &n, &overflow))
+        return raise_error("invalid literal for int() with base 10: " + quote_string(to_str(args[0])));
+    if(overflow)
+        return raise_error("integer overflow");
+    return value::from_int(n);
+}
+
+// set() or set(iterable)
+value builtin_set(value *args, int nargs, py_tuple *kwnames) {
+    if(!no_keywords("set", kwnames))
+        return value();
+    if(nargs > 1)
+        return raise_error("set expected at most 1 argument, got " + to_string(nargs));
+    py_set *t = new py_set();
+    value r(t);
+    if(nargs == 1){
+        value l = make_list(args[0]);
+        if(l.is_null())
+            return value();
+        py_list *items = static_cast<py_list *>(l.as_object());
+        try{
+            t->items.reserve(items->size());
+            for(size_t i = 0; i < items->size(); i++){
+                if(!check_hashable(items->get(i)))
+                    return value();
+                t->items.insert(items->get(i));
+            }
+        }catch(const std::bad_alloc &){
+            return raise_error("MemoryError");
+        }
+    }
+    return r;
+}
+
+value builtin_sorted(value *args, int nargs, py_tuple *kwnames) {
+    value key;
+    bool reverse;
+    if(!sort_arguments("sorted", args, nargs, kwnames, &key, &reverse))
+        return value();
+    if(nargs != 1)
+        return raise_error("sorted expected 1 argument, got " + to_string(nargs));
+    value l = make_list(args[0]);
+    if(l.is_null() || !sort_list(static_cast<py_list *>(l.as_object()), key, reverse))
+        return value();
+    return l;
+}
+
+interpreter::interpreter() : call_depth(0), shape_count(0), class_version_count(0), out(&cout),
+    deadline(chrono::steady_clock::time_point::max()), ticks(tick_interval) {
+    init_builtins();
+}
+
+bool interpreter::on_time() {
+    ticks = tick_interval;
+    if(chrono::steady_clock::now() < deadline)
+        return true;
+    raise_error("TimeoutError: script ran past its time limit");
+    return false;
+}
+
+// The objects an interpreter made go before the free lists of its
+// thread are given back.
+interpreter::~interpreter() {
+    interpreter *outer = current;
+    current = this;
+    var_table.clear();
+    module_cache.clear();
+    builtin_table.clear();
+    list_methods.clear();
+    str_methods.clear();
+    generator_methods.clear();
+    dict_methods.clear();
+    set_methods.clear();
+    for(int n = 0; n <= py_tuple::max_free_tuple; n++){
+        while(tuple_free_list[n] != NULL){
+            void *block = tuple_free_list[n];
+            tuple_free_list[n] = *static_cast<void **>(block);
+            ::operator delete(block);
+        }
+        tuple_free_count[n] = 0;
+    }
+    current = outer;
+}
+
+void interpreter::init_builtins() {
+    builtin_table[intern("print")] = value(new py_builtin("print", builtin_print));
+    builtin_table[intern("range")] = value(new py_builtin("range", builtin_range));
+    builtin_table[intern("len")] = value(new py_builtin("len", builtin_len));
+    builtin_table[intern("sorted")] = value(new py_builtin("sorted", builtin_sorted));
+    builtin_table[intern("abs")] = value(new py_builtin("abs", builtin_abs));
+    builtin_table[intern("min")] = value(new py_builtin("min", builtin_min));
+    builtin_table[intern("max")] = value(new py_builtin("max", builtin_max));
+    builtin_table[intern("next")] = value(new py_builtin("next", builtin_next));
+    builtin_table[intern("set")] = value(new py_builtin("set", builtin_set));
+    builtin_table[intern("float")] = value(new py_builtin("float", builtin_float));
+    builtin_table[intern("int")] = value(new py_builtin("int", builtin_int));
+    builtin_table[intern("str")] = value(new py_builtin("str", builtin_str));
+    list_methods[intern("sort")] = value(new py_builtin("sort", list_sort));
+    list_methods[intern("append")] = value(new py_builtin("append", list_append));
+    str_methods[intern("find")] = value(new py_builtin("find", str_find));
+    str_methods[intern("count")] = value(new py_builtin("count", str_count));
+    str_methods[intern("split")] = value(new py_builtin("split", str_split));
+    str_methods[intern("replace")] = value(new py_builtin("replace", str_replace));
+    str_methods[intern("join")] = value(new py_builtin("join", str_join));
+    str_methods[intern("upper")] = value(new py_builtin("upper", str_upper));
+    str_methods[intern("lower")] = value(new py_builtin("lower", str_lower));
+    generator_methods[intern("send")] = value(new py_builtin("send", generator_send));
+    generator_methods[intern("close")] = value(new py_builtin("close", generator_close));
+    dict_methods[intern("get")] = value(new py_builtin("get", dict_get));
+    dict_methods[intern("keys")] = value(new py_builtin("keys", dict_keys));
+    dict_methods[intern("values")] = value(new py_builtin("values", dict_values));
+    dict_methods[intern("items")] = value(new py_builtin("items", dict_items));
+    dict_methods[intern("pop")] = value(new py_builtin("pop", dict_pop));
+    set_methods[intern("add")] = value(new py_builtin("add", set_add));
+    set_methods[intern("remove")] = value(new py_builtin("remove", set_remove));
+    set_methods[intern("discard")] = value(new py_builtin("discard", set_discard));
+}
+
+// Compile a script to the code of its module; null after printing the
+// error
+code_object* compile_script(istream &source) {
+	token_parser parser(source);
+	parser.parse_tokens();
+    script_parser syntax(remove_whitespace(parser.get_token_vector()));
+    ast_node *program = syntax.parse_program();
+    if(program == NULL){
+        *current->out << "error: " << syntax.get_error() << endl;
+        return NULL;
+    }
+    compiler c;
+    code_object *module = c.compile_module(program);
+    if(module == NULL)
+        *current->out << "error: " << c.get_error() << endl;
+    return module;
+}
+
+// lex, parse, compile and run one script
+int run_script(istream &source, bool dump_tokens) {
+    if(dump_tokens){
+        token_parser parser(source);
+        parser.parse_tokens();
+        parser.print_tokens();
+        return 0;
+    }
+    unique_ptr<code_object> module(compile_script(source));
+    if(!module)
+        return -1;
+    if(!run_code(module.get())){
+        *current->out << "error: " << current->error_message << endl;
+        return -1;
+    }
+    return 0;
+}
+
+// Put the interpreter back as it was before any script ran: no globals
+// and no error. The builtins, shapes, compiled code and the free lists of
+// the thread stay, warmed up for the next script.
+void interpreter::reset() {
+    var_table.clear();
+    error_message.clear();
+    call_depth = 0;
+}
+
+value restore_module(const string &key, const string &text);
+
+// The module code of the text of a script, compiled (or restored from
+// an image) the first time it comes round under key; null if it does
+// not compile. Text that comes round again runs the code compiled for it
+// before, inline caches and all: they check shape ids and class
+// versions, which an interpreter never reuses.
+value compile_cached(const string &key, string &&text) {
+    cached_module &cached = current->module_cache[key];
+    if(cached.code.is_null() || cached.source != text){
+        value module = restore_module(key, text);
+        if(module.is_null()){
+            istringstream source(text);
+            code_object *compiled = compile_script(source);
+            if(compiled == NULL){
+                current->module_cache.erase(key);
+                return value();
+            }
+            module = value(compiled);
+        }
+        cached.source = std::move(text);
+        cached.code = module;
+    }
+    return cached.code;
+}
+
+// Run the text of a script on the current interpreter, reset first;
+// false if it could not be compiled or run.
+bool run_cached(const string &key, string &&text) {
+    current->reset();
+    value code = compile_cached(key, std::move(text));
+    if(code.is_null())
+        return false;
+    if(!run_code(static_cast<code_object *>(code.as_object()))){
+        *current->out << "error: " << current->error_message << endl;
+        return false;
+    }
+    return true;
+}
+
+// path made absolute, the key of a script in the module cache whichever
+// directory it is named from; path itself if it does not resolve
+string full_path(const string &path) {
+    char full[PATH_MAX];
+    return realpath(path.c_str(), full) != NULL ? string(full) : path;
+}
+
+// run one script of a batch, by path; false if it could not be read,
+// compiled or run
+bool run_batch_script(const string &path) {
+    ifstream source(path.c_str());
+    if(source.fail()){
+        current->reset();
+        *current->out << "An error occurred while opening " << path << endl;
+        return false;
+    }
+    string text((istreambuf_iterator<char>(source)), istreambuf_iterator<char>());
+    return run_cached(path, std::move(text));
+}
+
+// what running one script of a batch printed, whether it worked and how
+// long it took
+struct batch_result {
+    string output;
+    bool ok;
+    double ms;
+    bool done;
+};
+
+double elapsed_ms(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+void report_script(const string &path, const batch_result &r) {
+    char line[64];
+    snprintf(line, sizeof(line), "%s %.3f ms", r.ok ? "ok" : "failed", r.ms);
+    cerr << path << ": " << line << endl;
+}
+
+// Run paths on jobs threads, each with an interpreter of its own taking
+// the next script not yet started. What a script prints is held until
+// everything before it has been written, so the output is the same as
+// running them in order.
+void run_batch_parallel(const vector<string> &paths, int jobs, vector<batch_result> &results) {
+    mutex lock;
+    condition_variable finished;
+    atomic<size_t> next(0);
+    auto work = [&]() {
+        interpreter local;
+        current = &local;
+        ostringstream output;
+        local.out = &output;
+        size_t i;
+        while((i = next++) < paths.size()){
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            bool ok = run_batch_script(paths[i]);
+            double ms = elapsed_ms(start);
+            lock_guard<mutex> hold(lock);
+            results[i].output = output.str();
+            results[i].ok = ok;
+            results[i].ms = ms;
+            results[i].done = true;
+            output.str("");
+            finished.notify_one();
+        }
+    };
+    vector<thread> workers;
+    for(int j = 0; j < jobs; j++)
+        workers.push_back(thread(work));
+    for(size_t i = 0; i < paths.size(); i++){
+        unique_lock<mutex> hold(lock);
+        finished.wait(hold, [&]() { return results[i].done; });
+        string output = std::move(results[i].output);
+        hold.unlock();
+        cout << output;
+        cout.flush();
+        report_script(paths[i], results[i]);
+    }
+    for(thread &w : workers)
+        w.join();
+}
+
+// Script paths from the command line, where an argument @file names a
+// manifest of paths, one a line; false if a manifest cannot be read.
+bool script_paths(const vector<string> &arguments, vector<string> &paths) {
+    for(const string &a : arguments){
+        if(a.empty() || a[0] != '@'){
+            paths.push_back(a);
+            continue;
+        }
+        ifstream manifest(a.substr(1).c_str());
+        if(manifest.fail()){
+            cout << "An error occurred while opening " << a.substr(1) << endl;
+            return false;
+        }
+        string line;
+        while(getline(manifest, line)){
+            text_ref t = strip_space(text_ref{line.data(), line.size()});
+            if(t.size > 0 && t.data[0] != '#')
+                paths.push_back(string(t.data, t.size));
+        }
+    }
+    return true;
+}
+
+// --batch: run each script in turn in this one process, reporting how
+// long each took on stderr. With jobs above one the scripts are spread
+// over that many threads.
+int run_batch(const vector<string> &arguments, int jobs) {
+    vector<string> paths;
+    if(!script_paths(arguments, paths))
+        return -1;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<batch_result> results(paths.size());
+    if(jobs > 1 && paths.size() > 1){
+        run_batch_parallel(paths, min(jobs, (int)paths.size()), results);
+    }else{
+        for(size_t i = 0; i < paths.size(); i++){
+            chrono::steady_clock::time_point script_start = chrono::steady_clock::now();
+            results[i].ok = run_batch_script(paths[i]);
+            cout.flush();
+            results[i].ms = elapsed_ms(script_start);
+            report_script(paths[i], results[i]);
+        }
+    }
+    int failed = 0;
+    double total = 0;
+    for(const batch_result &r : results){
+        total += r.ms;
+        failed += !r.ok;
+    }
+    char summary[128];
+    snprintf(summary, sizeof(summary), "%zu scripts, %d failed, %.3f ms, %.3f ms elapsed", paths.size(), failed, total, elapsed_ms(start));
+    cerr << summary << endl;
+    return failed > 0 ? -1 : 0;
+}
+
+// --snapshot and --image: compiled scripts written to a file and mapped
+// back in at startup, so a script compiled once starts later without
+// being lexed, parsed or compiled again. Interpreter objects hold
+// vtables, std::strings and vectors, none of which can be mapped in
+// place, so the image is a flat, position independent encoding of the
+// code: counts, bytes and raw instruction arrays, which restoring copies
+// straight out of the mapping. Startup maps the file and reads only its
+// index; a module is decoded, and its pages touched, when a script with
+// its path and source is first looked up. Names are
+// interned as they are read. The builtins are native functions that
+// init_builtins sets up in microseconds and are not saved.
+//
+//   header  "MPYIMAGE", build identity, module count
+//   index   for each module its path, the offset and size of its source
+//           and the offset, size and checksum of its code, from the end
+//           of the index
+//   code    name, instructions, constants, names, stack size, argument
+//           count, varnames, cellnames, freenames, cell_args, the
+//           number of each kind of inline cache, generator, coroutine
+//   value   a tag, then an int, a float, a string, a code or the items
+//           of a tuple
+//
+// Strings are a 32-bit length and their bytes. Numbers and instructions
+// are stored as this machine lays them out: an image is only mapped by
+// the build that wrote it. A module's code is restored only if its
+// checksum matches, and then every count is checked against the bytes
+// left and every operand against what the code has (operands_valid).
+
+// 64-bit FNV-1a
+uint64_t fnv_hash(const char *data, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < n; i++)
+        h = (h ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+// A hash identifying this build: when and by which compiler it was
+// compiled, and the layouts an image copies raw. Any change to the
+// compiler's output means a rebuild, so an image never outlives it.
+uint64_t build_identity() {
+    string build = string(__DATE__ " " __TIME__ " " __VERSION__) + " " + to_string(sizeof(instruction)) + " "
+        + to_string(sizeof(value)) + " " + to_string(sizeof(void *)) + " " + to_string((int)op_return);
+    return fnv_hash(build.data(), build.size());
+}
+
+typedef enum {i_none, i_false, i_true, i_int, i_float, i_str, i_code, i_tuple} image_tag;
+
+// where a module's source and code are in the image
+struct image_module {
+    uint64_t source;
+    uint64_t source_size;
+    uint64_t code;
+    uint64_t code_size;
+    uint64_t checksum;
+};
+
+// the image given with --image, mapped for the life of the process, and
+// its index; both are set up before any thread starts and only read
+// afterwards
+const char *image_data = NULL;
+size_t image_size = 0;
+size_t image_modules = 0;
+compact_dict<istr, image_module> image_index;
+
+class image_writer
+{
+    public:
+        string bytes;
+        template <class T> void put(T x) { bytes.append(reinterpret_cast<const char *>(&x), sizeof(x)); };
+        void put_str(text_ref s) { put<uint32_t>(s.size); bytes.append(s.data, s.size); };
+        void put_str(const string &s) { put_str(text_ref{s.data(), s.size()}); };
+        bool put_value(const value &v);
+        bool put_code(code_object *code);
+};
+
+bool image_writer::put_value(const value &v) {
+    if(v.is_none()){
+        put<uint8_t>(i_none);
+    }else if(v.is_bool()){
+        put<uint8_t>(v.as_int() ? i_true : i_false);
+    }else if(v.is_int()){
+        put<uint8_t>(i_int);
+        put<int64_t>(v.as_int());
+    }else if(v.is_float()){
+        put<uint8_t>(i_float);
+        put<double>(v.as_float());
+    }else if(v.is(o_str)){
+        put<uint8_t>(i_str);
+        put_str(static_cast<py_str *>(v.as_object())->text());
+    }else if(v.is(o_code)){
+        put<uint8_t>(i_code);
+        return put_code(static_cast<code_object *>(v.as_object()));
+    }else if(v.is(o_tuple)){
+        py_tuple *t = static_cast<py_tuple *>(v.as_object());
+        put<uint8_t>(i_tuple);
+        put<uint32_t>(t->length);
+        for(size_t i = 0; i < t->length; i++)
+            if(!put_value(t->items()[i]))
+                return false;
+    }else{
+        return false;
+    }
+    return true;
+}
+
+bool image_writer::put_code(code_object *code) {
+    put_str(code->name);
+    put<uint32_t>(code->code.size());
+    bytes.append(reinterpret_cast<const char *>(code->code.data()), code->code.size() * sizeof(instruction));
+    put<uint32_t>(code->constants.size());
+    for(const value &c : code->constants)
+        if(!put_value(c))
+            return false;
+    put<uint32_t>(code->names.size());
+    for(istr n : code->names)
+        put_str(n.str());
+    put<int32_t>(code->stack_size);
+    put<int32_t>(code->argcount);
+    const vector<string> *lists[] = {&code->varnames, &code->cellnames, &code->freenames};
+    for(const vector<string> *l : lists){
+        put<uint32_t>(l->size());
+        for(const string &s : *l)
+            put_str(s);
+    }
+    put<uint32_t>(code->cell_args.size());
+    for(int a : code->cell_args)
+        put<int32_t>(a);
+    put<uint32_t>(code->caches.size());
+    put<uint32_t>(code->method_caches.size());
+    put<uint32_t>(code->call_caches.size());
+    put<uint8_t>(code->generator);
+    put<uint8_t>(code->coroutine);
+    return true;
+}
+
+// Does every operand of code's instructions name something the code has:
+// a constant, name, local, cell, inline cache, operator or instruction?
+// Operands that are counts of stack values must fit the stack. Stack use
+// itself is not re-verified; the compiler of this build emitted it.
+bool operands_valid(const code_object *code) {
+    size_t n = code->code.size(), cells = code->cellnames.size() + code->freenames.size();
+    size_t stack = (size_t)code->stack_size;
+    if(n == 0 || code->stack_size < 0 || code->argcount < 0 || (size_t)code->argcount > code->varnames.size()
+        || code->cell_args.size() != code->cellnames.size())
+        return false;
+    for(int a : code->cell_args)
+        if(a < -1 || a >= (int)code->varnames.size())
+            return false;
+    for(const instruction &i : code->code){
+        size_t arg = (size_t)(unsigned)i.arg;
+        bool ok = i.arg >= 0;
+        switch(i.op){
+        case op_load_const:
+            ok = ok && arg < code->constants.size();
+            break;
+        case op_build_class:
+            ok = ok && arg < code->constants.size() && code->constants[arg].is(o_str);
+            break;
+        case op_load_global:
+        case op_store_global:
+        case op_store_class_attr:
+            ok = ok && arg < code->names.size();
+            break;
+        case op_load_attr:
+        case op_store_attr:
+            ok = ok && arg < code->names.size() && (i.sub == no_cache || i.sub < code->caches.size());
+            break;
+        case op_load_method:
+            ok = ok && arg < code->names.size() && (i.sub == no_cache || i.sub < code->method_caches.size());
+            break;
+        case op_load_fast:
+        case op_store_fast:
+            ok = ok && arg < code->varnames.size();
+            break;
+        case op_inplace_fast:
+            ok = ok && arg < code->varnames.size() && i.sub <= b_xor;
+            break;
+        case op_load_deref:
+        case op_store_deref:
+        case op_load_closure:
+            ok = ok && arg < cells;
+            break;
+        case op_binary:
+        case op_inplace:
+            ok = i.sub <= b_xor;
+            break;
+        case op_compare:
+            ok = i.sub <= c_not_in;
+            break;
+        case op_compare_jump:
+            ok = ok && arg < n && i.sub < 16;
+            break;
+        case op_pop_jump_if_false:
+        case op_pop_jump_if_true:
+        case op_jump_if_false_or_pop:
+        case op_jump_if_true_or_pop:
+        case op_for_iter:
+        case op_for_iter_range:
+        case op_for_iter_list:
+        case op_jump:
+            ok = ok && arg < n;
+            break;
+        case op_call:
+            ok = ok && arg + 1 <= stack;
+            break;
+        case op_call_method:
+            ok = ok && arg + 2 <= stack;
+            break;
+        case op_call_kw:
+            ok = ok && arg + 2 <= stack && (i.sub == no_cache || i.sub < code->call_caches.size());
+            break;
+        case op_call_method_kw:
+            ok = ok && arg + 3 <= stack && (i.sub == no_cache || i.sub < code->call_caches.size());
+            break;
+        case op_make_function:
+            ok = ok && i.sub <= 1 && arg + 1 + i.sub <= stack;
+            break;
+        case op_build_map:
+            ok = ok && 2 * arg <= stack;
+            break;
+        case op_copy:
+            ok = ok && 2 * arg <= stack;
+            break;
+        case op_list_append:
+        case op_set_add:
+            ok = ok && arg + 1 <= stack;
+            break;
+        case op_map_add:
+            ok = ok && arg + 2 <= stack;
+            break;
+        case op_build_list:
+        case op_build_tuple:
+        case op_build_set:
+        case op_unpack_sequence:
+        case op_reverse:
+        case op_rotate:
+            ok = ok && arg <= stack;
+            break;
+        default:
+            ok = i.op <= op_return;
+            break;
+        }
+        if(!ok)
+            return false;
+    }
+    return code->code.back().op == op_return || code->code.back().op == op_jump;
+}
+
+// Reads an image, checking every count against the bytes left, so a
+// truncated or damaged image fails instead of reading past the end.
+class image_reader
+{
+    private:
+        const char *p, *end;
+    public:
+        bool ok;
+        image_reader(const char *data, size_t size) : p(data), end(data + size), ok(true) { };
+        template <class T> T get();
+        size_t get_count(size_t item_size);
+        text_ref get_bytes(size_t n);
+        string get_str() { uint32_t n = get<uint32_t>(); text_ref t = get_bytes(n); return string(t.data, t.size); };
+        value get_value();
+        value get_code();
+        size_t remaining() const { return end - p; };
+};
+
+template <class T>
+T image_reader::get() {
+    T x = T();
+    if(ok && (size_t)(end - p) >= sizeof(T)){
+        memcpy(&x, p, sizeof(T));
+        p += sizeof(T);
+    }else{
+        ok = false;
+    }
+    return x;
+}
+
+// a count of items that each take at least item_size bytes of the image
+size_t image_reader::get_count(size_t item_size) {
+    size_t n = get<uint32_t>();
+    if(n * item_size > (size_t)(end - p))
+        ok = false;
+    return ok ? n : 0;
+}
+
+text_ref image_reader::get_bytes(size_t n) {
+    text_ref t = {p, 0};
+    if(ok && (size_t)(end - p) >= n){
+        t.size = n;
+        p += n;
+    }else{
+        ok = false;
+    }
+    return t;
+}
+
+value image_reader::get_value() {
+    switch(get<uint8_t>()){
+    case i_none:
+        return value::none();
+    case i_false:
+        return value::from_bool(false);
+    case i_true:
+        return value::from_bool(true);
+    case i_int:
+        return value::from_int(get<int64_t>());
+    case i_float:
+        return value::from_float(get<double>());
+    case i_str:
+        return make_str(get_str());
+    case i_code:
+        return get_code();
+    case i_tuple:{
+        size_t n = get_count(1);
+        py_tuple *t = py_tuple::make(n);
+        value result(t);
+        for(size_t i = 0; i < n && ok; i++)
+            t->items()[i] = get_value();
+        return ok ? result : value();
+    }
+    default:
+        ok = false;
+        return value();
+    }
+}
+
+value image_reader::get_code() {
+    code_object *code = new code_object(get_str());
+    value result(code);
+    size_t n = get_count(sizeof(instruction));
+    text_ref instructions = get_bytes(n * sizeof(instruction));
+    if(!ok)
+        return value();
+    code->code.resize(n);
+    if(n > 0)
+        memcpy(code->code.data(), instructions.data, instructions.size);
+    n = get_count(1);
+    code->constants.reserve(n);
+    for(size_t i = 0; i < n && ok; i++)
+        code->constants.push_back(get_value());
+    n = get_count(sizeof(uint32_t));
+    code->names.reserve(n);
+    for(size_t i = 0; i < n && ok; i++)
+        code->names.push_back(intern(get_str()));
+    code->stack_size = get<int32_t>();
+    code->argcount = get<int32_t>();
+    vector<string> *lists[] = {&code->varnames, &code->cellnames, &code->freenames};
+    for(vector<string> *l : lists){
+        n = get_count(sizeof(uint32_t));
+        for(size_t i = 0; i < n && ok; i++)
+            l->push_back(get_str());
+    }
+    n = get_count(sizeof(int32_t));
+    for(size_t i = 0; i < n && ok; i++)
+        code->cell_args.push_back(get<int32_t>());
+    size_t caches = get<uint32_t>(), method_caches = get<uint32_t>(), call_caches = get<uint32_t>();
+    if(caches > no_cache || method_caches > no_cache || call_caches > no_cache)
+        ok = false;
+    if(!ok)
+        return value();
+    attr_cache empty = {0, 0, NULL};
+    code->caches.resize(caches, empty);
+    method_cache empty_method = {-1, 0, 0, NULL};
+    code->method_caches.resize(method_caches, empty_method);
+    code->call_caches.resize(call_caches);
+    code->generator = get<uint8_t>() != 0;
+    code->coroutine = get<uint8_t>() != 0;
+    if(ok && !operands_valid(code))
+        ok = false;
+    return ok ? result : value();
+}
+
+// Save the module cache of the current interpreter to path, written to
+// a temporary file first so that a running process never maps half an
+// image.
+bool write_image(const string &path) {
+    image_writer index, modules;
+    index.bytes.append("MPYIMAGE", 8);
+    index.put<uint64_t>(build_identity());
+    index.put<uint32_t>(current->module_cache.size());
+    for(auto &e : current->module_cache){
+        index.put_str(e.first.str());
+        index.put<uint64_t>(modules.bytes.size());
+        index.put<uint64_t>(e.second.source.size());
+        modules.bytes.append(e.second.source);
+        size_t start = modules.bytes.size();
+        index.put<uint64_t>(start);
+        if(!modules.put_code(static_cast<code_object *>(e.second.code.as_object()))){
+            cout << "Cannot save the code of " << e.first.str() << endl;
+            return false;
+        }
+        index.put<uint64_t>(modules.bytes.size() - start);
+        index.put<uint64_t>(fnv_hash(modules.bytes.data() + start, modules.bytes.size() - start));
+    }
+    string temporary = path + ".tmp";
+    ofstream out(temporary.c_str(), ios_base::binary);
+    out.write(index.bytes.data(), index.bytes.size());
+    out.write(modules.bytes.data(), modules.bytes.size());
+    out.close();
+    if(out.fail() || rename(temporary.c_str(), path.c_str()) != 0){
+        cout << "An error occurred while writing " << path << endl;
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// map the image at path, if it was written by this build, and read its
+// index
+bool map_image(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) < 0){
+        cout << "An error occurred while opening " << path << endl;
+        if(fd >= 0)
+            close(fd);
+        return false;
+    }
+    void *data = info.st_size > 0 ? mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    size_t size = data == MAP_FAILED ? 0 : info.st_size;
+    image_reader header(static_cast<const char *>(data), size);
+    text_ref magic = header.get_bytes(8);
+    uint64_t build = header.get<uint64_t>();
+    size_t modules = header.get_count(sizeof(uint32_t) + 5 * sizeof(uint64_t));
+    for(size_t m = 0; m < modules && header.ok; m++){
+        string name = header.get_str();
+        image_module &module = image_index[name];
+        module.source = header.get<uint64_t>();
+        module.source_size = header.get<uint64_t>();
+        module.code = header.get<uint64_t>();
+        module.code_size = header.get<uint64_t>();
+        module.checksum = header.get<uint64_t>();
+    }
+    if(!header.ok || memcmp(magic.data, "MPYIMAGE", 8) != 0 || build != build_identity()){
+        cout << path << " is not an image written by this build" << endl;
+        if(data != MAP_FAILED)
+            munmap(data, size);
+        image_index.clear();
+        return false;
+    }
+    image_data = static_cast<const char *>(data);
+    image_size = size;
+    image_modules = size - header.remaining();
+    return true;
+}
+
+// The module code the image holds for the script at key, if it was
+// compiled from this same text; null when it was not, or when that part
+// of the image is cut short or damaged, which like a stale .pyc only
+// means compiling as usual.
+value restore_module(const string &key, const string &text) {
+    if(image_data == NULL)
+        return value();
+    // the image has full paths, a batch the paths as they were given
+    image_module *m = image_index.find(full_path(key));
+    size_t size = image_size - image_modules;
+    if(m == NULL || m->source > size || m->source_size > size - m->source || m->code > size
+        || m->code_size > size - m->code)
+        return value();
+    const char *modules = image_data + image_modules;
+    if(!equal_text(text_ref{modules + m->source, (size_t)m->source_size}, text_ref{text.data(), text.size()}))
+        return value();
+    if(fnv_hash(modules + m->code, m->code_size) != m->checksum)
+        return value();
+    image_reader r(modules + m->code, m->code_size);
+    value code = r.get_code();
+    return r.ok ? code : value();
+}
+
+// --snapshot: compile scripts and save them as an image to start later
+// runs from
+int snapshot(const string &path, const vector<string> &scripts) {
+    vector<string> paths;
+    if(!script_paths(scripts, paths))
+        return -1;
+    for(const string &p : paths){
+        ifstream source(p.c_str());
+        if(source.fail()){
+            cout << "An error occurred while opening " << p << endl;
+            return -1;
+        }
+        string text((istreambuf_iterator<char>(source)), istreambuf_iterator<char>());
+        if(compile_cached(full_path(p), std::move(text)).is_null())
+            return -1;
+    }
+    return write_image(path) ? 0 : -1;
+}
+
+// --serve: a daemon that runs scripts for clients of a Unix socket, so a
+// short script costs a round trip instead of starting a process. The
+// requests and replies are described in connection.h. A pool of worker
+// threads, each with an interpreter of its own, takes requests: a worker
+// is held for one request, not for a connection, and connections
+// waiting for their next request are watched with poll by the thread
+// that accepts them.
+
+// Where print writes while serving: what a script prints goes to the
+// client in out frames, whenever the buffer fills or the stream is
+// flushed. A client that has gone away stops getting output, but the
+// script still runs to the end.
+class frame_buffer : public streambuf
+{
+    private:
+        connection &client;
+        char buffer[4096];
+        bool send_frame();
+    public:
+        frame_buffer(connection &c) : client(c) { setp(buffer, buffer + sizeof(buffer)); };
+    protected:
+        int_type overflow(int_type c);
+        int sync() { return send_frame() ? 0 : -1; };
+};
+
+bool frame_buffer::send_frame() {
+    size_t n = pptr() - pbase();
+    setp(buffer, buffer + sizeof(buffer));
+    if(n == 0)
+        return true;
+    string header = "out " + to_string(n) + "\n";
+    return client.write_all(header.data(), header.size()) && client.write_all(buffer, n);
+}
+
+frame_buffer::int_type frame_buffer::overflow(int_type c) {
+    send_frame();
+    if(c != traits_type::eof()){
+        *pptr() = (char)c;
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+// How long a script may run when serving, in seconds (0 for no limit),
+// and how long a connection has to send the whole of its next request.
+int time_limit = 30;
+const int idle_limit = 60;
+
+// the longest request line and source a server accepts, and so the most
+// a connection has buffered before its request is complete
+enum { max_request_line = 8192, max_source_size = 1 << 24 };
+const size_t max_request = max_request_line + 1 + max_source_size;
+
+// the n of a "source <n>" request line, or false if it has none
+bool source_size(const string &line, size_t *n) {
+    if(line.compare(0, 7, "source ") != 0 || line.size() == 7 || line.size() > 15)
+        return false;
+    *n = 0;
+    for(size_t i = 7; i < line.size(); i++){
+        if(line[i] < '0' || line[i] > '9')
+            return false;
+        *n = *n * 10 + (size_t)(line[i] - '0');
+    }
+    return *n <= max_source_size;
+}
+
+// Does what client has buffered hold a whole request? 1 when it does, 0
+// when more has to come first, and -1 when it is not a request or is
+// over the limits.
+int request_state(const connection &client) {
+    size_t n = client.pending_size();
+    const char *data = client.pending();
+    const char *newline = static_cast<const char *>(memchr(data, '\n', min(n, (size_t)max_request_line + 1)));
+    if(newline == NULL)
+        return n > max_request_line ? -1 : 0;
+    string line(data, newline - data);
+    if(line.compare(0, 4, "run ") == 0)
+        return 1;
+    size_t size;
+    if(!source_size(line, &size))
+        return -1;
+    return n - line.size() - 1 >= size ? 1 : 0;
+}
+
+// Read from client until it has sent a whole request, giving up at
+// deadline; false if it hangs up first or sends something else.
+bool wait_for_request(connection &client, chrono::steady_clock::time_point deadline) {
+    while(true){
+        int state = request_state(client);
+        if(state != 0)
+            return state > 0;
+        long long wait = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        if(wait <= 0 || client.receive((int)wait, max_request) < 0)
+            return false;
+    }
+}
+
+// Answer the request a client has sent whole (see request_state),
+// running the script under time_limit; false when the connection should
+// be closed.
+bool serve_request(connection &client) {
+    string line, text;
+    size_t size;
+    if(!client.read_line(line))
+        return false;
+    frame_buffer frames(client);
+    ostream out(&frames);
+    current->out = &out;
+    if(time_limit > 0)
+        current->deadline = chrono::steady_clock::now() + chrono::seconds(time_limit);
+    bool ok, understood = true;
+    if(line.compare(0, 4, "run ") == 0){
+        ok = run_batch_script(line.substr(4));
+    }else if(source_size(line, &size) && client.read_bytes(size, text)){
+        ok = run_cached("<source>", std::move(text));
+    }else{
+        ok = understood = false;
+    }
+    current->deadline = chrono::steady_clock::time_point::max();
+    current->out = &cout;
+    if(!understood)
+        return false;
+    out.flush();
+    string status = ok ? "exit 0\n" : "exit 255\n";
+    return client.write_all(status.data(), status.size());
+}
+
+// Connections with a request to answer, waiting for a worker, and those
+// a worker has answered, waiting to be watched for their next request.
+// Handing one back writes a byte to a pipe, which wakes the poll.
+class connection_queue
 {
-    std::string buffer_string = "";
+    private:
+        mutex lock;
+        condition_variable ready;
+        deque<connection *> waiting;
+        vector<connection *> answered;
+        int wake[2];
+    public:
+        connection_queue() { if(pipe(wake) < 0) wake[0] = wake[1] = -1; };
+        int wake_fd() const { return wake[0]; };
+        void push(connection *c);
+        connection *pop();
+        void hand_back(connection *c);
+        void take_answered(vector<connection *> &into);
+};
+
+void connection_queue::push(connection *c) {
+    lock_guard<mutex> hold(lock);
+    waiting.push_back(c);
+    ready.notify_one();
+}
+
+connection *connection_queue::pop() {
+    unique_lock<mutex> hold(lock);
+    ready.wait(hold, [this]() { return !waiting.empty(); });
+    connection *c = waiting.front();
+    waiting.pop_front();
+    return c;
+}
 
-    std::fstream file_stream;
-    std::string current_readline;
-    file_stream.open(file_path, std::fstream::in); //open the file in input mode
+void connection_queue::hand_back(connection *c) {
+    lock_guard<mutex> hold(lock);
+    answered.push_back(c);
+    char byte = 0;
+    if(write(wake[1], &byte, 1) < 0){
+        // the pipe is full of wake ups already
+    }
+}
+
+void connection_queue::take_answered(vector<connection *> &into) {
+    char bytes[256];
+    while(read(wake[0], bytes, sizeof(bytes)) == (ssize_t)sizeof(bytes)){
+    }
+    lock_guard<mutex> hold(lock);
+    into.insert(into.end(), answered.begin(), answered.end());
+    answered.clear();
+}
+
+// a socket listening at path, or -1
+int listen_on(const string &path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path)){
+        cout << "Socket path too long: " << path << endl;
+        return -1;
+    }
+    strcpy(address.sun_path, path.c_str());
+    // a socket left behind by a daemon that is gone
+    struct stat info;
+    if(stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+        unlink(path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0 || ::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(listener, 128) < 0){
+        cout << "Cannot listen on " << path << ": " << strerror(errno) << endl;
+        return -1;
+    }
+    return listener;
+}
+
+int serve(const string &path, int jobs) {
+    int listener = listen_on(path);
+    if(listener < 0)
+        return -1;
+    connection_queue queue;
+    if(queue.wake_fd() < 0){
+        cout << "pipe failed: " << strerror(errno) << endl;
+        return -1;
+    }
+    fcntl(queue.wake_fd(), F_SETFL, O_NONBLOCK);
+    vector<thread> workers;
+    for(int j = 0; j < jobs; j++){
+        workers.push_back(thread([&queue]() {
+            interpreter local;
+            current = &local;
+            while(true){
+                connection *client = queue.pop();
+                int next = serve_request(*client) ? request_state(*client) : -1;
+                if(next < 0)
+                    delete client;
+                else if(next > 0)
+                    queue.push(client); // the next request is already here
+                else
+                    queue.hand_back(client);
+            }
+        }));
+    }
+    // The connections waiting for a whole request, and since when each
+    // has waited. Workers only get connections with a whole request
+    // buffered, so a client that stalls part way through holds none.
+    vector<connection *> idle;
+    vector<chrono::steady_clock::time_point> since;
+    vector<pollfd> polled;
+    vector<connection *> answered;
+    while(true){
+        polled.assign(2, pollfd());
+        polled[0].fd = listener;
+        polled[1].fd = queue.wake_fd();
+        polled[0].events = polled[1].events = POLLIN;
+        for(connection *c : idle){
+            pollfd p = {c->descriptor(), POLLIN, 0};
+            polled.push_back(p);
+        }
+        if(poll(polled.data(), polled.size(), 1000) < 0 && errno != EINTR)
+            break;
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        // read what has arrived; a connection with a whole request goes to
+        // a worker, and one that hung up, sent something else or took too
+        // long is closed
+        size_t kept = 0;
+        for(size_t k = 0; k < idle.size(); k++){
+            int state = 0;
+            if(polled[k + 2].revents != 0)
+                state = idle[k]->receive(0, max_request) < 0 ? -1 : request_state(*idle[k]);
+            if(state > 0){
+                queue.push(idle[k]);
+            }else if(state < 0 || now - since[k] > chrono::seconds(idle_limit)){
+                delete idle[k];
+            }else{
+                idle[kept] = idle[k];
+                since[kept++] = since[k];
+            }
+        }
+        idle.resize(kept);
+        since.resize(kept);
+        if(polled[1].revents != 0){
+            answered.clear();
+            queue.take_answered(answered);
+            for(connection *c : answered){
+                idle.push_back(c);
+                since.push_back(now);
+            }
+        }
+        if(polled[0].revents != 0){
+            int fd = accept(listener, NULL, NULL);
+            if(fd >= 0){
+                // a client usually sends its request straight away
+                connection *c = new connection(fd);
+                int state = c->receive(0, max_request) < 0 ? -1 : request_state(*c);
+                if(state > 0){
+                    queue.push(c);
+                }else if(state < 0){
+                    delete c;
+                }else{
+                    idle.push_back(c);
+                    since.push_back(now);
+                }
+            }else if(errno == EMFILE || errno == ENFILE){
+                // out of descriptors until idle connections time out
+                this_thread::sleep_for(chrono::milliseconds(10));
+            }else if(errno != EINTR && errno != ECONNABORTED){
+                break;
+            }
+        }
+    }
+    cout << "serve failed: " << strerror(errno) << endl;
+    close(listener);
+    // the workers wait for connections for good
+    for(thread &w : workers)
+        w.detach();
+    return -1;
+}
+
+// make v immortal, and what it refers to: the objects a warmed up
+// interpreter holds are builtins, and code with its str, tuple and code
+// constants. The parts of code that running it writes to are copied, into
+// the code arena while freeze has it open.
+void make_immortal(const value &v) {
+    if(!v.is_object() || v.as_object()->immortal())
+        return;
+    py_object *o = v.as_object();
+    o->refcount = -1;
+    if(o->type == o_tuple){
+        py_tuple *t = static_cast<py_tuple *>(o);
+        for(size_t i = 0; i < t->length; i++)
+            make_immortal(t->items()[i]);
+    }else if(o->type == o_code){
+        code_object *code = static_cast<code_object *>(o);
+        decltype(code->code)(code->code).swap(code->code);
+        decltype(code->caches)(code->caches).swap(code->caches);
+        decltype(code->method_caches)(code->method_caches).swap(code->method_caches);
+        decltype(code->call_caches)(code->call_caches).swap(code->call_caches);
+        for(const value &c : code->constants)
+            make_immortal(c);
+    }
+}
 
-    // read all the lines till the end of the file
-    while(getline(file_stream, current_readline))
-    {
-        // check if the line is empty
-        if(!current_readline.empty())
-            buffer_string = buffer_string + current_readline + "\n";
+// Make everything the interpreter holds between scripts immortal: the
+// builtins, the native methods and the compiled module code. They are
+// never freed after this.
+void interpreter::freeze() {
+    compact_dict<istr, value> *tables[] = {&builtin_table, &list_methods, &str_methods,
+        &generator_methods, &dict_methods, &set_methods};
+    for(compact_dict<istr, value> *t : tables)
+        for(auto &e : *t)
+            make_immortal(e.second);
+    // address space for far more code than there will be; only the pages
+    // used are ever touched
+    size_t size = (size_t)1 << 30;
+    void *arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(arena != MAP_FAILED){
+        char *begin = static_cast<char *>(arena);
+        frozen_code = {begin, begin, begin + size, true};
     }
-    file_stream.close();
+    for(auto &e : module_cache)
+        make_immortal(e.second.code);
+    frozen_code.open = false;
+}
 
-    file_stream.open(file_path, std::fstream::out); //open file in Output mode. This line will delete all data inside the file.
-    file_stream << buffer_string;
-    file_stream.close();
+// --prefork: answer the same requests as --serve, each connection in a
+// child forked from a process already warmed up. The scripts in preload
+// are compiled before the first fork, so children run them without
+// compiling; everything the parent set up is made immortal first, so
+// children share its pages copy-on-write instead of dirtying them with
+// reference counts. A child gets a fresh copy of the warm state, and
+// what it compiles or changes is gone when it exits. At most
+// max_children run at once; further connections wait to be accepted.
+int prefork(const string &path, const vector<string> &preload, int max_children) {
+    vector<string> paths;
+    if(!script_paths(preload, paths))
+        return -1;
+    for(const string &p : paths){
+        ifstream source(p.c_str());
+        if(source.fail()){
+            cout << "An error occurred while opening " << p << endl;
+            return -1;
+        }
+        // clients send the full path
+        string text((istreambuf_iterator<char>(source)), istreambuf_iterator<char>());
+        if(compile_cached(full_path(p), std::move(text)).is_null())
+            return -1;
+    }
+    power_tables::get();
+    current->freeze();
+#if defined(__GLIBC__)
+    // Give back what compiling freed. Left in the heap, those free chunks
+    // are what a child's first allocations walk and split, copying a page
+    // for nearly every one.
+    malloc_trim(0);
+#endif
+    int listener = listen_on(path);
+    if(listener < 0)
+        return -1;
+    cout.flush();
+    int children = 0;
+    while(true){
+        // reap the children that have finished, waiting for one while
+        // there are as many as allowed
+        while(children > 0 && waitpid(-1, NULL, children >= max_children ? 0 : WNOHANG) > 0)
+            children--;
+        int fd = accept(listener, NULL, NULL);
+        if(fd < 0){
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+        pid_t pid = fork();
+        if(pid == 0){
+            close(listener);
+            {
+                // each request has to arrive whole within idle_limit
+                connection client(fd);
+                while(wait_for_request(client, chrono::steady_clock::now() + chrono::seconds(idle_limit)) && serve_request(client)){
+                }
+            }
+            // destructors would only write to pages shared with the parent
+            _exit(0);
+        }
+        if(pid < 0)
+            cerr << "fork failed: " << strerror(errno) << endl;
+        else
+            children++;
+        close(fd);
+    }
+    cout << "accept failed: " << strerror(errno) << endl;
+    close(listener);
+    return -1;
 }
 
 // main program entry point
@@ -1326,9 +9963,62 @@ int main(int argc, char** argv) {
 		cout << "Invalid number of arguments. Filename is required." << endl;
         return -1;
 	}
-	string filename = argv[argc-1];
-
-    remove_empty_lines(filename);
+    bool dump_tokens = false;
+    int jobs = 0;
+    string socket_path, filename;
+    for(int i = 1; i < argc; i++){
+        string option = argv[i];
+        if(option == "--batch"){
+            interpreter main_interpreter;
+            current = &main_interpreter;
+            return run_batch(vector<string>(argv + i + 1, argv + argc), max(jobs, 1));
+        }
+        if(option == "--prefork" && i + 1 < argc){
+            interpreter main_interpreter;
+            current = &main_interpreter;
+            // --jobs caps the children, four a core by default
+            int cores = max(1, (int)thread::hardware_concurrency());
+            return prefork(argv[i + 1], vector<string>(argv + i + 2, argv + argc), jobs > 0 ? jobs : 4 * cores);
+        }
+        if(option == "--snapshot" && i + 2 < argc){
+            interpreter main_interpreter;
+            current = &main_interpreter;
+            return snapshot(argv[i + 1], vector<string>(argv + i + 2, argv + argc));
+        }
+        bool valued = option == "--serve" || option == "--time-limit" || option == "--image" || option == "--jobs";
+        if(valued && i + 1 == argc){
+            cout << "Option " << option << " needs a value" << endl;
+            return -1;
+        }
+        if(option == "--serve"){
+            socket_path = argv[++i];
+        }else if(option == "--time-limit"){
+            // seconds a served script may run, 0 for no limit
+            time_limit = max(0, atoi(argv[++i]));
+        }else if(option == "--image"){
+            // scripts in the image start without compiling
+            if(!map_image(argv[++i]))
+                return -1;
+        }else if(option == "--jobs"){
+            // 0 means a thread for each core
+            jobs = atoi(argv[++i]);
+            if(jobs <= 0)
+                jobs = max(1, (int)thread::hardware_concurrency());
+        }else if(option == "--tokens"){
+            dump_tokens = true;
+        }else if(i + 1 == argc){
+            filename = option;
+        }else{
+            cout << "Unknown option " << argv[i] << endl;
+            return -1;
+        }
+    }
+    if(!socket_path.empty())
+        return serve(socket_path, jobs > 0 ? jobs : max(1, (int)thread::hardware_concurrency()));
+    if(filename.empty()){
+        cout << "Invalid number of arguments. Filename is required." << endl;
+        return -1;
+    }
 
 	fstream source;
 
@@ -1339,18 +10029,11 @@ int main(int argc, char** argv) {
         return -1;
 	}
 
-	// Create the token list
-	token_parser parser(source);
-	parser.parse_tokens();
-	parser.print_tokens();
-
-    // token type (int), token value (string)
-    // vector<pair<int, string> > token_vector = parser.get_token_vector();
-
-    // deque<pair<int,string>> token_deque = parser.get_token_vector();
-    // deque<pair<int,string>> tokens = remove_whitespace(token_deque);
-    // for(auto &i : tokens){
-    //     cout << i.first << " " << i.second << endl;
-    // }
-    // evaluate(tokens);
+    interpreter main_interpreter;
+    current = &main_interpreter;
+    if(image_data != NULL && !dump_tokens){
+        source.close();
+        return run_batch_script(full_path(filename)) ? 0 : -1;
+    }
+    return run_script(source, dump_tokens);
 }
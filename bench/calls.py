@@ -0,0 +1,10 @@
+# plain function calls, the baseline for generators.py
+# the last line printed is the number of calls
+def add(a, b):
+    return a + b
+n = 5000000
+total = 0
+for i in range(n):
+    total = add(total, i)
+print(total)
+print(n)
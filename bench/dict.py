@@ -0,0 +1,28 @@
+# Dict insert, hit, miss, overwrite and delete at n keys; bench/run.sh sets n.
+# Small tables are rebuilt for several rounds so every size does about
+# the same number of operations; the last line printed is that number.
+n = 1000000
+rounds = 1
+if n < 4000000:
+    rounds = 4000000 // n
+ops = 0
+for r in range(rounds):
+    d = {}
+    for i in range(n):
+        d[i * 2654435761 % 4294967296] = i
+    hits = 0
+    for i in range(n):
+        if d.get(i * 2654435761 % 4294967296) == i:
+            hits += 1
+    misses = 0
+    for i in range(n):
+        if d.get(-1 - i) == None:
+            misses += 1
+    for i in range(0, n, 2):
+        d[i * 2654435761 % 4294967296] = -i
+    size = len(d)
+    for i in range(n):
+        del d[i * 2654435761 % 4294967296]
+    ops += 4 * n + n // 2
+print(size, len(d), hits, misses)
+print(ops)
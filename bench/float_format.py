@@ -0,0 +1,9 @@
+# str() of one million floats of assorted magnitudes
+total = 0
+x = 0.1
+for i in range(1000000):
+    x = x * 1.000123 + 0.37
+    if x > 1e12:
+        x = x / 1e15
+    total += len(str(x))
+print(total)
@@ -0,0 +1,14 @@
+# float() of one million strings, shortest forms and long ones
+texts = []
+x = 0.1
+for i in range(1000):
+    x = x * 1.37 + 0.11
+    if x > 1e12:
+        x = x / 1e15
+    texts.append(str(x))
+texts += ["3.141592653589793238462643383279", "1e-300", "6.02214076e23", "0.000001", "12345678901234567890"]
+total = 0.0
+for r in range(1000):
+    for t in texts:
+        total += float(t)
+print(total)
@@ -0,0 +1,28 @@
+# generators: a pipeline of generators, and send into a coroutine; the
+# last line printed is how many values numbers() made and send() sent
+def numbers(n):
+    i = 0
+    while i < n:
+        yield i
+        i += 1
+def evens(source):
+    for x in source:
+        if x % 2 == 0:
+            yield x
+def squares(source):
+    for x in source:
+        yield x * x
+total = 0
+for x in squares(evens(numbers(3000000))):
+    total += x
+def accumulate():
+    total = 0
+    while True:
+        got = yield total
+        total += got
+acc = accumulate()
+next(acc)
+for i in range(1000000):
+    last = acc.send(i)
+print(total, last)
+print(3000000 + 1000000)
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Builds mypython twice, once with every dict on the linear index and once
+# with every dict on the Swiss index, and runs bench/dict.py on each
+# through run.sh, so the two can be compared at the same sizes. Sets
+# always use a Swiss table and are not rebuilt for this.
+#
+#   bench/index_modes.sh [MyPython.cpp]
+#   DICT_SIZES="1000 1000000" bench/index_modes.sh
+dir=$(cd "$(dirname "$0")" && pwd)
+source=${1:-"$dir/../MyPython.cpp"}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+for mode in linear swiss; do
+    if [ "$mode" = linear ]; then
+        size="(1 << 30)"
+    else
+        size=0
+    fi
+    g++ --std=c++11 -O2 -pthread "-DMYPYTHON_DICT_LARGE_SIZE=$size" "$source" -o "$work/mypython" || exit 1
+    echo "$mode index:"
+    "$dir/run.sh" "$work/mypython" "$dir/dict.py"
+done
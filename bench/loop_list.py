@@ -0,0 +1,12 @@
+# for over a list, and nested range loops indexing it; the
+# last line printed is the number of iterations of the inner loops
+items = [i for i in range(1000)]
+total = 0
+for r in range(10000):
+    for x in items:
+        total += x
+for i in range(2000):
+    for j in range(1000):
+        total += items[j] - i
+print(total)
+print(10000 * 1000 + 2000 * 1000)
@@ -0,0 +1,8 @@
+# for over range, the specialised loop; the last line printed is the
+# number of iterations
+n = 20000000
+total = 0
+for i in range(n):
+    total += i
+print(total)
+print(n)
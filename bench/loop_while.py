@@ -0,0 +1,7 @@
+# a while loop counting with a compare and jump
+total = 0
+i = 0
+while i < 20000000:
+    total += i
+    i += 1
+print(total)
@@ -0,0 +1,25 @@
+# mandelbrot: float arithmetic in while loops, on a 400 by 400 grid
+def mandel(size):
+    count = 0
+    y = 0
+    while y < size:
+        ci = 2.0 * y / size - 1.0
+        x = 0
+        while x < size:
+            cr = 2.0 * x / size - 1.5
+            zr = 0.0
+            zi = 0.0
+            i = 0
+            while i < 50:
+                tr = zr * zr - zi * zi + cr
+                zi = 2.0 * zr * zi + ci
+                zr = tr
+                if zr * zr + zi * zi > 4.0:
+                    break
+                i += 1
+            if i == 50:
+                count += 1
+            x += 1
+        y += 1
+    return count
+print(mandel(400))
@@ -0,0 +1,78 @@
+#!/bin/sh
+# Times the bench scripts with mypython --batch, which reports how long
+# each script ran, and prints the best of $REPS runs (3 by default).
+# A script whose header says the last line it prints is its number of
+# operations also gets the time and the allocations per operation; the
+# allocations are counted in one more run with alloc_count.cpp preloaded,
+# less those of an empty script. dict.py and set.py are run once per size
+# in $DICT_SIZES. 100000000 keys need about 7 GB of memory, so that size
+# is only run when asked for:
+#
+#   bench/run.sh [mypython] [script.py...]
+#   DICT_SIZES="1000 100000000" bench/run.sh ./mypython bench/dict.py
+mypython=${1:-./mypython}
+[ $# -gt 0 ] && shift
+dir=$(cd "$(dirname "$0")" && pwd)
+reps=${REPS:-3}
+sizes=${DICT_SIZES:-"1000 10000 100000 1000000 10000000"}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+[ $# -eq 0 ] && set -- "$dir"/*.py
+: > "$work/empty.py"
+if g++ -shared -fPIC -O2 "$dir/alloc_count.cpp" -o "$work/alloc_count.so" 2> /dev/null; then
+    counted=yes
+else
+    echo "alloc_count.cpp did not build; not counting allocations" >&2
+fi
+
+# best <script>: the least time in ms over $reps runs; the script's
+# output is left in $work/out
+best() {
+    least=
+    for r in $(seq "$reps"); do
+        ms=$("$mypython" --batch "$1" 2>&1 > "$work/out" | awk '$2 == "ok" { print $3; exit }')
+        if [ -z "$ms" ]; then
+            echo "$1 failed" >&2
+            return 1
+        fi
+        least=$(echo "$ms $least" | awk '{ print ($2 == "" || $1 < $2) ? $1 : $2 }')
+    done
+    echo "$least"
+}
+
+# allocations <script>: how many allocations one run made
+allocations() {
+    LD_PRELOAD="$work/alloc_count.so" "$mypython" --batch "$1" 2>&1 > /dev/null | awk '$1 == "allocations" { print $2 }'
+}
+
+# report <label> <script>: the best time, and per operation figures for a
+# script that prints its operation count last
+report() {
+    ms=$(best "$2") || return
+    if ! grep -q 'last line printed is' "$2"; then
+        printf '%-16s %10s ms\n' "$1" "$ms"
+        return
+    fi
+    ops=$(tail -n 1 "$work/out")
+    ns=$(echo "$ms $ops" | awk '{ print $1 * 1e6 / $2 }')
+    if [ -z "$counted" ]; then
+        printf '%-16s %10s ms %8.1f ns/op\n' "$1" "$ms" "$ns"
+        return
+    fi
+    allocs=$(echo "$(allocations "$2") $base $ops" | awk '{ print ($1 - $2) / $3 }')
+    printf '%-16s %10s ms %8.1f ns/op %8.2f allocs/op\n' "$1" "$ms" "$ns" "$allocs"
+}
+
+[ -n "$counted" ] && base=$(allocations "$work/empty.py")
+
+for script in "$@"; do
+    name=$(basename "$script" .py)
+    if [ "$name" = dict ] || [ "$name" = set ]; then
+        for n in $sizes; do
+            sed "s/^n = .*/n = $n/" "$script" > "$work/$name.py"
+            report "$name $n" "$work/$name.py"
+        done
+    else
+        report "$name" "$script"
+    fi
+done
@@ -0,0 +1,26 @@
+# Set add, hit, miss and delete at n members; bench/run.sh sets n.
+# Small sets are rebuilt for several rounds so every size does about the
+# same number of operations; the last line printed is that number.
+n = 1000000
+rounds = 1
+if n < 4000000:
+    rounds = 4000000 // n
+ops = 0
+for r in range(rounds):
+    s = set()
+    for i in range(n):
+        s.add(i * 2654435761 % 4294967296)
+    hits = 0
+    for i in range(n):
+        if i * 2654435761 % 4294967296 in s:
+            hits += 1
+    misses = 0
+    for i in range(n):
+        if -1 - i not in s:
+            misses += 1
+    size = len(s)
+    for i in range(n):
+        s.remove(i * 2654435761 % 4294967296)
+    ops += 4 * n
+print(size, len(s), hits, misses)
+print(ops)
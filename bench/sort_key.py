@@ -0,0 +1,12 @@
+# sorted with a key function over strings and tuples
+words = []
+seed = 12345
+for i in range(200000):
+    seed = (seed * 1103515245 + 12345) % 2147483648
+    words.append("w" + str(seed % 1000003))
+by_length = sorted(words, key=len)
+pairs = []
+for i in range(200000):
+    pairs.append((i % 1000, words[i]))
+by_first = sorted(pairs, key=lambda p: p[0])
+print(by_length[0], by_first[0], by_first[-1])
@@ -0,0 +1,11 @@
+# sort one million ints in order except for one value in a hundred
+data = []
+seed = 12345
+for i in range(1000000):
+    seed = (seed * 1103515245 + 12345) % 2147483648
+    if seed % 100 == 0:
+        data.append(seed % 1000000)
+    else:
+        data.append(i)
+data.sort()
+print(data[0], data[500000], data[-1])
@@ -0,0 +1,8 @@
+# sort one million pseudo-random ints
+data = []
+seed = 12345
+for i in range(1000000):
+    seed = (seed * 1103515245 + 12345) % 2147483648
+    data.append(seed)
+data.sort()
+print(data[0], data[500000], data[-1])
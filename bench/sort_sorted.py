@@ -0,0 +1,7 @@
+# sort one million ints already in order, then in reverse order, ten times
+data = [i for i in range(1000000)]
+back = [i for i in range(1000000, 0, -1)]
+for r in range(10):
+    data.sort()
+    s = sorted(back)
+print(data[0], data[-1], s[0], s[-1])
@@ -0,0 +1,155 @@
+// The socket protocol between mypython --serve (or --prefork) and its
+// clients. A connection carries requests, one after another:
+//
+//   run <path>\n               run the script at path
+//   source <n>\n<n bytes>      run the n bytes of source that follow
+//
+// and gets back, for each, what the script prints as frames
+//
+//   out <n>\n<n bytes>
+//
+// as it is printed, then exit <status>\n with the status the script
+// would have exited with. Both ends read and write it through the
+// connection class here.
+#ifndef MYPYTHON_CONNECTION_H
+#define MYPYTHON_CONNECTION_H
+
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+// a connected socket, read through a buffer
+class connection
+{
+    private:
+        enum { chunk = 16384 };
+        int fd;
+        // what has been read; the bytes before start are used up
+        std::string buffer;
+        size_t start;
+        bool fill();
+    public:
+        connection(int f) : fd(f), start(0) { };
+        ~connection() { close(fd); };
+        int descriptor() const { return fd; };
+        // bytes read ahead that no request has used yet
+        bool buffered() const { return start < buffer.size(); };
+        const char *pending() const { return buffer.data() + start; };
+        size_t pending_size() const { return buffer.size() - start; };
+        long receive(int wait_ms, size_t limit);
+        bool read_line(std::string &line);
+        bool read_bytes(size_t n, std::string &s);
+        bool copy_bytes(size_t n, FILE *out);
+        bool write_all(const char *data, size_t n);
+};
+
+// false at the end of the stream, on an error, or when a receive timeout
+// set on the socket runs out
+inline bool connection::fill() {
+    ssize_t n;
+    buffer.resize(chunk);
+    do{
+        n = read(fd, &buffer[0], chunk);
+    }while(n < 0 && errno == EINTR);
+    start = 0;
+    buffer.resize(n > 0 ? (size_t)n : 0);
+    return n > 0;
+}
+
+// Wait up to wait_ms for bytes to arrive, then add all that have arrived
+// to the buffer, until limit bytes are pending. Returns how many were
+// added, 0 if none came in time, or -1 at the end of the stream or on an
+// error. A server reads requests this way without blocking on a client.
+inline long connection::receive(int wait_ms, size_t limit) {
+    pollfd p = {fd, POLLIN, 0};
+    int ready;
+    do{
+        ready = poll(&p, 1, wait_ms);
+    }while(ready < 0 && errno == EINTR);
+    if(ready <= 0)
+        return ready;
+    buffer.erase(0, start);
+    start = 0;
+    if(buffer.empty() && buffer.capacity() > chunk)
+        std::string().swap(buffer); // let go of a large request once used up
+    long added = 0;
+    while(buffer.size() < limit){
+        size_t old = buffer.size();
+        buffer.resize(old + chunk);
+        ssize_t n = recv(fd, &buffer[old], chunk, MSG_DONTWAIT);
+        buffer.resize(old + (n > 0 ? (size_t)n : 0));
+        if(n > 0)
+            added += n;
+        else if(n < 0 && errno == EINTR)
+            continue;
+        else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        else
+            return added > 0 ? added : -1; // the hang up is seen next time
+    }
+    return added;
+}
+
+// the next line without its newline; false at the end of the stream
+inline bool connection::read_line(std::string &line) {
+    line.clear();
+    while(true){
+        if(start == buffer.size() && !fill())
+            return false;
+        const char *data = buffer.data();
+        const char *newline = static_cast<const char *>(memchr(data + start, '\n', buffer.size() - start));
+        if(newline != NULL){
+            line.append(data + start, newline - (data + start));
+            start = newline - data + 1;
+            return true;
+        }
+        line.append(data + start, buffer.size() - start);
+        start = buffer.size();
+    }
+}
+
+inline bool connection::read_bytes(size_t n, std::string &s) {
+    s.clear();
+    while(s.size() < n){
+        if(start == buffer.size() && !fill())
+            return false;
+        size_t k = std::min(n - s.size(), buffer.size() - start);
+        s.append(buffer, start, k);
+        start += k;
+    }
+    return true;
+}
+
+// pass the next n bytes on to out, or drop them if out is NULL
+inline bool connection::copy_bytes(size_t n, FILE *out) {
+    while(n > 0){
+        if(start == buffer.size() && !fill())
+            return false;
+        size_t k = std::min(n, buffer.size() - start);
+        if(out != NULL)
+            fwrite(buffer.data() + start, 1, k, out);
+        start += k;
+        n -= k;
+    }
+    return true;
+}
+
+inline bool connection::write_all(const char *data, size_t n) {
+    while(n > 0){
+        ssize_t k = send(fd, data, n, MSG_NOSIGNAL);
+        if(k < 0 && errno == EINTR)
+            continue;
+        if(k <= 0)
+            return false;
+        data += k;
+        n -= (size_t)k;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,160 @@
+// A client for mypython --serve. It sends one script to the daemon
+// listening on a Unix socket, copies what the script prints to stdout as
+// it arrives, and exits with the script's status.
+//
+//   mypython-client <socket> <script>      run a script file
+//   mypython-client <socket> -             run source read from stdin
+//
+// With -n <count> it runs the script count times instead, each on a new
+// connection, throws the output away and reports the latency percentiles
+// on stderr. --launch <mypython> in place of the socket times starting
+// a fresh mypython process for each run, for comparison; options for
+// mypython can follow its path in the same argument, so
+//
+//   mypython-client -n 100 --launch "./mypython --image app.img" app.py
+//
+// is the startup benchmark for images.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "connection.h"
+
+using namespace std;
+
+int connect_to(const string &path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path))
+        return -1;
+    strcpy(address.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// send the request and relay the reply; the script's exit status, or -1
+// if the daemon could not be reached or hung up
+int run_remote(const string &socket_path, const string &request, FILE *out) {
+    int fd = connect_to(socket_path);
+    if(fd < 0){
+        cerr << "Cannot connect to " << socket_path << ": " << strerror(errno) << endl;
+        return -1;
+    }
+    connection daemon(fd);
+    if(!daemon.write_all(request.data(), request.size()))
+        return -1;
+    string line;
+    while(daemon.read_line(line)){
+        if(line.compare(0, 4, "out ") == 0){
+            if(!daemon.copy_bytes(strtoul(line.c_str() + 4, NULL, 10), out))
+                return -1;
+        }else if(line.compare(0, 5, "exit ") == 0){
+            if(out != NULL)
+                fflush(out);
+            return atoi(line.c_str() + 5);
+        }else{
+            break;
+        }
+    }
+    cerr << "The daemon hung up" << endl;
+    return -1;
+}
+
+// start mypython on the script and wait for it, its output thrown away;
+// command is the path of mypython and any options, split at spaces
+int run_local(const string &command, const string &script) {
+    vector<string> words;
+    size_t start = 0;
+    while(start < command.size()){
+        size_t end = command.find(' ', start);
+        if(end == string::npos)
+            end = command.size();
+        if(end > start)
+            words.push_back(command.substr(start, end - start));
+        start = end + 1;
+    }
+    words.push_back(script);
+    vector<char *> arguments;
+    for(string &w : words)
+        arguments.push_back(&w[0]);
+    arguments.push_back(NULL);
+    pid_t pid = fork();
+    if(pid == 0){
+        freopen("/dev/null", "w", stdout);
+        execv(arguments[0], arguments.data());
+        _exit(127);
+    }
+    int status;
+    if(pid < 0 || waitpid(pid, &status, 0) < 0)
+        return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char **argv) {
+    int count = 0;
+    string launch;
+    int i = 1;
+    for(; i < argc - 2; i++){
+        if(string(argv[i]) == "-n" && i + 1 < argc - 2){
+            count = atoi(argv[++i]);
+        }else if(string(argv[i]) == "--launch"){
+            break;
+        }else{
+            cerr << "Unknown option " << argv[i] << endl;
+            return -1;
+        }
+    }
+    if(i != argc - 2 && !(string(argv[i]) == "--launch" && i == argc - 3)){
+        cerr << "usage: mypython-client [-n count] <socket> <script | ->" << endl;
+        cerr << "       mypython-client -n count --launch \"<mypython> [options]\" <script>" << endl;
+        return -1;
+    }
+    if(string(argv[i]) == "--launch")
+        launch = argv[++i];
+    string target = argv[i];
+    string script = argv[i + 1];
+    string request;
+    if(launch.empty()){
+        if(script == "-"){
+            string text((istreambuf_iterator<char>(cin)), istreambuf_iterator<char>());
+            request = "source " + to_string(text.size()) + "\n" + text;
+        }else{
+            // the daemon may be running in another directory
+            char path[PATH_MAX];
+            if(realpath(script.c_str(), path) == NULL){
+                cerr << "An error occurred while opening " << script << endl;
+                return -1;
+            }
+            request = "run " + string(path) + "\n";
+        }
+    }
+    if(count <= 0)
+        return launch.empty() ? run_remote(target, request, stdout) : run_local(launch, script);
+    vector<double> latencies;
+    for(int k = 0; k < count; k++){
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        int status = launch.empty() ? run_remote(target, request, NULL) : run_local(launch, script);
+        latencies.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+        if(status < 0)
+            return -1;
+    }
+    sort(latencies.begin(), latencies.end());
+    fprintf(stderr, "%d runs: p50 %.1f us, p99 %.1f us, max %.1f us\n", count,
+        latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back());
+    return 0;
+}
@@ -0,0 +1,50 @@
+# In-place operators on locals and globals, with int fast paths
+a = 5
+a += 3
+a -= 1
+a *= 4
+a //= 3
+a %= 7
+a <<= 4
+a >>= 1
+a &= 0xff
+a |= 0x100
+a ^= 0x0f
+print(a)
+f = 1.5
+f += 1
+f *= 2
+f /= 4
+f -= 0.25
+print(f)
+s = "a"
+s += "b"
+s *= 3
+print(s)
+l = [1]
+l += [2, 3]
+print(l)
+n = 0
+for i in range(100000):
+    n += i
+    n ^= i
+print(n)
+def local():
+    x = 10
+    for i in range(1000):
+        x += i
+        x -= 1
+        x *= 1
+        x |= 1
+    return x
+print(local())
+b = True
+b &= False
+c = False
+c |= True
+print(b, c)
+def f():
+    x = True
+    x ^= True
+    return x
+print(f())
@@ -0,0 +1,14 @@
+# Keyword arguments, defaults and builtins called in place
+def f(a, b, c=3, d=4):
+    return (a, b, c, d)
+print(f(1, 2), f(1, 2, 5), f(1, b=2), f(d=1, c=2, b=3, a=4), f(1, 2, d=9))
+for i in range(3):
+    print(f(i, b=i * 2, d=i * 3))
+
+class K:
+    def m(self, x, y=0, z=0):
+        return x + 10 * y + 100 * z
+k = K()
+print(k.m(1), k.m(1, z=2), k.m(x=3, y=4), k.m(1, 2, z=3))
+print(max(3, 9, 2), min([4, 1, 7]), abs(-5), abs(-2.5), len("four"), len([1, 2]), len({1: 2}))
+print(sorted([3, 1, 2], reverse=True), float("2.5"), int(7.9), int(-7.9), str(1.0))
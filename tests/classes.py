@@ -0,0 +1,48 @@
+# Classes, instance attributes, inheritance and method calls
+class Point:
+    def __init__(self, x, y):
+        self.x = x
+        self.y = y
+    def norm2(self):
+        return self.x * self.x + self.y * self.y
+    def moved(self, dx, dy=0):
+        return Point(self.x + dx, self.y + dy)
+
+p = Point(3, 4)
+print(p.x, p.y, p.norm2(), p.moved(1).x, p.moved(1, dy=2).y)
+total = 0
+for i in range(1000):
+    q = Point(i, i + 1)
+    total += q.norm2()
+print(total)
+p.z = 5
+print(p.z, p.norm2())
+
+class Base:
+    kind = "base"
+    def name(self):
+        return "Base:" + self.kind
+    def hello(self):
+        return "hello from " + self.name()
+class Child(Base):
+    kind = "child"
+    def name(self):
+        return "Child:" + self.kind
+print(Base().hello(), Child().hello(), Child.kind)
+
+class Account:
+    count = 0
+    def __init__(self, owner):
+        self.owner = owner
+        self.balance = 0
+        Account.count += 1
+    def deposit(self, amount):
+        self.balance += amount
+        return self
+accounts = [Account("a" + str(i)) for i in range(5)]
+for i in range(5):
+    accounts[i].deposit(i).deposit(10)
+print(Account.count, [a.balance for a in accounts])
+m = accounts[2].deposit
+m(100)
+print(accounts[2].balance)
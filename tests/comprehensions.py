@@ -0,0 +1,15 @@
+# List, dict and set comprehensions with filters and nesting
+print([x * 2 for x in range(10)])
+print([x for x in range(20) if x % 3 == 0])
+print([(x, y) for x in range(3) for y in range(x)])
+print({x: x % 3 for x in range(7)})
+print(len({x % 5 for x in range(100)}))
+matrix = [[r * 3 + c for c in range(3)] for r in range(3)]
+print(matrix, [row[1] for row in matrix])
+words = "apple banana cherry".split()
+print({w: len(w) for w in words}, [w.upper() for w in words if len(w) > 5])
+x = "outer"
+ys = [x for x in range(3)]
+print(x, ys)
+big = [i for i in range(100000) if i % 7 == 0]
+print(len(big), big[-1])
@@ -0,0 +1,35 @@
+# Boolean operators short-circuit and comparison chains
+def loud(tag, v):
+    print("eval", tag)
+    return v
+print(loud("a", 0) and loud("b", 1))
+print(loud("c", 1) or loud("d", 1))
+print(loud("e", 1) and loud("f", "last"))
+print(loud("g", "") or loud("h", None) or loud("i", "found"))
+x = 5
+print(1 < x < 10, 1 < x > 10, 0 <= x <= 5 < 6, 10 > x >= 5 != 4)
+print(loud("j", 1) < loud("k", 0) < loud("l", 2))
+n = 0
+i = 0
+while i < 100:
+    if i % 3 == 0 and i % 5 == 0:
+        n += 100
+    elif i % 3 == 0 or i % 5 == 0:
+        n += 1
+    else:
+        n -= 1
+    i += 1
+print(n)
+for v in [0, 1, "", "s", [], [0], None, 0.0, 2.5]:
+    if v:
+        print("truthy", v)
+    else:
+        print("falsy", v)
+k = 0
+while True:
+    k += 1
+    if k > 10:
+        break
+    if k % 2:
+        continue
+    print("even", k)
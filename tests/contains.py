@@ -0,0 +1,23 @@
+d = {1: 2, "a": 3}
+s = {1, 2.5, (1, 2)}
+print(1 in d, "a" in d, 2 in d, 2 not in d, 1.0 in d)
+print(2.5 in s, (1, 2) in s, 3 in s, 3 not in s)
+print(3 in [1, 2, 3], 4 in [1, 2, 3], 2.0 in [1, 2], "x" in ["x"], [1] in [[1]])
+print("bc" in "abcd", "" in "a", "z" in "abc", "z" not in "abc")
+print(3 in range(0, 10, 3), 4 in range(0, 10, 3), -5 in range(0, -10, -5), 3.0 in range(5), 3.5 in range(5), "a" in range(5))
+print(9 in range(10**18), 10**18 in range(10**18), True in range(2))
+print(1 in (1, 2), 3 in (1, 2))
+def g():
+    yield 1
+    yield 2
+    yield 3
+it = g()
+print(2 in it, next(it))
+x = 5
+if x in [4, 5]:
+    print("yes")
+if x not in [4, 5]:
+    print("no")
+print(1 < 2 in [2], 1 in [1] in [[1]])
+print(not 1 in [1])
+print([k for k in range(6) if k in {1, 3}])
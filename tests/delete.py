@@ -0,0 +1,47 @@
+d = {}
+for k in range(20):
+    d[k] = k * k
+del d[3]
+del d[5], d[7]
+print(len(d), 3 in d, 4 in d, d.pop(4), d.pop(4, "gone"), 4 in d)
+print(sorted(d))
+d[3] = "back"
+print(d)
+for k in range(20):
+    if k in d:
+        del d[k]
+print(d, len(d))
+big = {}
+for k in range(100000):
+    big[k] = k
+for k in range(0, 100000, 2):
+    del big[k]
+print(len(big), 2 in big, 3 in big, big[99999])
+for k in range(0, 100000, 2):
+    big[k] = -k
+total = 0
+for v in big.values():
+    total += v
+print(len(big), big[2], total)
+s = set(range(10))
+s.discard(3)
+s.discard(30)
+s.remove(4)
+print(sorted(s), 3 in s, 5 in s, len(s))
+t = set()
+for k in range(50000):
+    t.add(k)
+for k in range(50000):
+    if k % 3 != 0:
+        t.remove(k)
+print(len(t), 3 in t, 4 in t)
+for k in range(50000):
+    t.add(k)
+print(len(t))
+l = [1, 2, 3, 4, 5]
+del l[0]
+del l[-1]
+print(l)
+l = ["a", "b", "c"]
+del l[1]
+print(l)
@@ -0,0 +1,23 @@
+# Ordered dicts: insertion order, replacement, mixed keys, counting
+d = {}
+for i in range(20):
+    d["k" + str(i)] = i * i
+print(len(d), d["k7"], d.get("k19"), d.get("missing"), d.get("missing", -1))
+d["k3"] = "replaced"
+print(d["k3"], len(d))
+order = ""
+for k in d.keys():
+    order += k[1:] + " "
+print(order)
+print(len(d.values()), len(d.items()))
+
+mixed = {1: "int", 1.5: "float", "1": "str", (1, 2): "tuple", None: "none"}
+print(mixed[1], mixed[1.0], mixed[1.5], mixed["1"], mixed[(1, 2)], mixed[None])
+print(mixed[True], len(mixed))
+
+words = "the quick brown fox jumps over the lazy dog the end".split()
+seen = {}
+for w in words:
+    seen[w] = seen.get(w, 0) + 1
+print(seen)
+print({x: x * x for x in range(6)})
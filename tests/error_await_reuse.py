@@ -0,0 +1,24 @@
+# await on a coroutine and on an object with __await__, driven by send();
+# awaiting a coroutine a second time raises
+class Ready:
+    def __init__(self, value):
+        self.value = value
+    def __await__(self):
+        yield "waiting"
+        return self.value
+
+async def double(x):
+    return 2 * x
+
+async def main():
+    a = await double(3)
+    print("double", a)
+    b = await Ready(5)
+    print("ready", b)
+    c = double(4)
+    print("first", await c)
+    print("second", await c)
+
+m = main()
+print(m.send(None))
+m.send(None)
@@ -0,0 +1,8 @@
+# Comparing nested lists deeper than the recursion limit raises
+a = []
+b = []
+for i in range(5000):
+    a = [a]
+    b = [b]
+print(a == a)
+print(a == b)
@@ -0,0 +1,4 @@
+# A comprehension over a range longer than memory can hold does not try
+# to make room for all of it before the first element
+print([x * x for x in range(5)])
+print([1 // (x - 3) for x in range(10 ** 18)])
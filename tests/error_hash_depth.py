@@ -0,0 +1,8 @@
+# Hashing tuples nested deeper than the recursion limit raises
+t = ()
+for i in range(5000):
+    t = (t,)
+d = {}
+d[(((1,),),)] = "shallow"
+print(len(d))
+d[t] = "deep"
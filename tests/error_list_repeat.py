@@ -0,0 +1,3 @@
+# Repeating a list past what memory can hold raises instead of aborting
+print([1, 2] * 2)
+l = [1, 2] * 4611686018427387904
@@ -0,0 +1,3 @@
+# A range with more items than fit in a machine word raises
+r = range(-9223372036854775807 - 1, 9223372036854775807)
+print(len(r))
@@ -0,0 +1,4 @@
+# Slicing a range with a step whose product overflows raises
+r = range(0, 9223372036854775807, 4611686018427387904)
+print(len(r), r[1], r[::-1][0])
+print(r[::4])
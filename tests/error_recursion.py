@@ -0,0 +1,5 @@
+# Unbounded recursion stops at the recursion limit
+def down(n):
+    return down(n + 1)
+print("start")
+down(0)
@@ -0,0 +1,6 @@
+# Printing a list nested deeper than the recursion limit raises
+a = []
+for i in range(5000):
+    a = [a]
+print(len(a))
+print(a)
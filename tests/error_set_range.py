@@ -0,0 +1,4 @@
+# A set of a range with more items than memory can hold raises instead of
+# aborting
+print(set(range(3)))
+print(set(range(10 ** 18)))
@@ -0,0 +1,13 @@
+# A key function sees the list empty while it is sorted, and adding to
+# the list from the key function raises once the keys are computed
+l = [3, 1, 2]
+def size_key(x):
+    print(len(l))
+    return -x
+l.sort(key=size_key)
+print(l)
+def growing_key(x):
+    l.append(x)
+    return x
+l.sort(key=growing_key)
+print(l)
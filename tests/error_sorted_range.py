@@ -0,0 +1,4 @@
+# Listing a range with more items than memory can hold raises instead of
+# aborting
+print(sorted(range(3)))
+print(sorted(range(10 ** 18)))
@@ -0,0 +1,4 @@
+# Repeating a string past what memory can hold raises instead of aborting
+s = "ab" * 3
+print(s)
+t = "ab" * 4611686018427387904
@@ -0,0 +1,17 @@
+# Shortest round-trip float repr and float() parsing
+values = [0.1, 0.2, 0.3, 1 / 3, 2 / 3, 1e16, 1e17, 1.5e-7, 123456789.125, 5e-324]
+values += [1.7976931348623157e308, 2.2250738585072014e-308, 100.0, 1e22, 1e23, 0.5, -0.0, 3.0e-5]
+for v in values:
+    print(v)
+texts = ["0.1", "1e-7", "1E10", "-2.5", "+3.25", "  4.5  ", "1000.5", "0.000001", "6.02214076e23"]
+texts += ["123456789012345678901234567890", "inf", "-inf", "2.2250738585072011e-308", "9007199254740993"]
+texts += ["1.00000000000000011102230246251565404236316680908203125"]
+for s in texts:
+    print(float(s))
+total = 0.0
+for i in range(1, 2000):
+    f = float(str(i / 7))
+    if f != i / 7:
+        total += 1
+print(total)
+print(str(0.1), str(1e-5), str(1e21), str(12.0), [0.1, 2.5], (1.0,))
@@ -0,0 +1,26 @@
+# Mixed int/float arithmetic and comparison, exact past 2**53
+big = 2 ** 53
+print(big + 1 == float(big + 1), big + 1 > float(big), float(big) < big + 1, big + 1 != float(big))
+huge = 9223372036854775807
+print(huge == 9223372036854775808.0, huge < 9223372036854775808.0, float(huge) > huge)
+print(-huge - 1 == -9223372036854775808.0, -huge - 1 <= -9.223372036854775808e18)
+nan = float("nan")
+inf = float("inf")
+print(nan == nan, nan != nan, nan < 1, nan > 1, 1 == nan, 1 != nan, nan <= inf)
+print(inf > huge, -inf < -huge, inf == inf, 1e308 < inf, -0.0 == 0, 0.0 == -0)
+d = {}
+d[1] = "int"
+d[1.0] = "float"
+d[2.5] = "x"
+d[big] = "big"
+print(len(d), d[1], d[float(big)], d[2.5])
+print(7 / 2, 1 / 3, 2 / 3, -7 / 2, 10 / 5, 2 ** 60 / 3, 9007199254740993 / 1)
+print(huge / 1, huge / 3, (2 ** 62 + 1) / 2 ** 62, -huge / 7)
+print(1.5 + 2, 3 * 0.1, 0.1 + 0.2, 1e16 + 1, 2.0 ** 10, 10 ** -2)
+print(int(2.9), int(-2.9), int(1e15), float(3), abs(-0.5), max(1, 2.5), min(-1, -1.5))
+print(7.0 // 2, -7.0 // 2, 7.5 % 2, -7.5 % 2, 7 % 2.5)
+x = 0.0
+for i in range(1000):
+    x += 0.001
+print(x)
+print(sorted([3, 1.5, -2, 2.0, 0.5]), 1 < 1.5 < 2, 2 == 2.0 == 2)
@@ -0,0 +1,51 @@
+# Functions, defaults, closures and nonlocal cells
+def add(a, b=10):
+    return a + b
+print(add(1), add(1, 2), add(b=5, a=1))
+
+def counter():
+    n = 0
+    def step(by=1):
+        nonlocal n
+        n += by
+        return n
+    return step
+c = counter()
+c()
+c()
+print(c(5), counter()())
+
+def make_adders():
+    adders = []
+    for i in range(3):
+        def adder(x, i=i):
+            return x + i
+        adders.append(adder)
+    return adders
+print([f(10) for f in make_adders()])
+
+def outer():
+    x = "outer"
+    def middle():
+        def inner():
+            return x
+        return inner
+    return middle()()
+print(outer())
+
+g = 1
+def read_global():
+    return g
+def write_global():
+    global g
+    g = 2
+write_global()
+print(read_global())
+
+def fib(n):
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+print(fib(20))
+square = lambda x: x * x
+print(square(7), (lambda: "no args")())
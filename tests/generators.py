@@ -0,0 +1,42 @@
+# Generators and coroutines: iteration, send, yield from, close
+def count_up(n):
+    i = 0
+    while i < n:
+        yield i
+        i += 1
+print([x for x in count_up(5)])
+g = count_up(3)
+print(next(g), next(g), next(g))
+
+def echo():
+    total = 0
+    while True:
+        got = yield total
+        total += got
+e = echo()
+next(e)
+print(e.send(5), e.send(10), e.send(-3))
+e.close()
+
+def inner():
+    yield 1
+    yield 2
+    return "done"
+def outer():
+    r = yield from inner()
+    yield r
+print([x for x in outer()])
+
+def squares(n):
+    for i in range(n):
+        yield i * i
+total = 0
+for s in squares(10000):
+    total += s
+print(total)
+
+def pipeline():
+    for x in squares(20):
+        if x % 2 == 0:
+            yield x
+print([x for x in pipeline()])
@@ -0,0 +1,35 @@
+# Lists: growth, indexing, slicing, equality and repr of nested lists
+a = []
+for i in range(1000):
+    a.append(i * 2)
+print(len(a), a[0], a[999], a[-1], a[-1000])
+print(a[10:15], a[:3], a[997:], a[::250], a[5:0:-2])
+a[3] = "three"
+print(a[2:5])
+print([1, 2.5, "x", None, True, (1,), [2]])
+print([1, [2, [3, [4]]]] == [1, [2, [3, [4]]]], [1, [2]] == [1, [3]], [1, 2] != [1, 2, 3])
+print([1, 2] < [1, 3], [1, 2] < [1, 2, 0], [2] > [1, 99], [] < [0])
+print([0] * 5, [1, 2] * 3, [] * 100, [1] * -1, [1, 2] + [3])
+
+# a list that contains itself
+b = [1, 2]
+b.append(b)
+print(b)
+print(b == b, len(b))
+c = {"self": None}
+c["self"] = c
+print(c)
+
+# deep nesting: compared, printed and freed without running out of stack
+deep = []
+for i in range(100000):
+    deep = [deep]
+other = []
+for i in range(100000):
+    other = [other]
+print(len(deep))
+deep = None
+other = None
+print("freed")
+m = [5, 3, 8, 1]
+print(max(m), min(m), sorted(m), len(m))
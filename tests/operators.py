@@ -0,0 +1,8 @@
+# Binary operators over int, float, str, list and tuple pairs
+print(7 + 2, 7 - 2, 7 * 2, 7 / 2, 7 // 2, 7 % 2, 7 ** 2, -7 // 2, -7 % 2, 7 % -2)
+print(7.5 + 2, 7 - 2.5, 2 * 3.5, 7.0 / 2, 7.5 // 2, 7.5 % 2, 2 ** 0.5, 2 ** -1)
+print(6 << 2, 100 >> 3, 12 & 10, 12 | 10, 12 ^ 10, -1 >> 5, 1 << 62)
+print(True & False, True | False, True ^ True, False ^ True, True & 3, 2 | False, True ^ 1)
+print(9223372036854775807 + 0, -9223372036854775807 - 1)
+print("ab" + "cd", [1] + [2], (1,) + (2,), "x" * 3, 3 * "y", [0] * 3)
+print(-5, -(-5), -2.5, not 0, not [], not [0], 3 == 3.0, 2 != 2.0)
@@ -0,0 +1,23 @@
+# Lazy ranges: lengths, indexing, slicing and for loops over them
+print(len(range(10)), len(range(3, 10)), len(range(10, 3)), len(range(0, 10, 3)), len(range(10, 0, -3)))
+r = range(5, 50, 5)
+print(r[0], r[-1], r[3], len(r), r[2:5], r[::-1], r[::-1][0])
+print(range(7), range(2, 9), range(0, 10, 2))
+s = 0
+for i in range(1000000):
+    s += i
+print(s)
+s = 0
+for i in range(100, 0, -7):
+    s += i
+print(s)
+n = 9223372036854775807
+big = range(n - 3, n)
+print(len(big), big[0], big[-1], big[::-1][0], big[::-1][2], len(big[::-1]))
+neg = range(-n, -n + 6, 2)
+print(len(neg), neg[2], neg[::-1][0])
+print(len(range(-5, 5)), len(range(0, -5, -1)), len(range(1, 1)))
+total = 0
+for x in [1, 2, 3, 4]:
+    total = total * 10 + x
+print(total)
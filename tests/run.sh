@@ -0,0 +1,101 @@
+#!/bin/sh
+# Runs every tests/*.py and compares what it prints with tests/*.out: once
+# on its own, once all together in a --batch, once from a --snapshot
+# image, and once each through --serve and --prefork with the client.
+# tests/syntax/ holds scripts that must fail to compile: they are run on
+# their own, and sent as source to --serve, which must go on serving.
+# Last, --serve with one worker must answer while another client stalls
+# part way through a request, and refuse a source over its size limit.
+#
+#   tests/run.sh [mypython] [mypython-client]
+#
+# To accept a changed output, rerun the script and write it over its .out.
+mypython=${1:-./mypython}
+client=${2:-./mypython-client}
+dir=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+failed=0
+trap 'rm -rf "$work"' EXIT
+
+# check <name> <expected file> <actual file>
+check() {
+    if ! cmp -s "$2" "$3"; then
+        echo "FAIL $1"
+        diff "$2" "$3" | head -20
+        failed=$((failed + 1))
+    fi
+}
+
+for t in "$dir"/*.py "$dir"/syntax/*.py; do
+    "$mypython" "$t" > "$work/out" 2>&1
+    check "$(basename "$t")" "${t%.py}.out" "$work/out"
+done
+
+cat "$dir"/*.out > "$work/expected"
+"$mypython" --jobs 4 --batch "$dir"/*.py > "$work/out" 2> /dev/null
+check "--batch" "$work/expected" "$work/out"
+
+"$mypython" --snapshot "$work/image" "$dir"/*.py > /dev/null
+for t in "$dir"/*.py; do
+    "$mypython" --image "$work/image" "$t" > "$work/out" 2>&1
+    check "--image $(basename "$t")" "${t%.py}.out" "$work/out"
+done
+
+# serve <mode> <options>...: start mypython on a socket, wait for it
+serve() {
+    mode=$1
+    shift
+    rm -f "$work/socket"
+    "$mypython" "$@" &
+    server=$!
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        [ -S "$work/socket" ] && return
+        sleep 0.2
+    done
+    echo "FAIL $mode did not start"
+    failed=$((failed + 1))
+}
+
+for mode in --serve --prefork; do
+    if [ $mode = --serve ]; then
+        serve $mode --serve "$work/socket" --time-limit 1
+    else
+        serve $mode --time-limit 1 --prefork "$work/socket" "$dir"/*.py
+    fi
+    for t in "$dir"/*.py "$dir"/serve/*.py; do
+        "$client" "$work/socket" "$t" > "$work/out" 2>&1
+        check "$mode $(basename "$t")" "${t%.py}.out" "$work/out"
+    done
+    for t in "$dir"/syntax/*.py; do
+        "$client" "$work/socket" - < "$t" > "$work/out" 2>&1
+        check "$mode $(basename "$t")" "${t%.py}.out" "$work/out"
+    done
+    kill $server
+    wait $server 2> /dev/null
+done
+
+serve "stalled --serve" --serve "$work/socket" --jobs 1
+perl -MIO::Socket::UNIX -e '
+    $s = IO::Socket::UNIX->new(Peer => $ARGV[0]) or die;
+    $s->autoflush(1);
+    print $s "source 100\nprint(";
+    sleep 30;' "$work/socket" &
+staller=$!
+sleep 0.5
+timeout 5 "$client" "$work/socket" "$dir/strings.py" > "$work/out" 2>&1
+check "stalled --serve strings.py" "$dir/strings.out" "$work/out"
+head -c 17000000 /dev/zero | tr '\0' '#' > "$work/huge.py"
+if timeout 5 "$client" "$work/socket" - < "$work/huge.py" > /dev/null 2>&1; then
+    echo "FAIL --serve ran a source over its size limit"
+    failed=$((failed + 1))
+fi
+timeout 5 "$client" "$work/socket" "$dir/strings.py" > "$work/out" 2>&1
+check "--serve after refusing a source" "$dir/strings.out" "$work/out"
+kill $staller $server
+wait $staller $server 2> /dev/null
+
+if [ $failed -ne 0 ]; then
+    echo "$failed failed"
+    exit 1
+fi
+echo "all passed"
@@ -0,0 +1,4 @@
+# Run by tests/run.sh under --serve --time-limit 1 only: never ends by itself
+print("spinning")
+while True:
+    pass
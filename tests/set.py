@@ -0,0 +1,19 @@
+# Sets, and dicts grown past a 2 byte index
+big = {}
+n = 100000
+for i in range(n):
+    big[i * 7919 % 1000003] = i
+total = 0
+for k in big.keys():
+    total += big[k]
+print(len(big), total, big[7919], big.get(-1))
+for i in range(0, n, 2):
+    big[i * 7919 % 1000003] = -i
+print(len(big), big[2 * 7919 % 1000003])
+
+s = set()
+for i in range(1000):
+    s.add(i % 37)
+print(len(s))
+t = set([1, 2, 3, 2, 1])
+print(len(t), t == set([3, 2, 1]), t == set([1, 2]))
@@ -0,0 +1,7 @@
+# String slices, including large ones that share their source text
+s = "the quick brown fox jumps over the lazy dog"
+long = "ab" * 5000 + "needle" + "cd" * 5000
+print(s[4:9], s[-3:], s[::-1][:3], s[::5], s[100:], len(s[0:0]))
+view = long[1000:9000]
+print(len(view), view[:4], view.find("needle"), view.count("d"))
+print(long[2:8], long[-3:], len(long[::2]), long[9990:10016])
@@ -0,0 +1,42 @@
+# list.sort and sorted: stability, keys, reverse, and runs
+def lcg(seed):
+    return (seed * 1103515245 + 12345) % 2147483648
+
+data = []
+seed = 42
+for i in range(2000):
+    seed = lcg(seed)
+    data.append(seed % 1000)
+s = sorted(data)
+ok = True
+for i in range(1, len(s)):
+    if s[i - 1] > s[i]:
+        ok = False
+print(ok, len(s), s[0], s[-1])
+print(sorted(data, reverse=True)[:5])
+recs = []
+for i in range(200):
+    recs.append((data[i] % 5, i))
+byk = sorted(recs, key=lambda r: r[0])
+stable = True
+for i in range(1, len(byk)):
+    if byk[i - 1][0] == byk[i][0] and byk[i - 1][1] > byk[i][1]:
+        stable = False
+print(stable, byk[:4])
+words = "banana Apple cherry apple Banana date".split()
+print(sorted(words), sorted(words, key=lambda w: w.lower()), sorted(words, key=len, reverse=True))
+up = [i for i in range(1000)]
+up.sort()
+print(up[:3], up[-3:])
+down = [i for i in range(1000, 0, -1)]
+down.sort()
+print(down[:3], down[-3:])
+part = [i for i in range(500)] + [7, 3, 9] + [i for i in range(500, 1000)]
+part.sort()
+print(part[:5], part[-2:])
+calls = []
+def key(x):
+    calls.append(x)
+    return -x
+print(sorted([5], key=key), calls)
+print(sorted([]), sorted([2.5, 1, 3, -0.5]), sorted(["b", "a"]))
@@ -0,0 +1,13 @@
+# String search, split, join, replace and case
+s = "the quick brown fox jumps over the lazy dog"
+print(s.find("fox"), s.find("the", 1), s.find("cat"), s.count("o"), s.count("the"), s.count(""))
+print(s.split(), s.split("o"), "a,,b,".split(","), "  lead and trail  ".split())
+print("-".join(["a", "b", "c"]), "".join([]), ", ".join(s.split()[:3]))
+print(s.replace("the", "a"), "aaaa".replace("a", "bb"), "abc".replace("", "-"))
+print(s.upper(), "MiXeD 123".lower())
+long = "ab" * 5000 + "needle" + "cd" * 5000
+print(len(long), long.find("needle"), long.count("ab"), long.count("needle"))
+print(len(long.split("needle")[0]), len(long.replace("ab", "")))
+print("a" < "b", "abc" < "abd", "b" > "abc", "x" == "x", "" < "a")
+print(str(12) + str(3.5) + str(None) + str(True), int("42") + 1, "ab" * 3)
+print(len("tab\there"), "new\nline", 'single "quotes"')
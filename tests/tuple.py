@@ -0,0 +1,20 @@
+# Tuples and multiple assignment
+t = (1, "two", 3.0)
+print(t, len(t), t[1], t[-1], t[0:2], (), (1,))
+a, b, c = t
+print(a, b, c)
+x, y = 1, 2
+x, y = y, x
+print(x, y)
+x, y, z = (3, 4, 5)
+print(x, y, z)
+p = (0, 0)
+q = (0, 0)
+print(p == q, (1, 2) < (1, 3), (1, 2) == (1, 2.0), (1, (2, 3)) == (1, (2, 3)))
+pairs = [(3, "c"), (1, "a"), (2, "b")]
+for k, v in pairs:
+    print(k, v)
+print(sorted(pairs))
+d = {(1, 2): "a", ((1, 2), 3): "b"}
+print(d[(1, 2)], d[((1, 2), 3)])
+print((1, 2) * 2, (1,) + (2, 3))